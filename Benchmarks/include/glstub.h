@@ -0,0 +1,8 @@
+#ifndef GLSTUB_H
+#define GLSTUB_H
+
+// Points the glad function pointers used by the loaders at stubs that only hand out object names,
+// so the CPU side of texture and mesh uploads can be measured without a GPU or a context
+void loadStubGL();
+
+#endif
@@ -0,0 +1,51 @@
+#include "glstub.h"
+
+#include <glad/glad.h>
+
+// every Gen* call returns fresh names, like a driver would
+static GLuint nextName = 1;
+
+static void APIENTRY stubGenNames(GLsizei n, GLuint* names)
+{
+    for (GLsizei i = 0; i < n; i++)
+        names[i] = nextName++;
+}
+
+static void APIENTRY stubBind(GLenum, GLuint) {}
+static void APIENTRY stubBindVertexArray(GLuint) {}
+static void APIENTRY stubTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*) {}
+static void APIENTRY stubGenerateMipmap(GLenum) {}
+static void APIENTRY stubTexParameteri(GLenum, GLenum, GLint) {}
+static void APIENTRY stubBufferData(GLenum, GLsizeiptr, const void*, GLenum) {}
+static void APIENTRY stubEnableVertexAttribArray(GLuint) {}
+static void APIENTRY stubVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {}
+static void APIENTRY stubVertexAttribIPointer(GLuint, GLint, GLenum, GLsizei, const void*) {}
+
+static const GLubyte* APIENTRY stubGetString(GLenum name)
+{
+    static const GLubyte version[] = "3.3.0 stub";
+    static const GLubyte none[] = "stub";
+    return name == GL_VERSION ? version : none;
+}
+
+void loadStubGL()
+{
+    GLVersion.major = 3;
+    GLVersion.minor = 3;
+    glad_glGetString = stubGetString;
+
+    glad_glGenTextures = stubGenNames;
+    glad_glBindTexture = stubBind;
+    glad_glTexImage2D = stubTexImage2D;
+    glad_glGenerateMipmap = stubGenerateMipmap;
+    glad_glTexParameteri = stubTexParameteri;
+
+    glad_glGenVertexArrays = stubGenNames;
+    glad_glGenBuffers = stubGenNames;
+    glad_glBindVertexArray = stubBindVertexArray;
+    glad_glBindBuffer = stubBind;
+    glad_glBufferData = stubBufferData;
+    glad_glEnableVertexAttribArray = stubEnableVertexAttribArray;
+    glad_glVertexAttribPointer = stubVertexAttribPointer;
+    glad_glVertexAttribIPointer = stubVertexAttribIPointer;
+}
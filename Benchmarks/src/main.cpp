@@ -0,0 +1,429 @@
+#include <benchmark/benchmark.h>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/random.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "model.h"
+#include "texture.h"
+#include "compression.h"
+#include "transformation.h"
+#include "culling.h"
+#include "occlusion.h"
+#include "bvh.h"
+#include "noise.h"
+#include "jobs.h"
+#include "glstub.h"
+
+// Microbenchmarks for the CPU hot paths of the planets program. They run without a GPU, the GL calls of
+// the loaders go to the stubs in glstub.cpp. Run from the GraphicsAssingnment directory or pass --assets.
+// Results are also written as JSON (benchmark_results.json unless --benchmark_out is given), compare two
+// runs with Google Benchmark's tools/compare.py.
+
+// the models and textures the program loads, relative to the assets directory
+static const char* MODELS[][2] = {
+    { "Sun", "objects/sun/scene.gltf" },
+    { "Moon", "objects/moon/Moon.obj" },
+    { "Earth", "objects/earth/Earth.obj" },
+};
+static const char* TEXTURES[][2] = {
+    { "Sun", "objects/sun/textures/Material.002_diffuse.jpeg" },
+    { "Moon", "objects/moon/Diffuse.png" },
+    { "Earth", "objects/earth/Textures/Diffuse_2K.png" },
+};
+
+// uploadTexture logs every texture, which would drown the benchmark output
+class SilenceCout {
+public:
+    SilenceCout() : _previous(std::cout.rdbuf(_sink.rdbuf())) {}
+    ~SilenceCout() { std::cout.rdbuf(_previous); }
+
+private:
+    std::ostringstream _sink;
+    std::streambuf* _previous;
+};
+
+// loader
+// ------
+static void BM_ProcessMesh(benchmark::State& state, const std::string& path)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, Model::importFlags);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        state.SkipWithError(("could not import " + path).c_str());
+        return;
+    }
+
+    Model model;
+    int64_t vertices = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+        vertices += scene->mMeshes[i]->mNumVertices;
+
+    for (auto _ : state)
+    {
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+        {
+            Model::PendingMesh pending;
+            model.processMesh(scene->mMeshes[i], pending);
+            benchmark::DoNotOptimize(pending.vertices.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * vertices);
+    state.counters["vertices"] = static_cast<double>(vertices);
+}
+
+// the whole CPU half of a model load: ASSIMP import, mesh conversion and texture decoding on the job system
+static void BM_LoadModel(benchmark::State& state, const std::string& path)
+{
+    if (!std::ifstream(path))
+    {
+        state.SkipWithError(("missing " + path).c_str());
+        return;
+    }
+    for (auto _ : state)
+    {
+        Model model;
+        model.loadModel(path);
+        benchmark::DoNotOptimize(model.boundingRadius);
+    }
+}
+
+// texture
+// -------
+static void BM_DecodeTexture(benchmark::State& state, const std::string& path)
+{
+    int64_t bytes = 0;
+    for (auto _ : state)
+    {
+        TextureImage image = decodeTexture(path);
+        if (!image.data)
+        {
+            state.SkipWithError(("could not decode " + path).c_str());
+            return;
+        }
+        bytes = static_cast<int64_t>(image.width) * image.height * image.nrComponents;
+        stbi_image_free(image.data);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+static void BM_TextureFromFile(benchmark::State& state, const std::string& path)
+{
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    std::string file = path.substr(path.find_last_of('/') + 1);
+    if (!std::ifstream(path))
+    {
+        state.SkipWithError(("missing " + path).c_str());
+        return;
+    }
+    SilenceCout silence;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(TextureFromFile(file.c_str(), directory));
+}
+
+// block compresses the decoded image, the one-time cost of loading a texture compressed
+static void BM_CompressTexture(benchmark::State& state, const std::string& path)
+{
+    TextureImage image = decodeTexture(path);
+    if (!image.data)
+    {
+        state.SkipWithError(("could not decode " + path).c_str());
+        return;
+    }
+    std::vector<unsigned char> blocks(compressedSize(image.width, image.height, image.nrComponents));
+    for (auto _ : state)
+    {
+        compressImage(image.data, image.width, image.height, image.nrComponents, blocks.data());
+        benchmark::DoNotOptimize(blocks.data());
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.width) * image.height * image.nrComponents);
+    state.counters["ratio"] = static_cast<double>(image.width) * image.height * image.nrComponents / blocks.size();
+    stbi_image_free(image.data);
+}
+
+// transformations
+// ---------------
+// evaluates the moon's chain (sun orbit, earth orbit, spin) for state.range(0) bodies, like the update phase does
+static void BM_TransformationChain(benchmark::State& state)
+{
+    std::vector<Transformation> chain = { Transformation(47.0f, 20.0f), Transformation(3.0f, 3.0f), Transformation(0.0f, 4.0f) };
+    std::vector<glm::mat4> positions(static_cast<size_t>(state.range(0)));
+    float time = 0.0f;
+    for (auto _ : state)
+    {
+        for (auto& position : positions)
+        {
+            glm::mat4 model = glm::mat4(1.0f);
+            for (auto& transformation : chain)
+                model = transformation.use(model, time);
+            position = model;
+        }
+        benchmark::DoNotOptimize(positions.data());
+        time += 1.0f / 60.0f;
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformationChain)->Arg(3)->Arg(1000)->Arg(100000);
+
+// culling
+// -------
+static glm::mat4 benchmarkViewProjection()
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 10000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(40.0f, 0.0f, 50.0f), glm::vec3(40.0f, 0.0f, 49.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    return projection * view;
+}
+
+static void BM_FrustumFromMatrix(benchmark::State& state)
+{
+    glm::mat4 viewProjection = benchmarkViewProjection();
+    for (auto _ : state)
+    {
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        benchmark::DoNotOptimize(frustum.planes);
+        viewProjection[3][0] += 1e-6f;
+    }
+}
+BENCHMARK(BM_FrustumFromMatrix);
+
+// spheres spread like the star field, a seeded rand keeps every run identical
+static std::vector<glm::vec4> benchmarkSpheres(size_t count)
+{
+    std::srand(1);
+    std::vector<glm::vec4> spheres;
+    spheres.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        spheres.push_back(glm::vec4(glm::sphericalRand(500.0f), 0.87f));
+    return spheres;
+}
+
+static void BM_CullSpheres(benchmark::State& state)
+{
+    Frustum frustum = Frustum::fromMatrix(benchmarkViewProjection());
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    std::vector<unsigned char> visible;
+    for (auto _ : state)
+    {
+        cullSpheres(frustum, spheres, visible);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullSpheres)->Arg(1000)->Arg(100000)->UseRealTime();
+
+// the largest spheres of a benchmarkSpheres set as occluders, the rest tested against them
+static void BM_OcclusionCull(benchmark::State& state)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 10000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(40.0f, 0.0f, 50.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    std::vector<unsigned char> visible(spheres.size(), 1);
+    OcclusionBuffer occlusion;
+    for (auto _ : state)
+    {
+        occlusion.begin(view, projection);
+        occlusion.addOccluder(glm::vec3(0.0f), 20.0f);
+        for (unsigned int i = 0; i < 15; i++)
+            occlusion.addOccluder(glm::vec3(spheres[i]) * 0.1f, 5.0f);
+        occlusion.finish();
+        std::fill(visible.begin(), visible.end(), 1);
+        cullOccluded(occlusion, spheres, visible);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OcclusionCull)->Arg(1000)->Arg(100000)->UseRealTime();
+
+// the same culling through a BVH, compare with BM_CullSpheres
+static void BM_BvhCull(benchmark::State& state)
+{
+    Frustum frustum = Frustum::fromMatrix(benchmarkViewProjection());
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    std::vector<unsigned char> visible;
+    BVH bvh;
+    bvh.build(spheres);
+    for (auto _ : state)
+    {
+        bvh.cullFrustum(frustum, visible);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BvhCull)->Arg(1000)->Arg(100000)->UseRealTime();
+
+static void BM_BvhBuild(benchmark::State& state)
+{
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    BVH bvh;
+    for (auto _ : state)
+    {
+        bvh.build(spheres);
+        benchmark::DoNotOptimize(bvh.nodes().data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BvhBuild)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+// every sphere moves a little each iteration, like the bodies between two frames
+static void BM_BvhRefit(benchmark::State& state)
+{
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    BVH bvh;
+    bvh.build(spheres);
+    for (auto _ : state)
+    {
+        for (auto& sphere : spheres)
+            sphere.x += 0.01f;
+        benchmark::DoNotOptimize(bvh.refit(spheres));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BvhRefit)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+static void BM_BvhRaycast(benchmark::State& state)
+{
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    BVH bvh;
+    bvh.build(spheres);
+    glm::vec3 origin(40.0f, 0.0f, 50.0f);
+    unsigned int hit;
+    float distance;
+    for (auto _ : state)
+    {
+        glm::vec3 direction = glm::sphericalRand(1.0f);
+        benchmark::DoNotOptimize(bvh.raycast(origin, direction, hit, distance));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BvhRaycast)->Arg(1000)->Arg(100000);
+
+// six octaves of simplex fBm on whatever instruction set the CPU has, see the label
+static void BM_Noise(benchmark::State& state)
+{
+    size_t count = static_cast<size_t>(state.range(0));
+    std::vector<glm::vec4> positions = benchmarkSpheres(count);
+    std::vector<float> x(count), y(count), z(count), result(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        x[i] = positions[i].x * 0.01f;
+        y[i] = positions[i].y * 0.01f;
+        z[i] = positions[i].z * 0.01f;
+    }
+    NoiseSettings settings;
+    for (auto _ : state)
+    {
+        evaluateNoise(settings, x.data(), y.data(), z.data(), result.data(), count);
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetLabel(noiseInstructionSet());
+}
+BENCHMARK(BM_Noise)->Arg(4096)->Arg(65536);
+
+// the albedo and height maps of a generated planet, the argument is the width
+static void BM_PlanetMaps(benchmark::State& state)
+{
+    int width = static_cast<int>(state.range(0));
+    PlanetStyle style = randomPlanetStyle(1, false);
+    PlanetMaps maps;
+    for (auto _ : state)
+    {
+        generatePlanetMaps(style, width, width / 2, maps);
+        benchmark::DoNotOptimize(maps.albedo.data());
+    }
+    state.SetItemsProcessed(state.iterations() * width * (width / 2));
+    state.SetLabel(noiseInstructionSet());
+}
+BENCHMARK(BM_PlanetMaps)->Arg(512)->Arg(2048)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// builds and sorts a draw list the way the culling phase does
+static void BM_SortKeys(benchmark::State& state)
+{
+    std::vector<glm::vec4> spheres = benchmarkSpheres(static_cast<size_t>(state.range(0)));
+    glm::vec3 cameraPosition(40.0f, 0.0f, 50.0f);
+    std::vector<DrawItem> drawList;
+    drawList.reserve(spheres.size());
+    for (auto _ : state)
+    {
+        drawList.clear();
+        for (unsigned int i = 0; i < spheres.size(); i++)
+        {
+            float depth = glm::length(glm::vec3(spheres[i]) - cameraPosition);
+            drawList.push_back({ makeSortKey(i % 3, i % 7, depth), i });
+        }
+        std::sort(drawList.begin(), drawList.end());
+        benchmark::DoNotOptimize(drawList.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SortKeys)->Arg(3)->Arg(1000)->Arg(100000);
+
+int main(int argc, char** argv)
+{
+    // the main thread has to be the first one to touch the job system so it becomes worker 0
+    jobSystem();
+    loadStubGL();
+
+    // --assets is ours, everything else goes to Google Benchmark
+    std::string assets = "./assets";
+    std::vector<char*> arguments;
+    bool hasOutput = false;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--assets" && i + 1 < argc)
+        {
+            assets = argv[++i];
+            continue;
+        }
+        if (argument.compare(0, 16, "--benchmark_out=") == 0)
+            hasOutput = true;
+        arguments.push_back(argv[i]);
+    }
+    std::string output = "--benchmark_out=benchmark_results.json";
+    std::string outputFormat = "--benchmark_out_format=json";
+    if (!hasOutput)
+    {
+        arguments.push_back(&output[0]);
+        arguments.push_back(&outputFormat[0]);
+    }
+
+    for (auto& model : MODELS)
+    {
+        std::string path = assets + "/" + model[1];
+        benchmark::RegisterBenchmark((std::string("BM_ProcessMesh/") + model[0]).c_str(), [path](benchmark::State& state) { BM_ProcessMesh(state, path); });
+        benchmark::RegisterBenchmark((std::string("BM_LoadModel/") + model[0]).c_str(), [path](benchmark::State& state) { BM_LoadModel(state, path); })
+            ->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+    for (auto& texture : TEXTURES)
+    {
+        std::string path = assets + "/" + texture[1];
+        benchmark::RegisterBenchmark((std::string("BM_DecodeTexture/") + texture[0]).c_str(), [path](benchmark::State& state) { BM_DecodeTexture(state, path); })
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark((std::string("BM_TextureFromFile/") + texture[0]).c_str(), [path](benchmark::State& state) { BM_TextureFromFile(state, path); })
+            ->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark((std::string("BM_CompressTexture/") + texture[0]).c_str(), [path](benchmark::State& state) { BM_CompressTexture(state, path); })
+            ->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+
+    int count = static_cast<int>(arguments.size());
+    benchmark::Initialize(&count, arguments.data());
+    if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
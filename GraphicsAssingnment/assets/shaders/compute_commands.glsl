@@ -0,0 +1,26 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// copies the number of visible instances of every batch into the draw commands of its meshes
+
+struct DrawElementsIndirectCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 2) readonly buffer BatchCounts { uint batchCounts[]; };
+layout (std430, binding = 5) buffer Commands { DrawElementsIndirectCommand commands[]; };
+layout (std430, binding = 6) readonly buffer CommandBatches { uint commandBatches[]; };
+
+uniform uint commandCount;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= commandCount)
+        return;
+    commands[i].instanceCount = batchCounts[commandBatches[i]];
+}
@@ -0,0 +1,124 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// places every object with its motions, culls it against the frustum and appends the visible ones
+// to the instances of their batch
+
+struct ObjectRecord {
+    vec4 scale;         // xyz scale, w bounding radius of the unscaled model
+    uint firstMotion;
+    uint motionCount;
+    uint batch;
+    uint impostorBatch; // 0xFFFFFFFF for models that aren't round
+};
+
+layout (std430, binding = 0) readonly buffer Objects { ObjectRecord objects[]; };
+layout (std430, binding = 1) readonly buffer Motions { vec4 motions[]; };     // radius, period, phase
+layout (std430, binding = 2) buffer BatchCounts { uint batchCounts[]; };
+layout (std430, binding = 3) readonly buffer BatchFirsts { uint batchFirsts[]; };
+layout (std430, binding = 4) writeonly buffer Instances { mat4 instances[]; };
+
+uniform uint objectCount;
+uniform float time;
+uniform vec4 planes[6];
+uniform vec3 cameraPosition;
+uniform float projectedScale;   // on-screen radius in pixels of a unit sphere at distance 1
+uniform float minimumRadius;    // in pixels, anything smaller isn't drawn
+uniform float impostorRadius;   // in pixels, round bodies smaller than this are drawn as impostors
+
+// occlusion culling against the max-depth pyramid of OcclusionBuffer, linear view distances
+uniform bool occlusion;
+uniform sampler2D depthPyramid;
+uniform mat4 view;
+uniform vec2 projectionScale;   // projection[0][0], projection[1][1]
+uniform float nearPlane;
+
+// the same rotation and translation as Transformation::use
+mat4 applyMotion(mat4 model, vec4 motion)
+{
+    float angle = time / motion.y + motion.z;
+    float c = cos(angle);
+    float s = sin(angle);
+    mat4 rotation = mat4(vec4(c, 0.0, -s, 0.0), vec4(0.0, 1.0, 0.0, 0.0), vec4(s, 0.0, c, 0.0), vec4(0.0, 0.0, 0.0, 1.0));
+    mat4 translation = mat4(1.0);
+    translation[3] = vec4(motion.x, 0.0, 0.0, 1.0);
+    return model * rotation * translation;
+}
+
+// the same test as OcclusionBuffer::occluded
+bool occluded(vec3 center, float radius)
+{
+    vec3 c = vec3(view * vec4(center, 1.0));
+    c.z = -c.z;
+    if (c.z < radius + nearPlane)
+        return false;
+
+    // 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere (Mara and McGuire 2013)
+    vec2 cx = c.xz;
+    vec2 vx = vec2(sqrt(dot(cx, cx) - radius * radius), radius);
+    vec2 minX = vec2(vx.x * cx.x - vx.y * cx.y, vx.y * cx.x + vx.x * cx.y);
+    vec2 maxX = vec2(vx.x * cx.x + vx.y * cx.y, -vx.y * cx.x + vx.x * cx.y);
+    vec2 cy = c.yz;
+    vec2 vy = vec2(sqrt(dot(cy, cy) - radius * radius), radius);
+    vec2 minY = vec2(vy.x * cy.x - vy.y * cy.y, vy.y * cy.x + vy.x * cy.y);
+    vec2 maxY = vec2(vy.x * cy.x + vy.y * cy.y, -vy.y * cy.x + vy.x * cy.y);
+    vec4 bounds = vec4(minX.x / minX.y * projectionScale.x, minY.x / minY.y * projectionScale.y,
+                       maxX.x / maxX.y * projectionScale.x, maxY.x / maxY.y * projectionScale.y);
+    ivec2 size = textureSize(depthPyramid, 0);
+    bounds = (bounds * 0.5 + 0.5) * vec4(size, size);
+
+    ivec2 minimum = max(ivec2(floor(bounds.xy)), ivec2(0));
+    ivec2 maximum = min(ivec2(floor(bounds.zw)), size - 1);
+    if (any(greaterThan(minimum, maximum)))
+        return false;
+
+    int levels = textureQueryLevels(depthPyramid);
+    int level = 0;
+    int span = max(maximum.x - minimum.x, maximum.y - minimum.y);
+    while (level + 1 < levels && (span >> level) > 1)
+        level++;
+    ivec2 levelSize = textureSize(depthPyramid, level);
+    ivec2 first = min(minimum >> level, levelSize - 1);
+    ivec2 last = min(maximum >> level, levelSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(depthPyramid, ivec2(x, y), level).r);
+    }
+    return c.z - radius > farthest;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= objectCount)
+        return;
+
+    ObjectRecord object = objects[i];
+    mat4 model = mat4(1.0);
+    for (uint m = 0u; m < object.motionCount; m++)
+        model = applyMotion(model, motions[object.firstMotion + m]);
+
+    vec3 center = model[3].xyz;
+    float radius = object.scale.w * max(object.scale.x, max(object.scale.y, object.scale.z));
+    for (int p = 0; p < 6; p++)
+    {
+        if (dot(planes[p].xyz, center) + planes[p].w < -radius)
+            return;
+    }
+    // the models only have one level of detail, the choice is between the mesh, an impostor and nothing
+    float distance = length(center - cameraPosition);
+    float pixels = distance > radius ? radius * projectedScale / distance : 1e30;
+    if (pixels < minimumRadius)
+        return;
+    if (occlusion && occluded(center, radius))
+        return;
+
+    model[0] *= object.scale.x;
+    model[1] *= object.scale.y;
+    model[2] *= object.scale.z;
+    uint batch = object.impostorBatch != 0xFFFFFFFFu && pixels < impostorRadius ? object.impostorBatch : object.batch;
+    uint slot = atomicAdd(batchCounts[batch], 1u);
+    instances[batchFirsts[batch] + slot] = model;
+}
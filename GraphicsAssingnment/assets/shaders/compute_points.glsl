@@ -0,0 +1,40 @@
+#version 430 core
+layout (local_size_x = 256) in;
+
+// CloudPoint, 16 bytes
+struct Point {
+    vec3 position;
+    uint color;     // RGBA8
+};
+
+layout (std430, binding = 0) readonly buffer Points { Point points[]; };
+layout (r32ui, binding = 0) uniform uimage2D target;
+
+uniform uint count;
+uniform mat4 viewProjection;
+uniform vec2 size;
+uniform float nearPlane;
+uniform float depthScale;   // 1 / log2(far / near)
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= count)
+        return;
+
+    vec4 clip = viewProjection * vec4(points[i].position, 1.0);
+    // w is the view depth of a perspective projection
+    if (clip.w < nearPlane)
+        return;
+    vec3 ndc = clip.xyz / clip.w;
+    if (abs(ndc.x) > 1.0 || abs(ndc.y) > 1.0 || ndc.z > 1.0)
+        return;
+    ivec2 pixel = min(ivec2((ndc.xy * 0.5 + 0.5) * size), ivec2(size) - 1);
+
+    // nearest wins: a logarithmic depth on top keeps the precision even over the whole depth range
+    float depth = clamp(log2(clip.w / nearPlane) * depthScale, 0.0, 1.0);
+    uint c = points[i].color;
+    uint rgb565 = ((c & 0xF8u) << 8) | ((c >> 5) & 0x7E0u) | ((c >> 19) & 0x1Fu);
+    // the farthest depth is kept for the empty value 0xFFFFFFFF, a white point there would vanish
+    imageAtomicMin(target, pixel, (min(uint(depth * 65535.0), 0xFFFEu) << 16) | rgb565);
+}
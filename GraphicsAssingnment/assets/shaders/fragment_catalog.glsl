@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 color;
+
+void main()
+{
+    // a round point that fades to its edge
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    float falloff = max(0.0, 1.0 - dot(offset, offset));
+    FragColor = vec4(color * falloff, 1.0);
+}
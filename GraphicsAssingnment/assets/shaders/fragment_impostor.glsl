@@ -0,0 +1,49 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+flat in vec3 Center;
+flat in float Radius;
+flat in mat3 ToModel;
+
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+};
+
+uniform samplerCube sphereMap;
+uniform vec3 viewPos;
+uniform Light light;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    // the view ray against the sphere. The squared distance of the centre from the ray is taken from the
+    // perpendicular itself, b * b - c would lose the radius to rounding far from the camera
+    vec3 ray = normalize(FragPos - viewPos);
+    vec3 offset = viewPos - Center;
+    float b = dot(offset, ray);
+    vec3 perpendicular = offset - b * ray;
+    float h = Radius * Radius - dot(perpendicular, perpendicular);
+    if (h < 0.0)
+        discard;
+    vec3 position = viewPos + ray * (-b - sqrt(h));
+    vec3 norm = (position - Center) / Radius;
+    vec3 color = texture(sphereMap, ToModel * norm).rgb;
+
+    // a body with the light inside it is the light, drawn unlit like the luminous shader
+    vec3 result = color;
+    if (length(light.position - Center) > Radius)
+    {
+        vec3 ambient = light.ambient * color;
+        float diff = max(dot(norm, normalize(light.position - position)), 0.0);
+        vec3 diffuse = light.diffuse * diff * color;
+        result = ambient + diffuse;
+    }
+
+    vec4 clip = projection * view * vec4(position, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    FragColor = vec4(result, 1.0);
+}
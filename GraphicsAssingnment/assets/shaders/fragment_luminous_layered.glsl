@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// the layers of a planet's material (see fragment_planet.glsl), the clouds are in the g channel of the masks
+uniform sampler2DArray layers;
+uniform int layer_color;
+uniform int layer_mask;
+
+void main()
+{
+    vec3 color = texture(layers, vec3(TexCoords, layer_color)).rgb;
+    float clouds = texture(layers, vec3(TexCoords, layer_mask)).g;
+    FragColor = vec4(mix(color, vec3(1.0), clouds), 1.0);
+}
@@ -0,0 +1,62 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+};
+
+// all the layers of the planet are in one array (see material.h), the masks are packed in the
+// channels of one layer: r ocean (black on the water), g clouds, b city lights, a height
+uniform sampler2DArray layers;
+uniform int layer_color;
+uniform int layer_mask;
+uniform vec3 viewPos;
+uniform Light light;
+
+// world units the height map spans
+const float BUMP_HEIGHT = 0.02;
+const vec3 CITY_LIGHTS = vec3(1.0, 0.8, 0.5);
+
+// tilts the normal by the slope of the height across the pixel, no tangents needed
+vec3 bumpNormal(vec3 normal, float height)
+{
+    vec3 dx = dFdx(FragPos);
+    vec3 dy = dFdy(FragPos);
+    vec3 r1 = cross(dy, normal);
+    vec3 r2 = cross(normal, dx);
+    float det = dot(dx, r1);
+    vec3 gradient = sign(det) * (dFdx(height) * r1 + dFdy(height) * r2) * BUMP_HEIGHT;
+    return normalize(abs(det) * normal - gradient);
+}
+
+void main()
+{
+    vec3 color = texture(layers, vec3(TexCoords, layer_color)).rgb;
+    vec4 mask = texture(layers, vec3(TexCoords, layer_mask));
+
+    vec3 surface = normalize(Normal);
+    vec3 norm = bumpNormal(surface, mask.a);
+    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+    // the clouds cover the ground, and the oceans and the lights under them
+    color = mix(color, vec3(1.0), mask.g);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 result = (light.ambient + light.diffuse * diff) * color;
+
+    // the oceans reflect the light
+    float spec = pow(max(dot(surface, normalize(lightDir + viewDir)), 0.0), 64.0);
+    result += light.diffuse * spec * (1.0 - mask.r) * (1.0 - mask.g) * 0.5;
+
+    // the cities light up past the terminator
+    float night = 1.0 - smoothstep(-0.1, 0.1, dot(surface, lightDir));
+    result += CITY_LIGHTS * mask.b * (1.0 - mask.g) * night;
+
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 430 core
+out vec4 FragColor;
+
+layout (r32ui, binding = 0) uniform uimage2D target;
+
+uniform float nearPlane;
+uniform float depthScale;
+uniform float projection22;
+uniform float projection32;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uint nearest = imageLoad(target, pixel).r;
+    // empty again for the next frame
+    imageStore(target, pixel, uvec4(0xFFFFFFFFu));
+    if (nearest == 0xFFFFFFFFu)
+        discard;
+
+    // back from the logarithmic depth to the window depth the scene was drawn with
+    float depth = nearPlane * exp2(float(nearest >> 16) / 65535.0 / depthScale);
+    gl_FragDepth = (-projection22 * depth + projection32) / depth * 0.5 + 0.5;
+    uint c = nearest & 0xFFFFu;
+    FragColor = vec4(float(c >> 11) / 31.0, float((c >> 5) & 63u) / 63.0, float(c & 31u) / 31.0, 1.0);
+}
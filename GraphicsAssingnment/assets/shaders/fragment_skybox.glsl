@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 direction;
+
+uniform samplerCube background;
+
+void main()
+{
+    FragColor = vec4(texture(background, normalize(direction)).rgb, 1.0);
+}
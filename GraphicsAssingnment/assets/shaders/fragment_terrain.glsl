@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec3 Direction;
+
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+};
+
+// the colour map as a cubemap in the planet's frame
+uniform samplerCube colorMap;
+uniform Light light;
+
+void main()
+{
+    vec3 color = texture(colorMap, Direction).rgb;
+
+    // ambient
+    vec3 ambient = light.ambient * color;
+
+    // diffuse
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(light.position - FragPos);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * color;
+
+    FragColor = vec4(ambient + diffuse, 1.0);
+}
@@ -1,12 +1,16 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+// the model matrix of an instanced draw, per instance
+layout (location = 7) in mat4 aInstanceModel;
 
 uniform mat4 model;
+uniform bool instanced;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	mat4 world = instanced ? aInstanceModel : model;
+	gl_Position = projection * view * world * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,40 @@
+#version 330 core
+
+// octahedral encoding of the star's direction
+layout (location = 0) in vec2 aDirection;
+// apparent magnitude and B-V colour index, in thousandths
+layout (location = 1) in vec2 aMagnitudeColor;
+
+out vec3 color;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+vec3 decodeDirection(vec2 e)
+{
+	vec3 d = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (d.z < 0.0)
+		d.xy = (1.0 - abs(d.yx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(d);
+}
+
+// from blue-white through white to orange-red along the B-V index
+vec3 starColor(float colorIndex)
+{
+	if (colorIndex < 0.4)
+		return mix(vec3(0.62, 0.73, 1.0), vec3(1.0), clamp((colorIndex + 0.4) / 0.8, 0.0, 1.0));
+	return mix(vec3(1.0), vec3(1.0, 0.6, 0.35), clamp((colorIndex - 0.4) / 1.6, 0.0, 1.0));
+}
+
+void main()
+{
+	// w = 0 puts the star at infinity, the view's translation drops out; then on the far plane
+	gl_Position = projection * view * vec4(decodeDirection(aDirection), 0.0);
+	gl_Position.z = gl_Position.w;
+
+	float magnitude = aMagnitudeColor.x * 0.001;
+	gl_PointSize = clamp(3.5 - 0.5 * magnitude, 1.0, 5.0);
+	// a much flatter curve than the real flux ratio, which would leave everything past magnitude 3 black
+	float brightness = clamp(pow(10.0, -0.16 * (magnitude - 1.0)), 0.0, 1.0);
+	color = starColor(aMagnitudeColor.y * 0.001) * brightness;
+}
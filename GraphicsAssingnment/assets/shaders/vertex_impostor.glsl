@@ -0,0 +1,33 @@
+#version 330 core
+layout (location = 0) in vec3 aCorner;
+// the model matrix of the body, per instance
+layout (location = 7) in mat4 aInstanceModel;
+
+out vec3 FragPos;
+flat out vec3 Center;
+flat out float Radius;
+flat out mat3 ToModel;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+uniform float sphereRadius;     // of the unscaled model
+
+void main()
+{
+    mat4 world = aInstanceModel;
+    float scale = max(length(world[0].xyz), max(length(world[1].xyz), length(world[2].xyz)));
+    Center = world[3].xyz;
+    Radius = sphereRadius * scale;
+    ToModel = transpose(mat3(world)) / scale;
+
+    // a quad through the centre facing the camera, as wide as the cone from the camera that touches the sphere
+    vec3 toCamera = viewPos - Center;
+    float distance = length(toCamera);
+    vec3 forward = toCamera / distance;
+    vec3 side = normalize(cross(abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), forward));
+    vec3 up = cross(forward, side);
+    float extent = Radius * min(distance / sqrt(max(distance * distance - Radius * Radius, 0.0)), 10.0);
+    FragPos = Center + (side * aCorner.x + up * aCorner.y) * extent;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -2,15 +2,19 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// the model matrix of an instanced draw, per instance
+layout (location = 7) in mat4 aInstanceModel;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
+uniform bool instanced;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+    mat4 world = instanced ? aInstanceModel : model;
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * world * vec4(aPos, 1.0);
 }
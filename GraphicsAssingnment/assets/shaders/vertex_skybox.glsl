@@ -0,0 +1,15 @@
+#version 330 core
+
+// the direction of the view ray through the vertex
+out vec3 direction;
+
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+	// one triangle that covers the screen, on the far plane
+	vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+	gl_Position = vec4(position, 1.0, 1.0);
+	vec4 world = inverseViewProjection * vec4(position, 1.0, 1.0);
+	direction = world.xyz / world.w;
+}
@@ -0,0 +1,32 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aMorph;
+layout (location = 2) in vec3 aNormal;
+layout (location = 3) in vec3 aMorphNormal;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 Direction;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+// the planet's rotation times its radius
+uniform mat3 orientation;
+// the chunk's centre relative to the camera, and on the unit planet
+uniform vec3 origin;
+uniform vec3 center;
+// the distances over which the vertices move onto the level above
+uniform vec2 morphRange;
+
+void main()
+{
+    // every position is relative to the camera, close to the ground the world positions run out of precision
+    float morph = clamp((length(origin + orientation * aPos) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    vec3 position = aPos + morph * aMorph;
+    vec3 relative = origin + orientation * position;
+    FragPos = viewPos + relative;
+    Normal = orientation * mix(aNormal, aMorphNormal, morph);
+    Direction = center + position;
+    gl_Position = projection * vec4(mat3(view) * relative, 1.0);
+}
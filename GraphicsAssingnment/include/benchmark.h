@@ -0,0 +1,66 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+// A scripted camera flight, read from a text file with one keyframe per line:
+//     time x y z yaw pitch
+// Lines starting with '#' are comments. Positions and angles are interpolated with a Catmull-Rom spline.
+class CameraPath {
+public:
+    bool load(const std::string& path);
+    bool empty() const { return _keys.empty(); }
+    float duration() const { return _keys.empty() ? 0.0f : _keys.back().time; }
+
+    // the camera state at time t, clamped to the first and last keyframe
+    void evaluate(float t, glm::vec3& position, float& yaw, float& pitch) const;
+
+private:
+    struct Keyframe {
+        float time;
+        glm::vec3 position;
+        glm::vec2 angles;   // yaw, pitch
+    };
+    std::vector<Keyframe> _keys;
+};
+
+// Collects frame times, draw calls and triangles of a benchmark run and reports their distribution
+class Benchmark {
+public:
+    explicit Benchmark(unsigned int warmupFrames = 10) : _warmupFrames(warmupFrames) {}
+
+    void beginFrame();
+    // call once the frame is complete on the GPU
+    void endFrame(const RenderStats& stats);
+
+    // prints the summary and, if path isn't empty, writes it as JSON
+    void report(const std::string& path, unsigned int seed, float fixedStep) const;
+    // appends one row of frame time against scene size to a CSV file, runs over growing scenes give the scaling curve
+    void appendCurve(const std::string& path, unsigned int bodies, unsigned int models, unsigned int stars) const;
+
+private:
+    struct Summary {
+        double average, p50, p95, p99, min, max;
+        double drawCalls, triangles;
+    };
+    bool summarize(Summary& summary) const;
+
+    struct Sample {
+        float milliseconds;
+        unsigned int drawCalls;
+        uint64_t triangles;
+    };
+
+    unsigned int _warmupFrames;
+    unsigned int _frames = 0;
+    std::chrono::steady_clock::time_point _frameStart;
+    std::vector<Sample> _samples;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "culling.h"
+
+// Bounding volume hierarchy over spheres (xyz center, w radius). build() splits with the surface area
+// heuristic, refit() follows moving spheres without changing the tree, so the bodies only need a new
+// build once refitting has made the tree too loose. Spheres with a negative radius are left out of
+// every query. Query results are indices into the vector given to build().
+class BVH {
+public:
+    // A node of the flattened tree, 32 bytes, two to a cache line. The nodes are stored depth first:
+    // the left child of an interior node is the node after it, so only the right one needs an index.
+    struct Node {
+        glm::vec3 min;
+        unsigned int index;     // interior: the right child, leaf: the first of its spheres
+        glm::vec3 max;
+        unsigned int count;     // spheres in a leaf, 0 for an interior node
+    };
+
+    void build(const std::vector<glm::vec4>& spheres);
+    // moves the bounds to the new spheres (same count and order as the build), returns how much worse
+    // the tree has become: its SAH cost relative to right after the build
+    float refit(const std::vector<glm::vec4>& spheres);
+
+    // sets visible[i] to 1 for the spheres at least partly inside the frustum, 0 for the rest
+    void cullFrustum(const Frustum& frustum, std::vector<unsigned char>& visible) const;
+    // the nearest sphere the ray (direction normalized) enters, or starts inside of
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, unsigned int& hit, float& distance) const;
+    // the sphere whose surface is nearest to the point, the distance is 0 inside a sphere
+    bool nearest(const glm::vec3& point, unsigned int& hit, float& distance) const;
+    // every sphere that comes within radius of the point
+    void queryRadius(const glm::vec3& point, float radius, std::vector<unsigned int>& result) const;
+
+    bool empty() const { return _nodes.empty(); }
+    size_t size() const { return _spheres.size(); }
+    const std::vector<Node>& nodes() const { return _nodes; }
+
+private:
+    unsigned int buildNode(unsigned int first, unsigned int count, std::vector<glm::vec3>& centroids);
+    void updateBounds(Node& node) const;
+    float cost() const;
+
+    std::vector<Node> _nodes;
+    std::vector<glm::vec4> _spheres;         // in leaf order, so a leaf reads consecutive spheres
+    std::vector<unsigned int> _primitives;   // the index given to build() of each of _spheres
+    float _buildCost = 0.0f;
+};
+
+#endif
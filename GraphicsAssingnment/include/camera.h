@@ -102,6 +102,14 @@ public:
         updateCameraVectors();
     }
 
+    // places the camera directly, used when the camera follows a scripted path instead of the input
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
@@ -0,0 +1,66 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "jobs.h"
+
+enum CaptureFormat {
+    CAPTURE_PNG,    // one numbered PNG per frame
+    CAPTURE_RAW     // every frame appended to a single raw RGBA video file
+};
+
+// Records rendered frames without stalling the pipeline. glReadPixels goes into a ring of pixel
+// buffer objects guarded by fences, a slot is only mapped when it comes around again, so with three
+// slots the readback of frame N overlaps the rendering of frames N+1 and N+2. Flipping and encoding
+// run on the job system.
+class FrameCapture {
+public:
+    FrameCapture(int width, int height, const std::string& output, CaptureFormat format, unsigned int ringSize = 3);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // queues the readback of the framebuffer bound to GL_READ_FRAMEBUFFER, call after drawing and before swapping
+    void capture();
+    // collects every outstanding readback and waits for the encoders
+    void finish();
+
+    unsigned int framesCaptured() const { return _framesQueued; }
+
+private:
+    struct Slot {
+        unsigned int PBO = 0;
+        GLsync fence = 0;
+        unsigned int frame = 0;
+    };
+
+    void collect(Slot& slot);
+    void encode(std::vector<unsigned char> pixels, unsigned int frame);
+
+    int _width;
+    int _height;
+    std::string _output;
+    CaptureFormat _format;
+
+    std::vector<Slot> _slots;
+    size_t _next = 0;
+    unsigned int _framesQueued = 0;
+
+    // encode jobs still running, the oldest is waited for when too many frames pile up
+    std::deque<JobHandle> _encoding;
+    // raw frames have to reach the file in order, so each write continues the previous one
+    JobHandle _lastWrite;
+    std::FILE* _rawFile = nullptr;
+};
+
+// writes 8-bit RGBA or RGB pixels (top row first) as an uncompressed PNG
+bool writePNG(const std::string& path, int width, int height, int channels, const unsigned char* pixels);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
+#include "shader.h"
+
+// One star of a packed catalog, 8 bytes. The file is a StarCatalogHeader followed by the stars, brightest
+// (lowest magnitude) first, so every magnitude limit selects a prefix of it.
+struct PackedStar {
+    int16_t direction[2];   // octahedral encoding of the unit direction, snorm16
+    int16_t magnitude;      // apparent visual magnitude, in thousandths
+    int16_t colorIndex;     // B-V colour index, in thousandths
+};
+
+struct StarCatalogHeader {
+    char magic[4];          // "STAR"
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+const uint32_t STAR_CATALOG_VERSION = 1;
+
+// converts a HYG-style CSV (a header row naming at least the ra, dec and mag columns, ci if there is one)
+// to the packed format. Right ascension is in hours, declination in degrees, and the celestial north pole
+// becomes +y. Rows without a position or a magnitude are skipped, so is the Sun.
+bool importStarCatalog(const std::string& csvPath, const std::string& outputPath);
+
+// A packed catalog mapped into memory, read in place
+class StarCatalog {
+public:
+    StarCatalog() {}
+    ~StarCatalog();
+    StarCatalog(const StarCatalog&) = delete;
+    StarCatalog& operator=(const StarCatalog&) = delete;
+
+    // maps the file and checks its header, prints the reason and returns false if it isn't a catalog
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const { return _count; }
+    const PackedStar* stars() const { return _stars; }
+    // how many stars are as bright as the magnitude or brighter, they are the first ones
+    size_t countBrighterThan(float magnitude) const;
+
+    static glm::vec3 direction(const PackedStar& star);
+    static float magnitude(const PackedStar& star) { return star.magnitude * 0.001f; }
+    static float colorIndex(const PackedStar& star) { return star.colorIndex * 0.001f; }
+
+private:
+    void* _mapping = nullptr;
+    size_t _bytes = 0;
+    const PackedStar* _stars = nullptr;
+    size_t _count = 0;
+};
+
+// Draws the stars of a catalog as points at infinity, sized and dimmed by magnitude and tinted by colour index.
+// The whole catalog is uploaded once; a magnitude limit only changes how much of it is drawn.
+class StarCatalogRenderer {
+public:
+    StarCatalogRenderer();
+    ~StarCatalogRenderer();
+
+    void upload(const StarCatalog& catalog);
+    // draws the first count stars, after the opaque geometry
+    void draw(const glm::mat4& projection, const glm::mat4& view, size_t count);
+
+private:
+    Shader _shader;
+    unsigned int _VAO = 0;
+    unsigned int _VBO = 0;
+    size_t _count = 0;
+};
+
+#endif
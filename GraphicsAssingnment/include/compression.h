@@ -0,0 +1,34 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// The S3TC formats come from EXT_texture_compression_s3tc, which the generated glad doesn't cover. The
+// RGTC ones (BC4 and BC5) are core since OpenGL 3.0.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Textures that weren't compressed offline are block compressed when they are loaded: blocks of 4x4
+// texels in BC4 for one channel, BC5 for two, BC1 for three and BC3 for four. A block takes 8 or 16
+// bytes, half a byte or a byte a texel against the 4 bytes of an uncompressed texel in video memory.
+
+// the GL format the blocks of an image with that many channels are in
+GLenum compressedFormat(int channels);
+// the bytes of the blocks of a width x height image, the blocks on the right and bottom edges count whole
+size_t compressedSize(int width, int height, int channels);
+// Encodes tightly packed 8 bit texels into blocks, rows of blocks are spread over the job system. The
+// endpoints of a block are the corners of the box around its texels, pulled in a little, and every
+// texel takes the nearest step between them along the box's diagonal, four texels at a time with SSE2.
+// Doesn't touch OpenGL.
+void compressImage(const unsigned char* pixels, int width, int height, int channels, unsigned char* blocks);
+// whether the context samples all four formats, BC1 and BC3 need EXT_texture_compression_s3tc. Call
+// once the context is current.
+bool textureCompressionSupported();
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <jobs.h>
+
+// The six clipping planes of a view-projection matrix, normals pointing inwards
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // extracts the planes from a combined projection * view matrix (Gribb/Hartmann)
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        Frustum frustum;
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // bottom
+        frustum.planes[3] = row3 - row1; // top
+        frustum.planes[4] = row3 + row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        for (auto& plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (const auto& plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// One entry of the per-frame draw list, sorted by key before drawing
+struct DrawItem {
+    uint64_t key;
+    unsigned int object;
+
+    bool operator<(const DrawItem& other) const { return key < other.key; }
+};
+
+// Packs shader, model and view depth into a key so sorting groups the draws by state and
+// draws front to back inside a group: | shader 16 | model 16 | depth 32 |
+inline uint64_t makeSortKey(unsigned int shader, unsigned int model, float depth)
+{
+    // the bit pattern of a non-negative float sorts like the float itself
+    uint32_t depthBits;
+    depth = depth > 0.0f ? depth : 0.0f;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    return (static_cast<uint64_t>(shader & 0xFFFF) << 48) | (static_cast<uint64_t>(model & 0xFFFF) << 32) | depthBits;
+}
+
+// Tests every sphere (xyz center, w radius) against the frustum on the job system,
+// visible[i] is set to 1 for the spheres that are at least partly inside
+inline void cullSpheres(const Frustum& frustum, const std::vector<glm::vec4>& spheres, std::vector<unsigned char>& visible)
+{
+    visible.resize(spheres.size());
+    jobSystem().parallelFor(0, spheres.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            visible[i] = frustum.intersectsSphere(glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+    });
+}
+
+#endif
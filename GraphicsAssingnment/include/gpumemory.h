@@ -0,0 +1,83 @@
+#ifndef GPUMEMORY_H
+#define GPUMEMORY_H
+
+#include <cstddef>
+#include <vector>
+
+// what video memory is used for, the stats are kept per category
+enum GpuMemoryCategory {
+    GPU_MEMORY_MESHES,          // vertex and index buffers of the models
+    GPU_MEMORY_TEXTURES,        // model textures, the skybox and the impostor cubemaps
+    GPU_MEMORY_TERRAIN,         // terrain chunks and colour maps
+    GPU_MEMORY_POINT_CLOUD,     // point cloud nodes
+    GPU_MEMORY_UNIVERSE,        // generated star system sectors
+    GPU_MEMORY_BUFFERS,         // instance, object and draw command buffers
+    GPU_MEMORY_RENDER_TARGETS,  // framebuffers, depth pyramids and capture buffers
+    GPU_MEMORY_CATEGORIES
+};
+
+const char* gpuMemoryCategoryName(GpuMemoryCategory category);
+
+// bytes of a 2D texture (or one cubemap face), three channel formats count four bytes a texel like
+// most drivers store them, a mip chain adds a third
+size_t textureBytes(int width, int height, int channels, bool mipmapped);
+
+// Something holding video memory that it can give back and load again the next time it is drawn
+class GpuCache {
+public:
+    virtual ~GpuCache() {}
+    // the frame (GpuMemory::frame()) its least recently drawn resource that can go was last drawn, false
+    // when nothing can. Resources drawn in the current frame never can, they are in use.
+    virtual bool oldest(unsigned int& frame) const = 0;
+    // frees the resource oldest() gave the frame of
+    virtual void evictOldest() = 0;
+};
+
+// Accounts the video memory of every GL buffer, texture and render target and keeps it within a
+// budget. Whatever is over the budget goes from the caches, the least recently drawn resource first
+// across all of them, and is loaded again by its owner when it is drawn next. Resources that can't be
+// reloaded are only counted. Main thread only.
+class GpuMemory {
+public:
+    void allocate(GpuMemoryCategory category, size_t bytes);
+    void release(GpuMemoryCategory category, size_t bytes);
+
+    // 0 is no budget, the subsystems still keep to their own
+    void setBudget(size_t bytes) { _budget = bytes; }
+    size_t budget() const { return _budget; }
+    size_t used() const { return _used; }
+    size_t used(GpuMemoryCategory category) const { return _categories[category].used; }
+    size_t peak(GpuMemoryCategory category) const { return _categories[category].peak; }
+    // resources freed to keep to the budget since the start
+    size_t evictions() const { return _evictions; }
+
+    void addCache(GpuCache* cache);
+    void removeCache(GpuCache* cache);
+    // evicts from the caches until bytes more fit in the budget, false if they can't
+    bool makeRoom(size_t bytes);
+
+    // the frame clock the caches stamp their resources with, advanced at the start of every frame
+    unsigned int frame() const { return _frame; }
+    void nextFrame() { _frame++; }
+
+    // the use and peak of every category
+    void print() const;
+
+private:
+    struct Category {
+        size_t used = 0;
+        size_t peak = 0;
+    };
+
+    Category _categories[GPU_MEMORY_CATEGORIES];
+    size_t _used = 0;
+    size_t _budget = 0;
+    size_t _evictions = 0;
+    std::vector<GpuCache*> _caches;
+    unsigned int _frame = 1;
+};
+
+// the video memory accounting of the program
+GpuMemory& gpuMemory();
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <vector>
+
+#include "shader.h"
+#include "instancing.h"
+#include "resources.h"
+
+// a model counts as a sphere when the sphere inside it is at least this much of the one around it
+const float IMPOSTOR_ROUNDNESS = 0.9f;
+
+// Spherical bodies drawn as one camera-facing quad each. The fragment shader intersects the view ray
+// with the sphere, so the silhouette, the normal and the depth are exact whatever the size on screen,
+// and the colour comes from a cubemap of the model's own texture, baked once by drawing the model from
+// its centre. Meant for bodies a few pixels across, where the mesh would cost its full vertex count
+// for a handful of fragments.
+class ImpostorRenderer {
+public:
+    // bakes a cubemap of every model that is round enough, faceSize texels across
+    ImpostorRenderer(const ModelLibrary& models, unsigned int faceSize);
+    ~ImpostorRenderer();
+    ImpostorRenderer(const ImpostorRenderer&) = delete;
+    ImpostorRenderer& operator=(const ImpostorRenderer&) = delete;
+
+    // whether the model has a cubemap and can be drawn as an impostor
+    bool has(ModelHandle model) const { return model < _spheres.size() && _spheres[model].texture != 0; }
+
+    // queues an impostor for this frame, world is the model matrix of the body (rotation, uniform scale
+    // and translation)
+    void add(ModelHandle model, const glm::mat4& world);
+    // draws the queued impostors, one instanced call per model, and empties the queue. prepare sets the
+    // per-frame uniforms (projection, view, light), like for the objects.
+    void draw(const std::function<void(Shader&)>& prepare);
+
+    // for the GPU-driven path, which draws the quads from its own buffers: the shader and the model's
+    // uniforms and cubemap
+    Shader& shader() { return _shader; }
+    void bind(ModelHandle model);
+
+    size_t queued() const { return _queued; }
+
+private:
+    struct Sphere {
+        unsigned int texture = 0;       // GL_TEXTURE_CUBE_MAP, 0 for models that aren't round
+        float radius = 0.0f;
+        std::vector<glm::mat4> instances;
+    };
+
+    void bake(const Model& model, Sphere& sphere, unsigned int faceSize, Shader& bakeShader);
+
+    Shader _shader;
+    unsigned int _VAO = 0;
+    unsigned int _VBO = 0;
+    InstanceBuffer _instanceBuffer;
+    std::vector<glm::mat4> _matrices;   // every model's instances back to back, uploaded in draw()
+    std::vector<Sphere> _spheres;       // by model handle
+    size_t _textureBytes = 0;           // of all the cubemaps
+    size_t _queued = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <vector>
+
+#include "gl43.h"
+#include "compute_shader.h"
+#include "shader.h"
+#include "instancing.h"
+#include "resources.h"
+#include "transformation.h"
+#include "occlusion.h"
+#include "impostor.h"
+
+// A drawable body as the GPU-driven path sees it
+struct IndirectObject {
+    ModelHandle model;
+    unsigned int shader;
+    glm::vec3 scale;
+    unsigned int firstMotion;   // range of the motions passed to build()
+    unsigned int motionCount;
+};
+
+// GPU-driven rendering for OpenGL 4.3 contexts. Every mesh lives in one shared vertex and index
+// buffer and every object is a record in a storage buffer. Each frame a compute shader moves the
+// objects, culls them and appends the visible ones to the instances of their (shader, model) batch,
+// a second one writes the instance counts into the draw commands, and the draw is one
+// glMultiDrawElementsIndirect per shader and material. The CPU work doesn't depend on the number of
+// objects. Needs hasGL43(). Objects behind the occluders of an OcclusionBuffer are dropped by the same
+// compute shader, sampling its depth pyramid. Round bodies below the impostor radius go to an impostor
+// batch instead, whose command draws the quad of an ImpostorRenderer.
+class IndirectRenderer {
+public:
+    IndirectRenderer();
+    ~IndirectRenderer();
+
+    IndirectRenderer(const IndirectRenderer&) = delete;
+    IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+
+    // uploads the geometry of every model, the object and motion records and the draw commands. With
+    // impostors, the objects whose model it has are drawn by it once they are under impostorRadius pixels.
+    void build(const ModelLibrary& models, const std::vector<IndirectObject>& objects, const std::vector<Transformation>& motions,
+               ImpostorRenderer* impostors = nullptr, float impostorRadius = 0.0f);
+    // places and culls the objects at the given simulation time and fills the draw commands. With an
+    // occlusion buffer the objects hidden behind its occluders are culled too.
+    void cull(float time, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, int viewportHeight,
+              const OcclusionBuffer* occlusion = nullptr);
+    // draws what cull() kept, prepare is called with every shader it switches to, to set the frame's uniforms
+    void draw(std::vector<Shader>& shaders, const std::function<void(Shader&)>& prepare);
+
+private:
+    // consecutive commands drawn with the same shader and textures
+    struct DrawGroup {
+        unsigned int shader;
+        const Mesh* material;       // a mesh with the textures of the group, null for impostors
+        ModelHandle impostor;       // the model whose impostors the group draws, INVALID_MODEL for meshes
+        unsigned int firstCommand;
+        unsigned int commandCount;
+    };
+
+    ComputeShader _cullShader;
+    ComputeShader _commandShader;
+
+    unsigned int _VAO = 0;
+    unsigned int _VBO = 0;
+    unsigned int _EBO = 0;
+    unsigned int _objectBuffer = 0;
+    unsigned int _motionBuffer = 0;
+    unsigned int _batchCountBuffer = 0;
+    unsigned int _batchFirstBuffer = 0;
+    unsigned int _commandBuffer = 0;
+    unsigned int _commandBatchBuffer = 0;
+    unsigned int _depthPyramid = 0;     // the levels of the OcclusionBuffer, uploaded every frame
+    // what build() allocated, counted in gpuMemory()
+    size_t _meshBytes = 0;
+    size_t _bufferBytes = 0;
+    size_t _pyramidBytes = 0;
+    InstanceBuffer _instances;
+    ImpostorRenderer* _impostors = nullptr;
+    float _impostorRadius = 0.0f;
+
+    unsigned int _objectCount = 0;
+    unsigned int _commandCount = 0;
+    std::vector<DrawGroup> _groups;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// first of the four attribute locations (one per column) the vertex shaders read the per-instance
+// model matrix from, 0-6 are taken by the mesh vertex layout
+const unsigned int INSTANCE_MATRIX_LOCATION = 7;
+
+// The model matrices of every instanced draw in a frame. They are uploaded together once per frame,
+// each draw then points the instance attributes of its VAO at its own range of the buffer.
+class InstanceBuffer {
+public:
+    InstanceBuffer();
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // replaces the contents with this frame's matrices, the previous storage is orphaned so the
+    // upload doesn't wait for the draws of the last frame
+    void upload(const std::vector<glm::mat4>& matrices);
+    // makes room for count matrices without uploading any, for buffers the GPU fills itself
+    void resize(size_t count);
+    // sets up the instance attributes of the currently bound VAO to start at matrix first
+    void bind(size_t first) const;
+
+    unsigned int buffer() const { return _buffer; }
+
+private:
+    unsigned int _buffer = 0;
+    size_t _capacity = 0;   // in matrices
+};
+
+#endif
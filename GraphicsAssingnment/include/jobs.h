@@ -0,0 +1,118 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// A unit of work for the job system. Jobs form a tree through their parent: a job only counts as
+// finished once its own function and all of its children have finished. Continuations are jobs that
+// are held back until every job they depend on has finished.
+struct Job {
+    std::function<void()> function;
+    JobHandle parent;
+    bool mainThreadOnly = false;
+    std::atomic<int> unfinished{ 1 };      // own function + children still running
+    std::atomic<int> dependencies{ 0 };    // jobs that have to finish before this one can start
+    std::atomic<bool> finished{ false };
+
+    std::mutex continuationLock;
+    std::vector<JobHandle> continuations;
+
+    // keeps the job alive while it sits in a queue, released once it has finished
+    JobHandle keepAlive;
+};
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the bottom, every other thread
+// steals from the top. The capacity is fixed, push() returns false when the deque is full.
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 4096);
+
+    bool push(Job* job);
+    Job* pop();
+    Job* steal();
+
+private:
+    std::vector<std::atomic<Job*>> _buffer;
+    size_t _mask;
+    alignas(64) std::atomic<int64_t> _top;
+    alignas(64) std::atomic<int64_t> _bottom;
+};
+
+// A small work-stealing scheduler. The thread that creates it becomes worker 0 (the main thread),
+// the other workers are spawned once and live as long as the scheduler. Every subsystem shares the
+// instance returned by jobSystem() so the number of busy cores stays predictable.
+class JobSystem {
+public:
+    // threadCount includes the main thread, 0 means one thread per hardware core
+    explicit JobSystem(unsigned int threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // schedules a function on any worker
+    JobHandle run(std::function<void()> function);
+    // like run(), but without worker threads the function runs right here and the handle is null: a job
+    // nobody waits for would otherwise sit in the queue until the main thread waits for something
+    JobHandle runOrInline(std::function<void()> function);
+    // schedules a function as a child of parent, parent does not finish before the child does
+    JobHandle runChild(const JobHandle& parent, std::function<void()> function);
+    // queues a function that may only execute on the main thread (GL calls), see pumpMainThread()
+    JobHandle runOnMainThread(std::function<void()> function);
+    // schedules a function once every job in dependencies has finished
+    JobHandle continueWith(const std::vector<JobHandle>& dependencies, std::function<void()> function, bool mainThread = false);
+    JobHandle continueWith(const JobHandle& dependency, std::function<void()> function, bool mainThread = false);
+
+    // blocks until the job has finished, executing other jobs (and main thread work) in the meantime
+    void wait(const JobHandle& job);
+    // splits [begin, end) into ranges of at most grainSize elements and runs them in parallel.
+    // Small ranges are executed inline on the calling thread.
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& function);
+
+    // executes the functions queued with runOnMainThread(), returns how many ran
+    size_t pumpMainThread();
+
+    bool isMainThread() const;
+    unsigned int threadCount() const { return static_cast<unsigned int>(_queues.size()); }
+
+private:
+    JobHandle createJob(std::function<void()> function, const JobHandle& parent);
+    void schedule(const JobHandle& job);
+    void execute(Job* job);
+    void finish(Job* job);
+    bool runOne(int workerIndex);
+    Job* findWork(int workerIndex);
+    void workerLoop(int workerIndex);
+
+    std::vector<std::unique_ptr<WorkStealingDeque>> _queues;
+    std::vector<std::thread> _threads;
+
+    // jobs submitted from threads that are not workers, or that did not fit into a full deque
+    std::mutex _injectionLock;
+    std::vector<Job*> _injected;
+
+    std::mutex _mainThreadLock;
+    std::vector<Job*> _mainThreadJobs;
+
+    std::mutex _sleepLock;
+    std::condition_variable _wake;
+    std::atomic<int> _pending{ 0 };
+    std::atomic<bool> _stopping{ false };
+    std::thread::id _mainThreadId;
+};
+
+// the scheduler shared by loading, simulation and culling
+JobSystem& jobSystem();
+
+#endif
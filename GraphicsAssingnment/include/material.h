@@ -0,0 +1,67 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "scene.h"
+#include "mesh.h"
+#include "jobs.h"
+
+// where a material's layers are, -1 while it isn't built or its colour map didn't load
+struct LayeredMaterial {
+    unsigned int array = 0;     // the GL_TEXTURE_2D_ARRAY holding both layers
+    int colorLayer = -1;        // RGB colour map
+    int maskLayer = -1;         // the masks in the channels: R ocean (black on water), G clouds, B city lights, A height
+};
+
+// Packs the surface maps of the planets into texture arrays. A material is two layers of one array:
+// its colour map and its greyscale masks packed into the four channels of another layer. Materials
+// whose maps are the same size share an array, so all the layers of those planets are one bind and
+// the shaders tell them apart by index, the "layer_color" and "layer_mask" uniforms Mesh::bindTextures()
+// sets next to the "layers" sampler. Every layer has its mip chain and is block compressed like the
+// model textures when they are.
+class MaterialLibrary {
+public:
+    explicit MaterialLibrary(bool compress);
+    ~MaterialLibrary();
+    MaterialLibrary(const MaterialLibrary&) = delete;
+    MaterialLibrary& operator=(const MaterialLibrary&) = delete;
+
+    // whether the colour map of the layers can be read, a material doesn't load without it. Only reads
+    // the image's header, for deciding before the model loads whether it needs its own textures.
+    static bool available(const SceneLayers& layers);
+    // starts decoding and packing a material's maps on the job system, returns its index
+    unsigned int add(const SceneLayers& layers);
+    // waits for every material added and creates the arrays, main thread only
+    void build();
+
+    const LayeredMaterial& get(unsigned int material) const { return _materials[material]; }
+    size_t arrayCount() const { return _arrays.size(); }
+    // the textures that draw a mesh with the material, empty if it didn't load (see ModelLibrary::addTextures())
+    std::vector<Texture> textures(unsigned int material) const;
+
+private:
+    // the packed layers of a material, filled by its job
+    struct PendingMaterial {
+        int width = 0;
+        int height = 0;
+        // the levels of the colour and the mask layer, largest first, RGBA texels or blocks
+        std::vector<std::vector<unsigned char>> color;
+        std::vector<std::vector<unsigned char>> masks;
+    };
+
+    static void pack(const SceneLayers& layers, bool compress, PendingMaterial& result);
+
+    bool _compress;
+    std::vector<LayeredMaterial> _materials;
+    std::vector<std::unique_ptr<PendingMaterial>> _pending;
+    std::vector<JobHandle> _loading;
+    std::vector<unsigned int> _arrays;
+    size_t _textureBytes = 0;
+};
+
+#endif
@@ -7,6 +7,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <stats.h>
+#include <instancing.h>
+#include <gpumemory.h>
 
 
 #include <string>
@@ -36,6 +39,7 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    int layer = -1;     // the layer of a GL_TEXTURE_2D_ARRAY (see material.h), -1 for a 2D texture
 };
 
 class Mesh {
@@ -44,7 +48,8 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    // 0 while the buffers are evicted (see gpumemory.h), the next draw uploads them again
+    mutable unsigned int VAO = 0;
 
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
@@ -58,7 +63,43 @@ public:
     }
 
     // render the mesh
-    void Draw(Shader &shader) 
+    void Draw(Shader &shader) const
+    {
+        shader.setBool("instanced", false);
+        bindTextures(shader);
+        reload();
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        renderStats().addDraw(indices.size() / 3);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // renders count copies of the mesh with one draw call, their model matrices are read from
+    // the instance buffer starting at matrix first
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances, size_t first, unsigned int count) const
+    {
+        shader.setBool("instanced", true);
+        bindTextures(shader);
+        reload();
+
+        glBindVertexArray(VAO);
+        instances.bind(first);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, count);
+        renderStats().addDraw(indices.size() / 3 * count);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // binds the textures to consecutive units and points the samplers (texture_diffuseN, ...) at them.
+    // The layers of a texture array are bound once for all of them to the sampler "layers", and the
+    // uniform named after their type gets the layer's index.
+    void bindTextures(Shader &shader) const
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -67,6 +108,16 @@ public:
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
+            if (textures[i].layer >= 0)
+            {
+                glUniform1i(glGetUniformLocation(shader.ID, textures[i].type.c_str()), textures[i].layer);
+                if (i > 0 && textures[i - 1].layer >= 0 && textures[i - 1].id == textures[i].id)
+                    continue;
+                glActiveTexture(GL_TEXTURE0 + i);
+                glUniform1i(glGetUniformLocation(shader.ID, "layers"), i);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i].id);
+                continue;
+            }
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
@@ -85,40 +136,31 @@ public:
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // the video memory of the vertex and index buffers
+    size_t gpuBytes() const
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        return vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+    }
 
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+    bool resident() const { return VAO != 0; }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // frees the GL buffers, the vertex data stays on the CPU so they can be uploaded again
+    void release()
+    {
+        if (VAO == 0)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+        gpuMemory().release(GPU_MEMORY_MESHES, gpuBytes());
+    }
 
-        // set the vertex attribute pointers
+    // points the vertex attributes 0-6 of the bound VAO at Vertex structs in the bound GL_ARRAY_BUFFER
+    static void setVertexAttributes()
+    {
         // vertex Positions
         glEnableVertexAttribArray(0);	
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -141,7 +183,44 @@ private:
 		// weights
 		glEnableVertexAttribArray(6);
 		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+    }
+
+private:
+    // render data 
+    mutable unsigned int VBO = 0, EBO = 0;
+
+    // uploads the buffers again if they were evicted
+    void reload() const
+    {
+        if (VAO != 0)
+            return;
+        gpuMemory().makeRoom(gpuBytes());
+        setupMesh();
+    }
+
+    // initializes all the buffer objects/arrays
+    void setupMesh() const
+    {
+        // create buffers/arrays
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        // load data into vertex buffers
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        // A great thing about structs is that their memory layout is sequential for all its items.
+        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+        // again translates to 3/2 floats which translates to a byte array.
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+        // set the vertex attribute pointers
+        setVertexAttributes();
         glBindVertexArray(0);
+        gpuMemory().allocate(GPU_MEMORY_MESHES, gpuBytes());
     }
 };
 #endif
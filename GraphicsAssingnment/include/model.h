@@ -12,6 +12,10 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include <texture.h>
+#include <streaming.h>
+#include <jobs.h>
+#include <profiler.h>
 
 #include <string>
 #include <fstream>
@@ -19,10 +23,10 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <limits>
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
-
 class Model
 {
 public:
@@ -31,27 +35,112 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    float boundingRadius = 0.0f;        // radius of a sphere around the model origin that contains every vertex
+    float occluderRadius = 0.0f;        // radius of a sphere around the model origin that is inside the model, 0 if there is none we can be sure of
+    TextureStreamer* streamer = nullptr; // streams the fine levels of the textures, null loads them whole
+    bool compressTextures = false;       // block compresses the textures as they load (see compression.h)
+    bool loadTextures = true;            // false leaves out the model's own textures, for models drawn with a material (see material.h)
+    mutable unsigned int lastDrawn = 0;  // the GpuMemory::frame() the model was last drawn in
+
+    // post processing asked of ASSIMP for every model
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // constructor for models that are loaded later with loadAsync()
+    Model() : gammaCorrection(false)
+    {
+    }
 
     // constructor, expects a filepath to a 3D model.
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
+        upload();
     }
 
+    // models are shared through the ModelLibrary, a copy would duplicate all the vertex data for nothing
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
     // draws the model, and thus all its meshes
-    void Draw(Shader& shader)
+    void Draw(Shader& shader) const
     {
+        lastDrawn = gpuMemory().frame();
         for (unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // draws count instances of the model, one call per mesh, the model matrices come from the instance buffer
+    void DrawInstanced(Shader& shader, const InstanceBuffer& instances, size_t first, unsigned int count) const
+    {
+        lastDrawn = gpuMemory().frame();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instances, first, count);
+    }
+
+    // whether the meshes have their GL buffers, the next draw uploads evicted ones again
+    bool resident() const
+    {
+        return !meshes.empty() && meshes[0].resident();
+    }
+
+    // frees the GL buffers of the meshes to make room in video memory, the textures stay
+    void release()
+    {
+        for (auto& mesh : meshes)
+            mesh.release();
+    }
+
+    // imports the file on a worker thread and finishes the GL upload on the main thread.
+    // The model must stay at the same address until the returned job has finished.
+    JobHandle loadAsync(string const& path)
+    {
+        JobHandle import = jobSystem().run([this, path] { loadModel(path); });
+        return jobSystem().continueWith(import, [this] { upload(); }, true);
+    }
+
+    // creates the GL buffers and textures for everything loadModel() imported, main thread only
+    void upload()
+    {
+        PROFILE_SCOPE("Model::upload");
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            textures_loaded[i].id = streamer != nullptr ? streamer->add(pendingTextures[i]) : uploadTexture(pendingTextures[i]);
+
+        for (auto& pending : pendingMeshes)
+        {
+            for (auto& texture : pending.textures)
+            {
+                for (auto& loaded : textures_loaded)
+                {
+                    if (loaded.path == texture.path)
+                    {
+                        texture.id = loaded.id;
+                        break;
+                    }
+                }
+            }
+            meshes.push_back(Mesh(pending.vertices, pending.indices, pending.textures));
+        }
+        pendingMeshes.clear();
+        pendingTextures.clear();
+    }
+
+    // vertex data and texture references of a mesh that hasn't been uploaded yet
+    struct PendingMesh {
+        vector<Vertex>       vertices;
+        vector<unsigned int> indices;
+        vector<Texture>      textures;
+        float radius = 0.0f;
+        float innerRadius = 0.0f;
+    };
+
+    // loads a model with supported ASSIMP extensions from file and converts it into pending meshes and decoded textures.
+    // Doesn't call OpenGL, the conversion of the meshes and the texture decoding are spread over the job system.
     void loadModel(string const& path)
     {
+        PROFILE_SCOPE("Model::loadModel");
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -62,34 +151,43 @@ private:
         directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
-    }
+        vector<aiMesh*> nodeMeshes;
+        processNode(scene->mRootNode, scene, nodeMeshes);
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene)
-    {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
-        {
-            // the node object only contains indices to index the actual objects in the scene. 
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
-        }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        // the texture lookups share textures_loaded, so they run serially before the heavy work
+        pendingMeshes.resize(nodeMeshes.size());
+        for (unsigned int i = 0; loadTextures && i < nodeMeshes.size(); i++)
+            pendingMeshes[i].textures = processMaterial(scene->mMaterials[nodeMeshes[i]->mMaterialIndex]);
+
+        jobSystem().parallelFor(0, nodeMeshes.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                processMesh(nodeMeshes[i], pendingMeshes[i]);
+        });
+        pendingTextures.resize(textures_loaded.size());
+        jobSystem().parallelFor(0, textures_loaded.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                std::string path = directory + '/' + textures_loaded[i].path;
+                pendingTextures[i] = streamer != nullptr ? decodeStreamedTexture(path, compressTextures) : decodeTexture(path, compressTextures);
+            }
+        });
+
+        for (auto& pending : pendingMeshes)
         {
-            processNode(node->mChildren[i], scene);
+            boundingRadius = std::max(boundingRadius, pending.radius);
+            occluderRadius = std::max(occluderRadius, pending.innerRadius);
         }
-
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    // converts an imported mesh into vertices and indices, doesn't call OpenGL
+    void processMesh(aiMesh* mesh, PendingMesh& result)
     {
+        PROFILE_SCOPE("Model::processMesh");
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        vector<Vertex>& vertices = result.vertices;
+        vector<unsigned int>& indices = result.indices;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -101,6 +199,7 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            result.radius = std::max(result.radius, glm::length(vector));
             // normals
             if (mesh->HasNormals())
             {
@@ -142,15 +241,65 @@ private:
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-        // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        result.innerRadius = innerRadius(vertices, indices);
+    }
+
+    // When every triangle faces away from the origin the mesh is a convex shell around it, and the
+    // nearest triangle plane bounds a sphere that is inside the mesh. Planets are, most other models aren't (0).
+    static float innerRadius(const vector<Vertex>& vertices, const vector<unsigned int>& indices)
+    {
+        float nearest = std::numeric_limits<float>::max();
+        int facing = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            glm::vec3 a = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+            float area = glm::length(normal);
+            if (area <= 0.0f)
+                continue;
+            float distance = glm::dot(normal / area, a);
+            // either winding is fine, as long as all the triangles agree
+            int side = distance > 0.0f ? 1 : -1;
+            if (facing == 0)
+                facing = side;
+            if (side != facing || distance == 0.0f)
+                return 0.0f;
+            nearest = std::min(nearest, std::abs(distance));
+        }
+        return facing != 0 ? nearest : 0.0f;
+    }
+
+private:
+    vector<PendingMesh>  pendingMeshes;
+    vector<TextureImage> pendingTextures;
 
+    // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+    void processNode(aiNode* node, const aiScene* scene, vector<aiMesh*>& nodeMeshes)
+    {
+        // process each mesh located at the current node
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            // the node object only contains indices to index the actual objects in the scene. 
+            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+            nodeMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+        }
+        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            processNode(node->mChildren[i], scene, nodeMeshes);
+        }
+
+    }
+
+    // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
+    // Same applies to other texture as the following list summarizes:
+    // diffuse: texture_diffuseN
+    // specular: texture_specularN
+    // normal: texture_normalN
+    vector<Texture> processMaterial(aiMaterial* material)
+    {
+        vector<Texture> textures;
         // 1. diffuse maps
         vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
@@ -163,13 +312,11 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return textures;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // checks all material textures of a given type and registers the textures if they're not known yet.
+    // the required info is returned as a Texture struct, the id is filled in by upload().
     vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
@@ -189,9 +336,9 @@ private:
                 }
             }
             if (!skip)
-            {   // if texture hasn't been loaded already, load it
+            {   // if texture hasn't been loaded already, register it so loadModel() decodes it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = 0;
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -201,50 +348,4 @@ private:
         return textures;
     }
 };
-
-
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        std::cout << filename.c_str() << " NrComponents: " << nrComponents << std::endl;
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 2)
-            format = GL_RG;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        else format = GL_RED;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
 #endif
-
@@ -0,0 +1,69 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+enum NoiseType {
+    NOISE_VALUE,
+    NOISE_SIMPLEX
+};
+
+enum NoiseFractal {
+    NOISE_FBM,          // octaves summed as they are, in about [-1, 1]
+    NOISE_RIDGED        // octaves folded into sharp crests, in [0, 1]
+};
+
+// A fractal noise field in 3D: octaves of value or simplex noise, each at lacunarity times the frequency
+// and gain times the amplitude of the one before
+struct NoiseSettings {
+    NoiseType type = NOISE_SIMPLEX;
+    NoiseFractal fractal = NOISE_FBM;
+    unsigned int seed = 1;
+    float frequency = 1.0f;
+    unsigned int octaves = 6;
+    float lacunarity = 2.0f;
+    float gain = 0.5f;
+    // the positions are moved by noise of this strength before the field is sampled (domain warping), 0 doesn't warp
+    float warp = 0.0f;
+};
+
+// samples the field at count positions (x[i], y[i], z[i]), 0 octaves give 0. The kernels run 16, 8 or 4
+// samples at once with AVX-512, AVX2 or SSE2, whichever is the best the CPU has, and agree to rounding.
+void evaluateNoise(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count);
+// the instruction set evaluateNoise() runs on, "AVX-512", "AVX2", "SSE2" or "scalar"
+const char* noiseInstructionSet();
+
+// The look of a generated planet. The height is an fBm field with a ridged one added on land, the albedo
+// comes from the height: oceans below sea level, lowlands, highlands and snow, ice caps towards the poles.
+// Gas giants are coloured by latitude bands that the noise bends instead.
+struct PlanetStyle {
+    NoiseSettings terrain;
+    NoiseSettings mountains;
+    float seaLevel = 0.0f;
+    float iceLatitude = 0.85f;      // sine of the latitude the ice caps start at, 1 for none
+    bool gasGiant = false;
+    glm::vec3 deepColor = glm::vec3(0.02f, 0.05f, 0.2f);
+    glm::vec3 shallowColor = glm::vec3(0.1f, 0.3f, 0.5f);
+    glm::vec3 lowColor = glm::vec3(0.2f, 0.4f, 0.1f);
+    glm::vec3 highColor = glm::vec3(0.45f, 0.35f, 0.25f);
+    glm::vec3 snowColor = glm::vec3(0.95f, 0.95f, 0.97f);
+};
+
+// a random style for a seed, rocky or gas giant
+PlanetStyle randomPlanetStyle(unsigned int seed, bool gasGiant);
+
+// Equirectangular maps of a planet, sampled on the unit sphere so they have no seam and no pinching at the poles
+struct PlanetMaps {
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> albedo;      // RGBA8
+    std::vector<float> heights;             // about [-1, 1], 0 is sea level
+};
+
+// generates the maps in 64 x 64 tiles on the job system
+void generatePlanetMaps(const PlanetStyle& style, int width, int height, PlanetMaps& maps);
+
+#endif
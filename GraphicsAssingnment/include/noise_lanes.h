@@ -0,0 +1,349 @@
+#ifndef NOISE_LANES_H
+#define NOISE_LANES_H
+
+// The noise kernels of noise.h, written once over a vector of lanes and compiled once per instruction set:
+// noise.cpp instantiates them for SSE2 (and one lane where there is no SSE2), noise_avx2.cpp and
+// noise_avx512.cpp with NOISE_AVX2 or NOISE_AVX512 defined and their compiler flags. Only those files
+// include this header. Everything is in an unnamed namespace so the copies built with AVX never stand in
+// for the others at link time.
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#include "noise.h"
+
+#if defined(NOISE_AVX2) || defined(NOISE_AVX512)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_SSE2
+#endif
+
+namespace {
+
+// Every lane type provides F (floats), I (32 bit integers) and M (comparison results) and the same set
+// of free functions on them, the kernels below don't know which one they run on.
+
+#if !defined(NOISE_AVX2) && !defined(NOISE_AVX512) && !defined(NOISE_SSE2)
+struct Lanes {
+    typedef float F;
+    typedef uint32_t I;
+    typedef bool M;
+    static const size_t WIDTH = 1;
+};
+inline float fill(float value) { return value; }
+inline uint32_t fillInt(uint32_t value) { return value; }
+inline float load(const float* source) { return *source; }
+inline void store(float* destination, float value) { *destination = value; }
+inline float floorLanes(float x) { return std::floor(x); }
+inline float absLanes(float x) { return std::fabs(x); }
+inline float maxLanes(float a, float b) { return a > b ? a : b; }
+inline uint32_t toInt(float x) { return static_cast<uint32_t>(static_cast<int32_t>(x)); }
+inline float toFloat(uint32_t x) { return static_cast<float>(static_cast<int32_t>(x)); }
+inline bool less(float a, float b) { return a < b; }
+inline bool lessEqual(float a, float b) { return a <= b; }
+inline bool equal(float a, float b) { return a == b; }
+inline bool both(bool a, bool b) { return a && b; }
+inline bool either(bool a, bool b) { return a || b; }
+inline bool invert(bool a) { return !a; }
+inline float select(bool mask, float a, float b) { return mask ? a : b; }
+inline uint32_t multiply(uint32_t a, uint32_t b) { return a * b; }
+template <int N> inline uint32_t shiftRight(uint32_t a) { return a >> N; }
+#endif
+
+#ifdef NOISE_SSE2
+struct F4 { __m128 v; };
+struct I4 { __m128i v; };
+struct Lanes {
+    typedef F4 F;
+    typedef I4 I;
+    typedef F4 M;
+    static const size_t WIDTH = 4;
+};
+inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline I4 operator+(I4 a, I4 b) { return { _mm_add_epi32(a.v, b.v) }; }
+inline I4 operator-(I4 a, I4 b) { return { _mm_sub_epi32(a.v, b.v) }; }
+inline I4 operator^(I4 a, I4 b) { return { _mm_xor_si128(a.v, b.v) }; }
+inline I4 operator&(I4 a, I4 b) { return { _mm_and_si128(a.v, b.v) }; }
+inline F4 fill(float value) { return { _mm_set1_ps(value) }; }
+inline I4 fillInt(uint32_t value) { return { _mm_set1_epi32(static_cast<int>(value)) }; }
+inline F4 load(const float* source) { return { _mm_loadu_ps(source) }; }
+inline void store(float* destination, F4 value) { _mm_storeu_ps(destination, value.v); }
+inline F4 floorLanes(F4 x)
+{
+    // SSE2 has no rounding, truncate and step back where that rounded up (the negatives)
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x.v));
+    return { _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x.v), _mm_set1_ps(1.0f))) };
+}
+inline F4 absLanes(F4 x) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), x.v) }; }
+inline F4 maxLanes(F4 a, F4 b) { return { _mm_max_ps(a.v, b.v) }; }
+inline I4 toInt(F4 x) { return { _mm_cvttps_epi32(x.v) }; }
+inline F4 toFloat(I4 x) { return { _mm_cvtepi32_ps(x.v) }; }
+inline F4 less(F4 a, F4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline F4 lessEqual(F4 a, F4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline F4 equal(F4 a, F4 b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+inline F4 both(F4 a, F4 b) { return { _mm_and_ps(a.v, b.v) }; }
+inline F4 either(F4 a, F4 b) { return { _mm_or_ps(a.v, b.v) }; }
+inline F4 invert(F4 a) { return { _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+inline F4 select(F4 mask, F4 a, F4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+inline I4 multiply(I4 a, I4 b)
+{
+    // SSE2 only multiplies the even lanes into 64 bits, the odd ones are shifted down and done separately
+    __m128i even = _mm_mul_epu32(a.v, b.v);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+    return { _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))) };
+}
+template <int N> inline I4 shiftRight(I4 a) { return { _mm_srli_epi32(a.v, N) }; }
+#endif
+
+#ifdef NOISE_AVX2
+struct F8 { __m256 v; };
+struct I8 { __m256i v; };
+struct Lanes {
+    typedef F8 F;
+    typedef I8 I;
+    typedef F8 M;
+    static const size_t WIDTH = 8;
+};
+inline F8 operator+(F8 a, F8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline F8 operator-(F8 a, F8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline F8 operator*(F8 a, F8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline I8 operator+(I8 a, I8 b) { return { _mm256_add_epi32(a.v, b.v) }; }
+inline I8 operator-(I8 a, I8 b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+inline I8 operator^(I8 a, I8 b) { return { _mm256_xor_si256(a.v, b.v) }; }
+inline I8 operator&(I8 a, I8 b) { return { _mm256_and_si256(a.v, b.v) }; }
+inline F8 fill(float value) { return { _mm256_set1_ps(value) }; }
+inline I8 fillInt(uint32_t value) { return { _mm256_set1_epi32(static_cast<int>(value)) }; }
+inline F8 load(const float* source) { return { _mm256_loadu_ps(source) }; }
+inline void store(float* destination, F8 value) { _mm256_storeu_ps(destination, value.v); }
+inline F8 floorLanes(F8 x) { return { _mm256_floor_ps(x.v) }; }
+inline F8 absLanes(F8 x) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x.v) }; }
+inline F8 maxLanes(F8 a, F8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline I8 toInt(F8 x) { return { _mm256_cvttps_epi32(x.v) }; }
+inline F8 toFloat(I8 x) { return { _mm256_cvtepi32_ps(x.v) }; }
+inline F8 less(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline F8 lessEqual(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline F8 equal(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+inline F8 both(F8 a, F8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline F8 either(F8 a, F8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+inline F8 invert(F8 a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+inline F8 select(F8 mask, F8 a, F8 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+inline I8 multiply(I8 a, I8 b) { return { _mm256_mullo_epi32(a.v, b.v) }; }
+template <int N> inline I8 shiftRight(I8 a) { return { _mm256_srli_epi32(a.v, N) }; }
+#endif
+
+#ifdef NOISE_AVX512
+struct F16 { __m512 v; };
+struct I16 { __m512i v; };
+struct M16 { __mmask16 v; };
+struct Lanes {
+    typedef F16 F;
+    typedef I16 I;
+    typedef M16 M;
+    static const size_t WIDTH = 16;
+};
+inline F16 operator+(F16 a, F16 b) { return { _mm512_add_ps(a.v, b.v) }; }
+inline F16 operator-(F16 a, F16 b) { return { _mm512_sub_ps(a.v, b.v) }; }
+inline F16 operator*(F16 a, F16 b) { return { _mm512_mul_ps(a.v, b.v) }; }
+inline I16 operator+(I16 a, I16 b) { return { _mm512_add_epi32(a.v, b.v) }; }
+inline I16 operator-(I16 a, I16 b) { return { _mm512_sub_epi32(a.v, b.v) }; }
+inline I16 operator^(I16 a, I16 b) { return { _mm512_xor_si512(a.v, b.v) }; }
+inline I16 operator&(I16 a, I16 b) { return { _mm512_and_si512(a.v, b.v) }; }
+inline F16 fill(float value) { return { _mm512_set1_ps(value) }; }
+inline I16 fillInt(uint32_t value) { return { _mm512_set1_epi32(static_cast<int>(value)) }; }
+inline F16 load(const float* source) { return { _mm512_loadu_ps(source) }; }
+inline void store(float* destination, F16 value) { _mm512_storeu_ps(destination, value.v); }
+inline F16 floorLanes(F16 x) { return { _mm512_roundscale_ps(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+inline F16 absLanes(F16 x) { return { _mm512_abs_ps(x.v) }; }
+inline F16 maxLanes(F16 a, F16 b) { return { _mm512_max_ps(a.v, b.v) }; }
+inline I16 toInt(F16 x) { return { _mm512_cvttps_epi32(x.v) }; }
+inline F16 toFloat(I16 x) { return { _mm512_cvtepi32_ps(x.v) }; }
+inline M16 less(F16 a, F16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+inline M16 lessEqual(F16 a, F16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ) }; }
+inline M16 equal(F16 a, F16 b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ) }; }
+inline M16 both(M16 a, M16 b) { return { static_cast<__mmask16>(a.v & b.v) }; }
+inline M16 either(M16 a, M16 b) { return { static_cast<__mmask16>(a.v | b.v) }; }
+inline M16 invert(M16 a) { return { static_cast<__mmask16>(~a.v) }; }
+inline F16 select(M16 mask, F16 a, F16 b) { return { _mm512_mask_blend_ps(mask.v, b.v, a.v) }; }
+inline I16 multiply(I16 a, I16 b) { return { _mm512_mullo_epi32(a.v, b.v) }; }
+template <int N> inline I16 shiftRight(I16 a) { return { _mm512_srli_epi32(a.v, N) }; }
+#endif
+
+typedef Lanes::F F;
+typedef Lanes::I I;
+typedef Lanes::M M;
+
+// the primes the lattice coordinates are multiplied by before they are hashed
+const uint32_t PRIME_X = 0x8DA6B343u;
+const uint32_t PRIME_Y = 0xD8163841u;
+const uint32_t PRIME_Z = 0xCB1AB31Fu;
+
+// a 32 bit hash of a lattice point from its coordinates times the primes. The neighbours of a point only
+// add a prime to those, which saves the kernels most of their (slow) integer multiplies.
+inline I hashLattice(I xPrime, I yPrime, I zPrime, I seed)
+{
+    I hash = multiply(seed ^ xPrime ^ yPrime ^ zPrime, fillInt(0x27D4EB2Du));
+    return hash ^ shiftRight<15>(hash);
+}
+
+// the prime where a lane of offset (0 or 1) is 1, 0 elsewhere
+inline I primeWhere(F offset, uint32_t prime)
+{
+    return (fillInt(0) - toInt(offset)) & fillInt(prime);
+}
+
+// a lattice value in [-1, 1]
+inline F latticeValue(I hash)
+{
+    return toFloat(hash & fillInt(0xFFFFu)) * fill(2.0f / 65535.0f) - fill(1.0f);
+}
+
+inline F smooth(F t)
+{
+    return t * t * (fill(3.0f) - fill(2.0f) * t);
+}
+
+inline F interpolate(F a, F b, F t)
+{
+    return a + (b - a) * t;
+}
+
+// trilinear between random values at the lattice points, in [-1, 1]
+inline F valueNoise(F x, F y, F z, I seed)
+{
+    F x0 = floorLanes(x), y0 = floorLanes(y), z0 = floorLanes(z);
+    F tx = smooth(x - x0), ty = smooth(y - y0), tz = smooth(z - z0);
+    I x0p = multiply(toInt(x0), fillInt(PRIME_X)), y0p = multiply(toInt(y0), fillInt(PRIME_Y)), z0p = multiply(toInt(z0), fillInt(PRIME_Z));
+    I x1p = x0p + fillInt(PRIME_X), y1p = y0p + fillInt(PRIME_Y), z1p = z0p + fillInt(PRIME_Z);
+    F c000 = latticeValue(hashLattice(x0p, y0p, z0p, seed));
+    F c100 = latticeValue(hashLattice(x1p, y0p, z0p, seed));
+    F c010 = latticeValue(hashLattice(x0p, y1p, z0p, seed));
+    F c110 = latticeValue(hashLattice(x1p, y1p, z0p, seed));
+    F c001 = latticeValue(hashLattice(x0p, y0p, z1p, seed));
+    F c101 = latticeValue(hashLattice(x1p, y0p, z1p, seed));
+    F c011 = latticeValue(hashLattice(x0p, y1p, z1p, seed));
+    F c111 = latticeValue(hashLattice(x1p, y1p, z1p, seed));
+    F bottom = interpolate(interpolate(c000, c100, tx), interpolate(c010, c110, tx), ty);
+    F top = interpolate(interpolate(c001, c101, tx), interpolate(c011, c111, tx), ty);
+    return interpolate(bottom, top, tz);
+}
+
+// the dot product with one of the 12 edge directions of a cube, picked by the low 4 bits of the hash
+inline F gradient(I hash, F x, F y, F z)
+{
+    F h = toFloat(hash & fillInt(15u));
+    F u = select(less(h, fill(8.0f)), x, y);
+    F v = select(less(h, fill(4.0f)), y, select(either(equal(h, fill(12.0f)), equal(h, fill(14.0f))), x, z));
+    F signU = fill(1.0f) - fill(2.0f) * toFloat(hash & fillInt(1u));
+    F signV = fill(1.0f) - toFloat(hash & fillInt(2u));
+    return u * signU + v * signV;
+}
+
+inline F simplexCorner(F x, F y, F z, I hash)
+{
+    F t = maxLanes(fill(0.6f) - x * x - y * y - z * z, fill(0.0f));
+    t = t * t;
+    return t * t * gradient(hash, x, y, z);
+}
+
+// Gustavson's 3D simplex noise without the permutation table, in about [-1, 1]
+inline F simplexNoise(F x, F y, F z, I seed)
+{
+    const float SKEW = 1.0f / 3.0f;
+    const float UNSKEW = 1.0f / 6.0f;
+    F s = (x + y + z) * fill(SKEW);
+    F i = floorLanes(x + s), j = floorLanes(y + s), k = floorLanes(z + s);
+    F t = (i + j + k) * fill(UNSKEW);
+    F x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+
+    // which of the six tetrahedra of the skewed cube the point is in
+    M xy = lessEqual(y0, x0), xz = lessEqual(z0, x0), yz = lessEqual(z0, y0);
+    F one = fill(1.0f), zero = fill(0.0f);
+    F i1 = select(both(xy, xz), one, zero);
+    F j1 = select(both(invert(xy), yz), one, zero);
+    F k1 = select(both(invert(xz), invert(yz)), one, zero);
+    F i2 = select(either(xy, xz), one, zero);
+    F j2 = select(either(invert(xy), yz), one, zero);
+    F k2 = select(invert(both(xz, yz)), one, zero);
+
+    F x1 = x0 - i1 + fill(UNSKEW), y1 = y0 - j1 + fill(UNSKEW), z1 = z0 - k1 + fill(UNSKEW);
+    F x2 = x0 - i2 + fill(2.0f * UNSKEW), y2 = y0 - j2 + fill(2.0f * UNSKEW), z2 = z0 - k2 + fill(2.0f * UNSKEW);
+    F x3 = x0 - one + fill(3.0f * UNSKEW), y3 = y0 - one + fill(3.0f * UNSKEW), z3 = z0 - one + fill(3.0f * UNSKEW);
+
+    I ip = multiply(toInt(i), fillInt(PRIME_X)), jp = multiply(toInt(j), fillInt(PRIME_Y)), kp = multiply(toInt(k), fillInt(PRIME_Z));
+    F n = simplexCorner(x0, y0, z0, hashLattice(ip, jp, kp, seed));
+    n = n + simplexCorner(x1, y1, z1, hashLattice(ip + primeWhere(i1, PRIME_X), jp + primeWhere(j1, PRIME_Y), kp + primeWhere(k1, PRIME_Z), seed));
+    n = n + simplexCorner(x2, y2, z2, hashLattice(ip + primeWhere(i2, PRIME_X), jp + primeWhere(j2, PRIME_Y), kp + primeWhere(k2, PRIME_Z), seed));
+    n = n + simplexCorner(x3, y3, z3, hashLattice(ip + fillInt(PRIME_X), jp + fillInt(PRIME_Y), kp + fillInt(PRIME_Z), seed));
+    return n * fill(32.0f);
+}
+
+inline F fractalNoise(const NoiseSettings& settings, F x, F y, F z, unsigned int seed)
+{
+    F sum = fill(0.0f);
+    float amplitude = 1.0f;
+    float frequency = settings.frequency;
+    float total = 0.0f;
+    for (unsigned int octave = 0; octave < settings.octaves; octave++)
+    {
+        F px = x * fill(frequency), py = y * fill(frequency), pz = z * fill(frequency);
+        I octaveSeed = fillInt(seed + octave * 0x9E3779B9u);
+        F n = settings.type == NOISE_SIMPLEX ? simplexNoise(px, py, pz, octaveSeed) : valueNoise(px, py, pz, octaveSeed);
+        if (settings.fractal == NOISE_RIDGED)
+        {
+            // sharp crests where the noise crosses zero
+            n = fill(1.0f) - absLanes(n);
+            n = n * n;
+        }
+        sum = sum + n * fill(amplitude);
+        total += amplitude;
+        amplitude *= settings.gain;
+        frequency *= settings.lacunarity;
+    }
+    return total > 0.0f ? sum * fill(1.0f / total) : sum;
+}
+
+inline F evaluate(const NoiseSettings& settings, F x, F y, F z)
+{
+    if (settings.warp > 0.0f)
+    {
+        // the position is pushed around by three more noise fields first, which bends and swirls the features
+        F warp = fill(settings.warp);
+        F wx = fractalNoise(settings, x, y, z, settings.seed + 1013u);
+        F wy = fractalNoise(settings, x, y, z, settings.seed + 2029u);
+        F wz = fractalNoise(settings, x, y, z, settings.seed + 3037u);
+        x = x + wx * warp;
+        y = y + wy * warp;
+        z = z + wz * warp;
+    }
+    return fractalNoise(settings, x, y, z, settings.seed);
+}
+
+// count samples, a vector at a time, the last partial vector through a padded copy
+inline void evaluateBatch(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count)
+{
+    const size_t WIDTH = Lanes::WIDTH;
+    size_t i = 0;
+    for (; i + WIDTH <= count; i += WIDTH)
+        store(result + i, evaluate(settings, load(x + i), load(y + i), load(z + i)));
+    if (i < count)
+    {
+        float px[WIDTH] = {}, py[WIDTH] = {}, pz[WIDTH] = {}, out[WIDTH];
+        for (size_t j = 0; i + j < count; j++)
+        {
+            px[j] = x[i + j];
+            py[j] = y[i + j];
+            pz[j] = z[i + j];
+        }
+        store(out, evaluate(settings, load(px), load(py), load(pz)));
+        for (size_t j = 0; i + j < count; j++)
+            result[i + j] = out[j];
+    }
+}
+
+}
+
+#endif
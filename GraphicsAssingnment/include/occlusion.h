@@ -0,0 +1,51 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// A low resolution software depth buffer of the big bodies in front of the camera, with a max-depth
+// pyramid on top (hierarchical Z). The occluders are rasterized as the largest disc that is surely
+// inside their silhouette, at the depth of their far side, so a test against the buffer only ever
+// errs on the visible side. Depths are linear view distances.
+class OcclusionBuffer {
+public:
+    static const int WIDTH = 128;
+    static const int HEIGHT = 64;
+
+    OcclusionBuffer();
+
+    // clears the buffer for a new view
+    void begin(const glm::mat4& view, const glm::mat4& projection);
+    // rasterizes a sphere (world space) as an occluder
+    void addOccluder(const glm::vec3& center, float radius);
+    // builds the pyramid, call after the last occluder
+    void finish();
+    // true when the sphere (world space) is entirely behind the occluders
+    bool occluded(const glm::vec3& center, float radius) const;
+
+    // the pyramid, level 0 is WIDTH x HEIGHT and every level halves it down to 1x1
+    int levels() const { return static_cast<int>(_levels.size()); }
+    int levelWidth(int level) const { return glm::max(1, WIDTH >> level); }
+    int levelHeight(int level) const { return glm::max(1, HEIGHT >> level); }
+    const std::vector<float>& level(int level) const { return _levels[level]; }
+    bool empty() const { return _empty; }
+
+private:
+    // the screen rectangle (in level 0 pixels: min x, min y, max x, max y) that contains the sphere,
+    // false when it reaches the near plane
+    bool projectSphere(const glm::vec3& viewCenter, float radius, glm::vec4& bounds) const;
+
+    std::vector<std::vector<float>> _levels;
+    glm::mat4 _view;
+    float _p00 = 1.0f;
+    float _p11 = 1.0f;
+    float _near = 0.1f;
+    bool _empty = true;
+};
+
+// clears visible[i] of every visible sphere (xyz center, w radius) that is hidden behind the occluders
+void cullOccluded(const OcclusionBuffer& buffer, const std::vector<glm::vec4>& spheres, std::vector<unsigned char>& visible);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "window.h"
+#include "capture.h"
+#include "stress.h"
+#include "point_raster.h"
+
+#include <string>
+
+// Settings that can be changed from the command line
+struct Options {
+    // bodies, models and stars to simulate
+    std::string scenePath = "./assets/scenes/solar.json";
+    // a generated scene replaces the scene file when any of its counts is given
+    bool stress = false;
+    StressSettings stressSettings;
+    // the scene that was simulated, written back as a scene file
+    std::string saveScenePath;
+    // a CSV star catalog to convert to the packed format (next to it, as .stars) before exiting
+    std::string importCatalogPath;
+    WindowBackend backend = BACKEND_WINDOW;
+    // number of frames to render before exiting, 0 renders until the window is closed
+    unsigned int frames = 0;
+    // file prefix for recorded frames, empty disables the capture
+    std::string capturePath;
+    CaptureFormat captureFormat = CAPTURE_PNG;
+    // Chrome trace written at exit, empty disables it (needs a build with ENABLE_PROFILER)
+    std::string tracePath;
+    // draws of the same model and shader are merged into one instanced call, off draws every object on its own
+    bool instancing = true;
+    // with OpenGL 4.3 the objects are culled by a compute shader and drawn with multi-draw indirect
+    bool gpuDriven = true;
+    // bodies hidden behind the biggest ones are culled against a software depth pyramid
+    bool occlusion = true;
+    // face size of a cubemap the stars are baked into at startup, 0 draws them as cubes every frame
+    unsigned int skyboxSize = 0;
+    // the faintest catalog stars drawn, the default is about what the eye sees on a dark night
+    float magnitudeLimit = 6.5f;
+    // a point cloud of stars drawn around the scene, empty draws none
+    std::string galaxyPath;
+    // generate a galaxy of this many stars into galaxyPath first, 0 uses the file as it is
+    unsigned int galaxyStars = 0;
+    // the most galaxy points drawn in a frame
+    unsigned int pointBudget = 4000000;
+    // how the galaxy points are rasterized, the compute path needs OpenGL 4.3
+    PointRasterMode galaxyRaster = POINT_RASTER_FIXED;
+    // star systems generated from the seed sector by sector around the camera
+    bool universe = false;
+    // bodies with height maps are drawn as quadtree terrain, off draws their models
+    bool terrain = true;
+    // on-screen radius in pixels under which round bodies are drawn as ray-cast impostors, 0 never
+    float impostorRadius = 16.0f;
+    // the fine mip levels of the model textures are streamed in as the bodies get close, off loads them whole
+    bool textureStreaming = true;
+    // the model textures are block compressed as they load, a quarter to an eighth of the video memory
+    bool textureCompression = true;
+    // video memory budget in MB over everything the program allocates, the least recently drawn
+    // resources are evicted to keep to it, 0 leaves it to the budgets of the streaming subsystems
+    unsigned int gpuMemory = 0;
+
+    // benchmark mode: seeded randomness, fixed simulation step, scripted camera and a frame time report
+    bool benchmark = false;
+    unsigned int seed = 1;
+    float fixedStep = 1.0f / 60.0f;
+    std::string cameraPath;
+    std::string reportPath;
+    // CSV file that every benchmark appends its frame time and scene size to
+    std::string curvePath;
+};
+
+// parses the command line, returns false (after printing the usage) when an argument is not understood
+bool parseOptions(int argc, char** argv, Options& options);
+
+#endif
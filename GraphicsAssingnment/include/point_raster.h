@@ -0,0 +1,44 @@
+#ifndef POINT_RASTER_H
+#define POINT_RASTER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl43.h"
+#include "compute_shader.h"
+#include "shader.h"
+
+// How a point cloud reaches the screen: GL_POINTS through the pipeline, every point blended in, or the
+// PointRasterizer below that keeps the nearest point of each pixel
+enum PointRasterMode {
+    POINT_RASTER_FIXED,
+    POINT_RASTER_COMPUTE
+};
+
+// Draws one pixel points without the fixed-function pipeline (needs OpenGL 4.3, see gl43.h). A compute
+// shader projects every point and keeps the nearest one of each pixel with a 32 bit imageAtomicMin: the
+// high 16 bits are a logarithmic depth, the low 16 bits the colour as RGB565. A fullscreen pass then
+// writes the survivors over the framebuffer, depth tested against the scene, and clears the image for
+// the next frame. With dense point sets this skips the per-point primitive setup entirely.
+class PointRasterizer {
+public:
+    PointRasterizer();
+    ~PointRasterizer();
+
+    // starts a frame, the target follows the size of the viewport
+    void begin(const glm::mat4& projection, const glm::mat4& view);
+    // splats count points from a buffer of CloudPoints (see pointcloud.h)
+    void splat(unsigned int buffer, unsigned int count);
+    void resolve();
+
+private:
+    ComputeShader _splatShader;
+    Shader _resolveShader;
+    unsigned int _target = 0;
+    unsigned int _VAO = 0;
+    int _width = 0;
+    int _height = 0;
+    glm::mat4 _projection;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gpumemory.h"
+#include "jobs.h"
+#include "point_raster.h"
+#include "shader.h"
+
+// A point of the cloud, 16 bytes, the vertex format as it is on disk
+struct CloudPoint {
+    glm::vec3 position;
+    uint32_t color;         // RGBA8
+};
+
+// A node of the octree as it is stored. Every point is stored exactly once: a node keeps a random
+// subsample of the points inside it and its children the rest, so drawing a node adds detail to
+// what its parent already drew.
+struct CloudNode {
+    glm::vec3 center;
+    float halfSize;
+    uint32_t firstPoint;        // into the points that follow the nodes in the file
+    uint32_t pointCount;
+    int32_t children[8];        // node indices, -1 for an empty octant
+};
+
+struct PointCloudHeader {
+    char magic[4];              // "PCLD"
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t pointCount;
+};
+
+const uint32_t POINT_CLOUD_VERSION = 1;
+// points a node keeps before it splits
+const uint32_t POINT_CLOUD_NODE_POINTS = 8192;
+
+// A procedural spiral galaxy
+struct GalaxySettings {
+    uint32_t stars = 10000000;
+    float radius = 4000.0f;
+    float thickness = 60.0f;
+    unsigned int arms = 2;
+    // where the galaxy's centre is, the origin (the solar system) sits in the disc
+    glm::vec3 center = glm::vec3(-2600.0f, 0.0f, 0.0f);
+    // no stars this close to the origin, they would crowd the planets
+    float clearRadius = 600.0f;
+    unsigned int seed = 1;
+};
+
+// generates the galaxy on the job system and writes it as a point cloud. Everything is built in memory,
+// 16 bytes a star, so a 100M star galaxy needs a machine with a couple of GB to spare.
+bool buildGalaxy(const GalaxySettings& settings, const std::string& path);
+// builds the octree over the points (reordering them) and writes the file
+bool writePointCloud(std::vector<CloudPoint>& points, const std::string& path);
+
+// Draws a point cloud file of any size within a budget. Every frame the octree is walked from the
+// root, the node whose points are farthest apart on screen first, until the point budget is spent or
+// the points are less than a pixel apart. Nodes that are not in memory are read by jobs and uploaded
+// a few per frame; the least recently drawn ones are evicted once the resident points exceed the
+// memory budget, or when gpuMemory() needs the room.
+class PointCloud : public GpuCache {
+public:
+    PointCloud();
+    ~PointCloud();
+    PointCloud(const PointCloud&) = delete;
+    PointCloud& operator=(const PointCloud&) = delete;
+
+    // reads the header and the node table, the points stay on disk until they are needed
+    bool open(const std::string& path, size_t memoryBudget);
+
+    // picks this frame's nodes, uploads the nodes that finished loading and requests the missing ones
+    void update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, float viewportHeight, size_t pointBudget);
+    void draw(const glm::mat4& projection, const glm::mat4& view);
+
+    // the compute rasterizer needs OpenGL 4.3, without it the cloud stays on GL_POINTS
+    void setRasterMode(PointRasterMode mode);
+    PointRasterMode rasterMode() const { return _rasterMode; }
+
+    size_t drawnPoints() const { return _drawnPoints; }
+    size_t residentBytes() const { return _residentBytes; }
+
+    bool oldest(unsigned int& frame) const override;
+    void evictOldest() override;
+
+private:
+    enum NodeState { NODE_ON_DISK, NODE_REQUESTED, NODE_RESIDENT };
+    struct Node {
+        NodeState state = NODE_ON_DISK;
+        unsigned int buffer = 0;
+        unsigned int lastFrame = 0;
+        std::list<unsigned int>::iterator recent;   // position in _recent while resident
+    };
+    struct LoadedNode {
+        unsigned int node;
+        std::vector<CloudPoint> points;
+    };
+
+    void request(unsigned int node);
+    void upload();
+    void evict();
+
+    Shader _shader;
+    unsigned int _VAO = 0;
+    PointRasterMode _rasterMode = POINT_RASTER_FIXED;
+    std::unique_ptr<PointRasterizer> _rasterizer;
+    std::string _path;
+    size_t _pointsOffset = 0;       // file offset of the first point
+    size_t _memoryBudget = 0;
+    std::vector<CloudNode> _nodes;
+    std::vector<Node> _state;
+    std::list<unsigned int> _recent;    // resident nodes, most recently drawn first
+    size_t _residentBytes = 0;
+    std::vector<unsigned int> _selected;
+    size_t _drawnPoints = 0;
+
+    // filled by the loading jobs, emptied by upload() on the main thread
+    std::mutex _loadedLock;
+    std::vector<LoadedNode> _loaded;
+    std::vector<JobHandle> _jobs;
+    unsigned int _inFlight = 0;
+};
+
+#endif
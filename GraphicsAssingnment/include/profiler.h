@@ -0,0 +1,125 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// How long one frame took, kept in a rolling history
+struct FrameTiming {
+    uint64_t frame = 0;
+    float cpuMs = 0.0f;
+    float gpuMs = 0.0f;     // filled in two frames later, once the timestamp queries are available
+    std::vector<std::pair<const char*, float>> phases;  // top level CPU scopes of the main thread
+};
+
+// Collects CPU scopes from every thread and GL timestamp queries around the render passes, and
+// exports them as a Chrome trace (chrome://tracing or ui.perfetto.dev). Use the PROFILE_* macros,
+// they compile to nothing unless ENABLE_PROFILER is defined.
+class Profiler {
+public:
+    Profiler();
+
+    // creates the GL query pool, needs a current context
+    void initGpu();
+    void beginFrame();
+    void endFrame();
+
+    void recordCpu(const char* name, int64_t startUs, int64_t durationUs, bool topLevel);
+    void beginGpu(const char* name);
+    void endGpu();
+
+    // microseconds since the profiler was created
+    int64_t now() const;
+
+    const std::deque<FrameTiming>& history() const { return _history; }
+    bool writeChromeTrace(const std::string& path);
+    void printSummary() const;
+
+private:
+    struct TraceEvent {
+        const char* name;
+        int64_t start;
+        int64_t duration;
+        unsigned int thread;    // 0 is the GPU track
+    };
+    struct GpuRange {
+        const char* name;
+        unsigned int begin;     // query indices
+        unsigned int end;
+        int depth;
+    };
+    // queries of one frame, there are two of these so results are read a frame after they were issued
+    struct GpuFrame {
+        uint64_t frame = 0;
+        std::vector<unsigned int> queries;
+        unsigned int used = 0;
+        std::vector<GpuRange> scopes;
+        std::vector<size_t> open;
+        int64_t clockOffset = 0;    // CPU microseconds minus GPU microseconds
+        bool pending = false;
+    };
+
+    unsigned int threadIndex();
+    void resolveGpu(GpuFrame& frame);
+    void addEvent(const TraceEvent& event);
+
+    int64_t _epoch;
+    std::thread::id _mainThreadId;
+    uint64_t _frame = 0;
+    int64_t _frameStart = 0;
+    bool _gpuReady = false;
+
+    std::mutex _lock;
+    std::vector<TraceEvent> _events;
+    std::vector<std::string> _threadNames;
+    std::deque<FrameTiming> _history;
+    FrameTiming _current;
+    GpuFrame _gpuFrames[2];
+};
+
+// created on first use, which has to happen on the main thread
+Profiler& profiler();
+
+// Times the enclosing scope on the calling thread
+class CpuScope {
+public:
+    explicit CpuScope(const char* name);
+    ~CpuScope();
+
+private:
+    const char* _name;
+    int64_t _start;
+};
+
+// Brackets the enclosing scope with GL timestamp queries, main thread only
+class GpuScope {
+public:
+    explicit GpuScope(const char* name) { profiler().beginGpu(name); }
+    ~GpuScope() { profiler().endGpu(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_SCOPE(name) CpuScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuScope PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
+#define PROFILE_INIT_GPU() profiler().initGpu()
+#define PROFILE_BEGIN_FRAME() profiler().beginFrame()
+#define PROFILE_END_FRAME() profiler().endFrame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_INIT_GPU() ((void)0)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <random>
+
+// Random numbers that are the same for a seed on every platform, for what is generated from --seed.
+// std::uniform_real_distribution differs between standard libraries, this doesn't: the floats come
+// straight from the 32 bits of std::mt19937, whose sequence the standard fixes.
+class DeterministicRandom {
+public:
+    // a 64 bit seed is folded into 32, a 32 bit one is used as it is
+    explicit DeterministicRandom(uint64_t seed) : _engine(static_cast<uint32_t>(seed ^ (seed >> 32))) {}
+
+    // in [low, high)
+    float uniform(float low, float high)
+    {
+        return low + (high - low) * static_cast<float>(_engine() / 4294967296.0);
+    }
+    glm::vec3 color(const glm::vec3& low, const glm::vec3& high)
+    {
+        return glm::vec3(uniform(low.r, high.r), uniform(low.g, high.g), uniform(low.b, high.b));
+    }
+    uint32_t next() { return _engine(); }
+
+private:
+    std::mt19937 _engine;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "model.h"
+#include "jobs.h"
+#include "gpumemory.h"
+
+typedef unsigned int ModelHandle;
+const ModelHandle INVALID_MODEL = 0xFFFFFFFFu;
+
+// Owns every loaded model. A model is imported once and shared by all the objects that use it, the
+// objects only keep its handle. Models never move or change after loading, so handles and the
+// references returned by get() stay valid for the lifetime of the library. Over the video memory
+// budget the meshes of the least recently drawn models are evicted, they upload again when drawn.
+class ModelLibrary : public GpuCache {
+public:
+    ModelLibrary();
+    ~ModelLibrary();
+    ModelLibrary(const ModelLibrary&) = delete;
+    ModelLibrary& operator=(const ModelLibrary&) = delete;
+
+    // starts loading a model on the job system. A path that was loaded before returns the existing
+    // handle, unless unique asks for a separate copy. Without textures the model's own aren't loaded,
+    // a material gives them (see addTextures()), and it isn't shared with the textured copy.
+    ModelHandle load(const std::string& path, bool unique = false, bool textures = true);
+    // waits for every load started so far, the GL uploads run on the calling thread, which has to be the main thread
+    void wait();
+
+    // the models loaded after this stream their textures (see streaming.h), null loads them whole
+    void setTextureStreamer(TextureStreamer* streamer) { _streamer = streamer; }
+    // the models loaded after this block compress their textures (see compression.h)
+    void setTextureCompression(bool compress) { _compressTextures = compress; }
+
+    // adds textures to every mesh of a loaded model, like the layers of a material (see material.h)
+    void addTextures(ModelHandle handle, const std::vector<Texture>& textures);
+
+    // frees the GL buffers of a model's meshes, for models drawn from other buffers. A draw uploads them again.
+    void release(ModelHandle handle) { _models[handle].release(); }
+
+    const Model& get(ModelHandle handle) const { return _models[handle]; }
+    size_t size() const { return _models.size(); }
+
+    bool oldest(unsigned int& frame) const override;
+    void evictOldest() override;
+
+private:
+    // the resident model drawn longest ago, INVALID_MODEL if every resident one was drawn this frame
+    ModelHandle leastRecentlyDrawn() const;
+
+    std::deque<Model> _models;
+    std::map<std::pair<std::string, bool>, ModelHandle> _byPath;     // by path and whether it has its textures
+    std::vector<JobHandle> _loading;
+    TextureStreamer* _streamer = nullptr;
+    bool _compressTextures = false;
+};
+
+#endif
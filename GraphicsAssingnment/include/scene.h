@@ -0,0 +1,98 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// An orbit (or, with radius 0, a spin), the parameters of a Transformation
+struct SceneMotion {
+    float radius;
+    float period;
+    float phase = 0.0f;
+};
+
+struct SceneShader {
+    std::string name;
+    std::string vertex;
+    std::string fragment;
+};
+
+// The images of a layered planet material (see material.h), all of them the size of the colour map.
+// Only the colour map is required, the rest are greyscale masks: white where there is land (the ocean
+// mask is black on the water, like the one the earth ships with), cloud, city light or high ground.
+struct SceneLayers {
+    std::string color;
+    std::string ocean;
+    std::string clouds;
+    std::string night;
+    std::string height;
+};
+
+struct SceneModel {
+    std::string name;
+    std::string path;
+    bool unique = false;    // loaded separately even if another model has the same path
+    SceneLayers layers;     // drawn with a layered material when there is a colour map
+};
+
+// A celestial body. Children follow the orbits of their parent but not its spin.
+struct SceneBody {
+    std::string name;
+    unsigned int model = 0;     // index into SceneDescription::models
+    unsigned int shader = 0;    // index into SceneDescription::shaders
+    int parent = -1;            // index of a body listed before this one, -1 for none
+    glm::vec3 scale = glm::vec3(1.0f);
+    std::vector<SceneMotion> orbits;
+    float spin = 0.0f;          // period of the rotation around its own axis, 0 doesn't spin
+    bool hidden = false;        // moves (and carries its children) but isn't drawn
+    // cube cross height and colour maps that draw the body as terrain instead of its model, empty for none
+    std::string terrainHeight;
+    std::string terrainColor;
+    float terrainRelief = 0.0f; // highest point over the lowest, relative to the radius
+};
+
+// Everything main() needs to build the simulation, read from a JSON scene file:
+//
+// {
+//     "stars": { "count": 1000, "radius": 500, "catalog": "./assets/stars/hyg.stars" },
+//     "light": [0, 0, 0],
+//     "shaders": { "lit": { "vertex": "vertex.glsl", "fragment": "fragment.glsl" } },
+//     "models": { "earth": "./assets/objects/earth/Earth.obj", "copy": { "path": "./assets/objects/earth/Earth.obj", "unique": true,
+//                 "layers": { "color": "Diffuse_2K.png", "ocean": "Ocean_Mask_2K.png", "clouds": "Clouds_2K.png", "night": "Night_lights_2K.png", "height": "Bump_2K.png" } } },
+//     "bodies": [
+//         { "name": "earth", "model": "earth", "shader": "lit", "scale": 0.5, "orbits": [[47, 20]], "spin": 1,
+//           "terrain": { "height": "./assets/objects/earth/Textures/Bump_2K.png", "color": "./assets/objects/earth/Textures/Diffuse_2K.png", "relief": 0.01 } },
+//         { "name": "moon", "parent": "earth", "model": "earth", "shader": "lit", "scale": [0.1, 0.1, 0.1], "orbits": [[3, 3]] }
+//     ]
+// }
+//
+// Models with the same path are loaded once unless they are marked unique. A model with "layers" gets
+// a layered material for the shaders that sample it, they are packed into texture arrays (see material.h).
+// A body with "hidden": true moves and carries its children but isn't drawn. The star catalog is optional,
+// without it "count" stars are scattered at random on a sphere of "radius".
+// A body with "terrain" is drawn from its height map (see terrain.h) and keeps its model for the rest.
+// Orbits are [radius, period] or [radius, period, phase] arrays, the phase in radians. Shaders and
+// models have to come before the bodies, and a parent before its children, so every reference is
+// resolved while parsing.
+struct SceneDescription {
+    std::vector<SceneShader> shaders;
+    std::vector<SceneModel> models;
+    std::vector<SceneBody> bodies;
+    glm::vec3 light = glm::vec3(0.0f);
+    unsigned int starCount = 1000;
+    float starRadius = 500.0f;
+    // a packed star catalog (see catalog.h) that replaces the random stars when it is given
+    std::string starCatalog;
+
+    // the motions that place a body, outermost first: the orbits of its ancestors, its own orbits and its spin
+    std::vector<SceneMotion> motionChain(size_t body) const;
+};
+
+// reads a scene file, prints the reason and returns false if it is malformed
+bool loadScene(const std::string& path, SceneDescription& scene);
+// writes a scene in the format loadScene() reads
+bool saveScene(const std::string& path, const SceneDescription& scene);
+
+#endif
@@ -9,6 +9,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "profiler.h"
+
 class Shader
 {
 public:
@@ -17,6 +19,7 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
+        PROFILE_SCOPE("Shader");
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
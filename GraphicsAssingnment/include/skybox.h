@@ -0,0 +1,40 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+
+// The six faces of a cubemap, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X and the ones after it
+struct CubemapImage {
+    unsigned int size = 0;                      // width and height of a face
+    std::vector<unsigned char> faces[6];        // RGB, rows from t = 0
+};
+
+// bakes stars seen from the origin into a cubemap: white squares of halfSize (world units) at the
+// positions, over the background colour. A star never gets smaller than a texel and a half across,
+// so low resolutions dim the stars instead of losing them.
+CubemapImage bakeStarfield(const std::vector<glm::vec3>& positions, float halfSize, unsigned int size, const glm::vec3& background);
+
+// A background at infinity: a cubemap drawn by one fullscreen triangle at the far plane. It goes after
+// the opaque geometry so early depth testing rejects every pixel they cover, and it costs the same
+// whatever is baked into it.
+class Skybox {
+public:
+    Skybox();
+    ~Skybox();
+
+    void upload(const CubemapImage& image);
+    void draw(const glm::mat4& projection, const glm::mat4& view);
+
+private:
+    Shader _shader;
+    unsigned int _texture = 0;
+    size_t _textureBytes = 0;
+    unsigned int _VAO = 0;      // empty, the vertex shader makes up the triangle
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstdint>
+
+// Counters for the work submitted to OpenGL during a frame, reset at the start of every frame
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    uint64_t triangles = 0;
+
+    void reset()
+    {
+        drawCalls = 0;
+        triangles = 0;
+    }
+    void addDraw(uint64_t triangleCount)
+    {
+        drawCalls++;
+        triangles += triangleCount;
+    }
+};
+
+// render statistics of the current frame, only touched from the main thread
+inline RenderStats& renderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+#endif
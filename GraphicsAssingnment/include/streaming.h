@@ -0,0 +1,127 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "jobs.h"
+#include "texture.h"
+#include "gpumemory.h"
+
+// levels no larger than this (on their longer side) are loaded with the model and never evicted,
+// so a streamed texture is always complete
+const int STREAMING_TAIL_SIZE = 128;
+// a level stays wanted for this many frames after it was last asked for, so a renderer that only
+// reports every few frames doesn't lose its levels in between
+const unsigned int STREAMING_WANT_FRAMES = 8;
+
+// The header of a mip file, an image with its whole mip chain ready to upload. It is followed by the
+// file offset of every level and then the levels themselves, largest first, rows tightly packed or
+// block compressed.
+struct MipFileHeader {
+    char magic[4];              // "MIPS"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t levels;
+    uint32_t format;            // the GL format of block compressed levels, 0 for raw pixels
+    // size and modification time of the image the file was built from, a changed image rebuilds it
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+
+// the mip file next to an image, "<path>.mips"
+std::string mipFilePath(const std::string& imagePath);
+// decodes the image and writes its mip file, box filtered level by level and block compressed
+// (see compression.h) when compress is set
+bool buildMipFile(const std::string& imagePath, const std::string& mipPath, bool compress);
+// reads the levels up to STREAMING_TAIL_SIZE of an image's mip file, building the file first if it is
+// missing, older than the image or compressed otherwise. Doesn't touch OpenGL, TextureStreamer::add()
+// uploads the result.
+TextureImage decodeStreamedTexture(const std::string& imagePath, bool compress = false);
+
+// Streams the fine mip levels of model textures within a video memory budget. A texture starts with
+// its small levels only. Every frame the renderer says how many pixels across the bodies using it are
+// drawn, which gives the finest level worth having, and the missing levels are read from the mip file
+// by jobs, one level at a time, the texture that lacks the most first. When the next level doesn't fit
+// the budget, levels finer than their texture needs right now go, least recently wanted first. The GL
+// texture keeps its name: levels are added and dropped under GL_TEXTURE_BASE_LEVEL. The levels are
+// also counted in gpuMemory(), whose budget can take the unneeded ones.
+class TextureStreamer : public GpuCache {
+public:
+    explicit TextureStreamer(size_t memoryBudget);
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // creates the GL texture of an image from decodeStreamedTexture() and frees its pixels, main thread only
+    unsigned int add(TextureImage& image);
+    // a body using the texture is drawn pixels across this frame, the largest of the frame counts. The
+    // textures are assumed to wrap once around the body, like the maps of the planets.
+    void want(unsigned int texture, float pixels);
+    // uploads the levels that finished loading, makes room and requests the missing ones
+    void update();
+
+    size_t textureCount() const { return _textures.size(); }
+    size_t residentBytes() const { return _residentBytes; }
+    size_t memoryBudget() const { return _memoryBudget; }
+
+    bool oldest(unsigned int& frame) const override;
+    void evictOldest() override;
+
+private:
+    struct StreamedTexture {
+        unsigned int id = 0;
+        std::string mipPath;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        int levels = 0;
+        int tail = 0;               // the largest level loaded with the model
+        int base = 0;               // the largest resident level
+        std::vector<uint64_t> offsets;
+        bool loading = false;
+        int wantedLevel = 0;        // the largest level asked for in wantedFrame
+        unsigned int wantedFrame = 0;
+        GLenum compressedFormat = 0;    // 0 for raw pixels
+    };
+    struct LoadedLevel {
+        unsigned int texture;       // index into _textures
+        int level;
+        std::vector<unsigned char> pixels;
+    };
+
+    void request(unsigned int texture, int level);
+    void upload();
+    // one level of the bound texture from its bytes in the mip file
+    void uploadLevel(const StreamedTexture& texture, int level, const unsigned char* pixels, size_t size);
+    // the level a texture should have down to, its tail when nothing drew it lately
+    int target(const StreamedTexture& texture) const;
+    // the texture whose largest level should go first, -1 if every texture has only what it needs
+    int victim() const;
+    void dropLevel(StreamedTexture& texture);
+    // drops unneeded levels until bytes more fit in the budget, false if they can't
+    bool makeRoom(size_t bytes);
+    size_t levelBytes(const StreamedTexture& texture, int level) const;
+
+    size_t _memoryBudget;
+    std::vector<StreamedTexture> _textures;
+    std::unordered_map<unsigned int, unsigned int> _byName;     // GL name to index
+    size_t _residentBytes = 0;
+    size_t _requestedBytes = 0;     // levels being loaded, counted against the budget already
+    unsigned int _inFlight = 0;
+
+    // filled by the loading jobs, emptied by upload() on the main thread
+    std::mutex _loadedLock;
+    std::vector<LoadedLevel> _loaded;
+    std::vector<JobHandle> _jobs;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef STRESS_H
+#define STRESS_H
+
+#include "scene.h"
+
+// Counts of a synthetic scene used to find how the renderer scales with the number of bodies
+struct StressSettings {
+    unsigned int planets = 8;
+    unsigned int moons = 2;         // per planet
+    unsigned int asteroids = 0;     // small bodies in a belt around the sun, they always share one model
+    unsigned int stars = 1000;
+    // every planet and moon loads its own copy of its model and textures instead of sharing one
+    bool uniqueModels = false;
+};
+
+// builds a sun with planets, moons and an asteroid belt from the shipped models.
+// The same settings and seed always give the same scene.
+void generateStressScene(const StressSettings& settings, unsigned int seed, SceneDescription& scene);
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "culling.h"
+#include "gpumemory.h"
+#include "jobs.h"
+#include "shader.h"
+
+// quads along the edge of a terrain chunk, every chunk has the same grid
+const int TERRAIN_CHUNK_QUADS = 32;
+// the deepest level of the quadtree, a level 12 quad is about 1/130000 of the circumference across
+const int TERRAIN_MAX_LEVEL = 12;
+
+// A height map laid out as a cube cross, like the Bump textures of the planets: four faces around the
+// equator with the north pole above the second one and the south pole below it. Sampled by direction,
+// bilinearly within a face, so both sides of a cube edge read the same value for the same direction.
+class CubeHeightMap {
+public:
+    // reads a greyscale (or RGB, the first channel counts) image, 8 or 16 bits
+    bool load(const std::string& path);
+    // the height in [0, 1] in the direction, which doesn't have to be normalized
+    float sample(const glm::vec3& direction) const;
+
+    bool empty() const { return _heights.empty(); }
+    float lowest() const { return _lowest; }
+
+private:
+    int _width = 0;
+    int _height = 0;
+    std::vector<float> _heights;
+    float _lowest = 0.0f;
+};
+
+// Planet terrain on a quadtree over the six faces of a cube pushed out to a sphere and displaced by a
+// height map. Every frame the tree is walked from the faces down, and a chunk is split while its quads
+// would be more than a few pixels across on screen, so the triangle density follows the screen
+// coverage. Chunk meshes are built by jobs, cached and evicted least recently used once they go over
+// the memory budget or gpuMemory() needs the room. A chunk is only split once its four children are resident, so the frame never
+// waits for a mesh. Vertices morph towards the coarser level with their distance, which makes the
+// edges between levels meet, and skirts hang from the chunk edges to hide what a missing level leaves.
+class PlanetTerrain : public GpuCache {
+public:
+    // relief is the height of the highest point of the map over the lowest, relative to the radius
+    PlanetTerrain(const std::string& heightPath, const std::string& colorPath, float relief, size_t memoryBudget);
+    ~PlanetTerrain();
+    PlanetTerrain(const PlanetTerrain&) = delete;
+    PlanetTerrain& operator=(const PlanetTerrain&) = delete;
+
+    bool valid() const { return !_heights.empty(); }
+
+    // places the planet (model is its rotation and translation) and picks the chunks to draw, uploads
+    // the chunks that finished and requests the missing ones, nearest first
+    void update(const glm::mat4& model, float radius, const glm::mat4& projection, const glm::mat4& view,
+        const glm::vec3& cameraPosition, float viewportHeight);
+    // draws the chunks the last update picked, prepare sets the per-frame uniforms (projection, view, light)
+    void draw(const std::function<void(Shader&)>& prepare);
+
+    // the camera's height over the highest point of the planet where update() placed it last
+    float altitude(const glm::vec3& cameraPosition) const;
+    float radius() const { return _radius; }
+
+    size_t residentChunks() const { return _chunks.size(); }
+    size_t residentBytes() const { return _residentBytes; }
+    size_t drawnChunks() const { return _drawList.size(); }
+
+    // the faces are never evicted, there is always something to draw
+    bool oldest(unsigned int& frame) const override;
+    void evictOldest() override;
+
+private:
+    // vertex of a chunk, relative to the chunk's centre on the unit planet
+    struct ChunkVertex {
+        glm::vec3 position;
+        glm::vec3 morph;            // moves the vertex onto the coarser level's surface
+        glm::vec3 normal;
+        glm::vec3 morphNormal;
+    };
+
+    struct ChunkData {
+        uint64_t key = 0;
+        glm::vec3 center;
+        std::vector<ChunkVertex> vertices;
+    };
+
+    struct Chunk {
+        glm::vec3 center;
+        unsigned int VAO = 0;
+        unsigned int VBO = 0;
+        size_t bytes = 0;
+        unsigned int lastFrame = 0;
+        std::list<uint64_t>::iterator recent;
+    };
+
+    // a chunk picked for drawing and where it is relative to the camera
+    struct DrawChunk {
+        const Chunk* chunk;
+        int level;
+        glm::vec3 origin;
+    };
+
+    void generate(uint64_t key, ChunkData& data) const;
+    void request(uint64_t key);
+    void upload(unsigned int maxUploads);
+    void evict();
+    // the least recently drawn chunk below the faces, _recent.rend() if there is none
+    std::list<uint64_t>::const_reverse_iterator leastRecentlyDrawn() const;
+    // the distance under which a chunk of the level splits, in world units
+    float splitDistance(int level) const;
+    void select(uint64_t key, const glm::dvec3& camera, std::vector<std::pair<float, uint64_t>>& wanted);
+
+    CubeHeightMap _heights;
+    float _relief;
+    size_t _memoryBudget;
+    Shader _shader;
+    unsigned int _colorTexture = 0;
+    unsigned int _EBO = 0;
+    unsigned int _indexCount = 0;
+    size_t _staticBytes = 0;            // the colour map and the index buffer
+
+    std::unordered_map<uint64_t, Chunk> _chunks;
+    std::list<uint64_t> _recent;        // resident chunks, most recently used first
+    size_t _residentBytes = 0;
+
+    // the placement and view of the last update(), read while the tree is walked and drawn
+    glm::dmat4 _model = glm::dmat4(1.0);
+    float _radius = 1.0f;
+    glm::dvec3 _cameraPosition;
+    Frustum _frustum;
+    float _splitScale = 1.0f;           // distance under which a chunk splits, per unit of its quad size
+    std::vector<DrawChunk> _drawList;
+
+    // filled by the generating jobs, emptied by upload() on the main thread
+    std::mutex _generatedLock;
+    std::vector<ChunkData> _generated;
+    std::unordered_map<uint64_t, JobHandle> _requested;
+};
+
+#endif
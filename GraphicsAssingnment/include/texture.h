@@ -8,13 +8,47 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 #include <streambuf>
 #include <string>
+#include <vector>
 
 #include "stb/stb_image.h"
 
+// pixels decoded by stb_image, kept on the CPU until they are uploaded on the main thread
+struct TextureImage {
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int nrComponents = 0;
+    unsigned char* data = nullptr;
+    // a streamed texture (see streaming.h): width and height are those of level 0, data stays null and
+    // levels holds the small levels from firstLevel down, read from the mip file at mipPath
+    std::string mipPath;
+    int firstLevel = 0;
+    std::vector<uint64_t> levelOffsets;
+    std::vector<unsigned char> levels;
+    // the GL format of levels when they are block compressed (see compression.h), 0 for raw pixels. A
+    // compressed image that isn't streamed keeps its whole mip chain in levels, data stays null.
+    GLenum compressedFormat = 0;
+};
+
 unsigned int loadTexture(const char* path);
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
+
+// decodes an image file, block compressing its mip chain when compress is set, doesn't touch OpenGL
+// so it can run on any thread
+TextureImage decodeTexture(const std::string& filename, bool compress = false);
+// creates the GL texture for a decoded image and frees its pixels, main thread only
+unsigned int uploadTexture(TextureImage& image);
+// the pixel format of an image with that many channels
+GLenum textureFormat(int nrComponents);
+
+// the width or height of a mip level, never less than 1
+int mipLevelSize(int size, int level);
+// the levels down to 1x1 of tightly packed pixels, box filtered from the one before, level 0 is a copy
+std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char* pixels, int width, int height, int channels);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef TRANSFORMATION_H
+#define TRANSFORMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// A class that will allow us to create a template for the transformations of each planet
+class Transformation {
+    float _radius;
+    float _period;
+    float _phase;
+
+    public:
+    // the phase is the starting angle in radians, so bodies on similar orbits don't line up
+    Transformation(float radius, float period, float phase = 0.0f) {
+        _radius = radius;
+        _period = period;
+        _phase = phase;
+    }
+    float radius() const { return _radius; }
+    float period() const { return _period; }
+    float phase() const { return _phase; }
+
+    glm::mat4 use(glm::mat4 model, float time) {
+        model = glm::rotate(model, time / _period + _phase, glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::translate(model, glm::vec3(_radius, 0.0f, 0.0f));
+        return model;
+    }
+};
+
+#endif
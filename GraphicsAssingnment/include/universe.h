@@ -0,0 +1,123 @@
+#ifndef UNIVERSE_H
+#define UNIVERSE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "gpumemory.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "shader.h"
+
+// Space is split into cubes of this side. A sector is generated from the seed and its coordinates alone,
+// so it looks the same every time it comes back into range.
+const float SECTOR_SIZE = 2000.0f;
+
+struct SectorCoord {
+    int x;
+    int y;
+    int z;
+
+    bool operator==(const SectorCoord& other) const { return x == other.x && y == other.y && z == other.z; }
+    bool operator!=(const SectorCoord& other) const { return !(*this == other); }
+};
+
+struct SectorCoordHash {
+    size_t operator()(const SectorCoord& coord) const;
+};
+
+// the sector a point lies in
+SectorCoord sectorOf(const glm::vec3& position);
+
+// A body of a generated system: its star at the centre, or a planet on a circular orbit around it
+struct SectorBody {
+    float orbitRadius;      // 0 for the star
+    float period;
+    float phase;
+    float radius;
+    float spin;             // period of the rotation around its own axis
+    bool luminous;
+    // RGBA8 pixels while the sector is on the CPU
+    int textureWidth;
+    int textureHeight;
+    std::vector<unsigned char> pixels;
+};
+
+struct SectorSystem {
+    glm::vec3 center;
+    float radius;                   // bounds every orbit and its planet
+    unsigned int firstBody;         // into SectorData::bodies, the star comes first
+    unsigned int bodyCount;
+};
+
+// Everything a sector holds, built by a job and handed to the main thread for the upload
+struct SectorData {
+    SectorCoord coord;
+    std::vector<SectorSystem> systems;
+    std::vector<SectorBody> bodies;
+};
+
+// generates the star systems of a sector, their orbits and their textures. Doesn't touch OpenGL and
+// always gives the same sector for the same seed and coordinates.
+void generateSector(unsigned int seed, const SectorCoord& coord, SectorData& sector);
+
+// A procedural universe streamed around the camera. Every frame the sectors within a few sectors of the
+// camera that aren't in memory are generated by jobs, nearest first, and a few finished ones are uploaded.
+// Sectors stay cached after the camera leaves them and the least recently visited are evicted once the
+// cache exceeds its memory budget, so flying back is free and flying on never grows the memory. The
+// textures are counted in gpuMemory(), which can evict sectors out of range too.
+class Universe : public GpuCache {
+public:
+    Universe(unsigned int seed, size_t memoryBudget);
+    ~Universe();
+    Universe(const Universe&) = delete;
+    Universe& operator=(const Universe&) = delete;
+
+    // uploads the sectors that finished generating and requests the missing ones around the camera
+    void update(const glm::vec3& cameraPosition);
+    void draw(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, float time);
+
+    size_t residentSectors() const { return _sectors.size(); }
+    size_t residentBytes() const { return _residentBytes; }
+
+    bool oldest(unsigned int& frame) const override;
+    void evictOldest() override;
+
+private:
+    struct Sector {
+        SectorData data;                // the pixels are freed once uploaded
+        std::vector<unsigned int> textures;     // one per body
+        size_t bytes = 0;
+        size_t textureBytes = 0;        // the part of bytes in video memory
+        unsigned int lastFrame = 0;
+        std::list<SectorCoord>::iterator recent;
+    };
+
+    void request(const SectorCoord& coord);
+    void upload();
+    void evict();
+
+    unsigned int _seed;
+    size_t _memoryBudget;
+    Shader _starShader;
+    Shader _planetShader;
+    std::unique_ptr<Mesh> _sphere;
+    std::unordered_map<SectorCoord, Sector, SectorCoordHash> _sectors;
+    std::list<SectorCoord> _recent;     // resident sectors, most recently in range first
+    size_t _residentBytes = 0;
+
+    // filled by the generating jobs, emptied by upload() on the main thread
+    std::mutex _generatedLock;
+    std::vector<SectorData> _generated;
+    std::unordered_map<SectorCoord, JobHandle, SectorCoordHash> _requested;
+};
+
+#endif
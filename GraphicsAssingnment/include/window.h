@@ -14,7 +14,43 @@
 #include <string>
 
 
+// The kinds of OpenGL context the program can render with
+enum WindowBackend {
+	BACKEND_WINDOW,		// a visible GLFW window
+	BACKEND_HIDDEN,		// an invisible GLFW window, still needs a display
+	BACKEND_EGL,		// surfaceless EGL context, no display server needed (build with USE_EGL)
+	BACKEND_OSMESA		// OSMesa software context on llvmpipe, no display and no GPU (build with USE_OSMESA)
+};
+
+// The framebuffer object the scene is rendered into when there is no visible window
+struct OffscreenTarget {
+	unsigned int FBO = 0;
+	unsigned int colorBuffer = 0;
+	unsigned int depthBuffer = 0;
+	int width = 0;
+	int height = 0;
+};
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 GLFWwindow* windowInitializations(int width, int height, const char* title);
 
+// creates a context without a visible window and an offscreen target of the given size to render into
+bool headlessInitializations(int width, int height, WindowBackend backend);
+// parses "window", "hidden", "egl" or "osmesa", returns false for anything else
+bool parseWindowBackend(const char* name, WindowBackend& backend);
+// the best headless backend this build supports: EGL, then OSMesa, then a hidden window
+WindowBackend defaultHeadlessBackend();
+
+bool isHeadless();
+const OffscreenTarget& offscreenTarget();
+// binds the framebuffer the scene should be drawn into
+void bindRenderTarget();
+// finishes a frame: swaps the window buffers, or flushes the offscreen context
+void presentFrame(GLFWwindow* window);
+// the function glad loaded OpenGL with, for entry points beyond the generated 3.3 core ones
+GLADloadproc procAddressLoader();
+// seconds since the context was created, works with and without GLFW
+double getTime();
+void windowTerminate();
+
 #endif
@@ -0,0 +1,183 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+template <typename T>
+static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float u)
+{
+    float u2 = u * u;
+    float u3 = u2 * u;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+}
+
+bool CameraPath::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+
+    _keys.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream values(line);
+        Keyframe key;
+        if (values >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.angles.x >> key.angles.y)
+            _keys.push_back(key);
+    }
+    std::sort(_keys.begin(), _keys.end(), [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+
+    if (_keys.empty())
+        std::cout << "ERROR::CAMERA_PATH::NO_KEYFRAMES: " << path << std::endl;
+    return !_keys.empty();
+}
+
+void CameraPath::evaluate(float t, glm::vec3& position, float& yaw, float& pitch) const
+{
+    if (_keys.empty())
+        return;
+
+    size_t last = _keys.size() - 1;
+    if (t <= _keys.front().time || last == 0)
+    {
+        position = _keys.front().position;
+        yaw = _keys.front().angles.x;
+        pitch = _keys.front().angles.y;
+        return;
+    }
+    if (t >= _keys.back().time)
+    {
+        position = _keys.back().position;
+        yaw = _keys.back().angles.x;
+        pitch = _keys.back().angles.y;
+        return;
+    }
+
+    size_t i = 0;
+    while (i + 1 < last && _keys[i + 1].time <= t)
+        i++;
+    const Keyframe& k0 = _keys[i > 0 ? i - 1 : 0];
+    const Keyframe& k1 = _keys[i];
+    const Keyframe& k2 = _keys[i + 1];
+    const Keyframe& k3 = _keys[std::min(i + 2, last)];
+
+    float span = k2.time - k1.time;
+    float u = span > 0.0f ? (t - k1.time) / span : 0.0f;
+    position = catmullRom(k0.position, k1.position, k2.position, k3.position, u);
+    glm::vec2 angles = catmullRom(k0.angles, k1.angles, k2.angles, k3.angles, u);
+    yaw = angles.x;
+    pitch = angles.y;
+}
+
+void Benchmark::beginFrame()
+{
+    _frameStart = std::chrono::steady_clock::now();
+}
+
+void Benchmark::endFrame(const RenderStats& stats)
+{
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - _frameStart).count();
+    // the first frames pay for shader compilation and texture residency, they would skew the tail
+    if (_frames++ < _warmupFrames)
+        return;
+    _samples.push_back({ milliseconds, stats.drawCalls, stats.triangles });
+}
+
+bool Benchmark::summarize(Summary& summary) const
+{
+    if (_samples.empty())
+        return false;
+
+    std::vector<float> times;
+    double total = 0.0, drawCalls = 0.0, triangles = 0.0;
+    for (auto& sample : _samples)
+    {
+        times.push_back(sample.milliseconds);
+        total += sample.milliseconds;
+        drawCalls += sample.drawCalls;
+        triangles += static_cast<double>(sample.triangles);
+    }
+    std::sort(times.begin(), times.end());
+    // nearest-rank percentile
+    auto percentile = [&times](double p) {
+        size_t rank = static_cast<size_t>(p / 100.0 * times.size() + 0.5);
+        return times[std::min(times.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+
+    double count = static_cast<double>(_samples.size());
+    summary.average = total / count;
+    summary.p50 = percentile(50);
+    summary.p95 = percentile(95);
+    summary.p99 = percentile(99);
+    summary.min = times.front();
+    summary.max = times.back();
+    summary.drawCalls = drawCalls / count;
+    summary.triangles = triangles / count;
+    return true;
+}
+
+void Benchmark::report(const std::string& path, unsigned int seed, float fixedStep) const
+{
+    Summary summary;
+    if (!summarize(summary))
+    {
+        std::cout << "Benchmark: no frames measured (" << _frames << " frames, " << _warmupFrames << " warmup)" << std::endl;
+        return;
+    }
+
+    std::printf("Benchmark: %u frames measured (%u warmup), seed %u, step %.4f s\n", static_cast<unsigned int>(_samples.size()), _warmupFrames, seed, fixedStep);
+    std::printf("  frame time  avg %.3f ms  p50 %.3f  p95 %.3f  p99 %.3f  min %.3f  max %.3f\n",
+        summary.average, summary.p50, summary.p95, summary.p99, summary.min, summary.max);
+    std::printf("  draw calls  avg %.1f\n", summary.drawCalls);
+    std::printf("  triangles   avg %.0f\n", summary.triangles);
+
+    if (path.empty())
+        return;
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::BENCHMARK::FILE_NOT_OPENED: " << path << std::endl;
+        return;
+    }
+    std::fprintf(file, "{\n  \"frames\": %u,\n  \"warmup\": %u,\n  \"seed\": %u,\n  \"fixed_step\": %g,\n",
+        static_cast<unsigned int>(_samples.size()), _warmupFrames, seed, fixedStep);
+    std::fprintf(file, "  \"frame_ms\": { \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f },\n",
+        summary.average, summary.p50, summary.p95, summary.p99, summary.min, summary.max);
+    std::fprintf(file, "  \"draw_calls\": %.2f,\n  \"triangles\": %.0f\n}\n", summary.drawCalls, summary.triangles);
+    std::fclose(file);
+}
+
+void Benchmark::appendCurve(const std::string& path, unsigned int bodies, unsigned int models, unsigned int stars) const
+{
+    Summary summary;
+    if (!summarize(summary))
+        return;
+
+    // the header goes in when the file is created
+    std::FILE* existing = std::fopen(path.c_str(), "r");
+    bool created = existing == nullptr;
+    if (existing != nullptr)
+        std::fclose(existing);
+
+    std::FILE* file = std::fopen(path.c_str(), "a");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::BENCHMARK::FILE_NOT_OPENED: " << path << std::endl;
+        return;
+    }
+    if (created)
+        std::fprintf(file, "bodies,models,stars,avg_ms,p50_ms,p95_ms,p99_ms,us_per_body,draw_calls,triangles\n");
+    double perBody = bodies > 0 ? summary.average * 1000.0 / bodies : 0.0;
+    std::fprintf(file, "%u,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.0f\n", bodies, models, stars,
+        summary.average, summary.p50, summary.p95, summary.p99, perBody, summary.drawCalls, summary.triangles);
+    std::fclose(file);
+}
@@ -0,0 +1,431 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+static const unsigned int LEAF_SIZE = 4;        // ranges this small always become leaves
+static const unsigned int MAX_LEAF_SIZE = 16;   // and ranges this big never do
+static const int BINS = 12;
+static const float TRAVERSAL_COST = 1.0f;       // relative to testing one sphere
+
+static const float INFINITE = std::numeric_limits<float>::max();
+
+static void emptyBounds(glm::vec3& min, glm::vec3& max)
+{
+    min = glm::vec3(INFINITE);
+    max = glm::vec3(-INFINITE);
+}
+
+static void growBounds(glm::vec3& min, glm::vec3& max, const glm::vec4& sphere)
+{
+    if (sphere.w < 0.0f)
+        return;
+    min = glm::min(min, glm::vec3(sphere) - sphere.w);
+    max = glm::max(max, glm::vec3(sphere) + sphere.w);
+}
+
+static float surfaceArea(const glm::vec3& min, const glm::vec3& max)
+{
+    if (min.x > max.x)
+        return 0.0f;
+    glm::vec3 size = max - min;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// distance from the point to the box, 0 inside
+static float boxDistance(const BVH::Node& node, const glm::vec3& point)
+{
+    if (node.min.x > node.max.x)
+        return INFINITE;
+    glm::vec3 outside = glm::max(glm::max(node.min - point, point - node.max), glm::vec3(0.0f));
+    return glm::length(outside);
+}
+
+// distance from the point to the surface of the sphere, 0 inside
+static float sphereDistance(const glm::vec4& sphere, const glm::vec3& point)
+{
+    return std::max(0.0f, glm::length(point - glm::vec3(sphere)) - sphere.w);
+}
+
+// distance along the ray to where it enters the box, INFINITE if it misses
+static float boxEntry(const BVH::Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection)
+{
+    glm::vec3 t0 = (node.min - origin) * inverseDirection;
+    glm::vec3 t1 = (node.max - origin) * inverseDirection;
+    glm::vec3 near = glm::min(t0, t1);
+    glm::vec3 far = glm::max(t0, t1);
+    float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), far.z);
+    return entry <= exit ? entry : INFINITE;
+}
+
+void BVH::build(const std::vector<glm::vec4>& spheres)
+{
+    _nodes.clear();
+    _spheres = spheres;
+    _primitives.resize(spheres.size());
+    std::iota(_primitives.begin(), _primitives.end(), 0u);
+    _buildCost = 0.0f;
+    if (spheres.empty())
+        return;
+
+    std::vector<glm::vec3> centroids(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++)
+        centroids[i] = glm::vec3(spheres[i]);
+    _nodes.reserve(2 * spheres.size());
+    buildNode(0, static_cast<unsigned int>(spheres.size()), centroids);
+
+    for (size_t i = 0; i < _primitives.size(); i++)
+        _spheres[i] = spheres[_primitives[i]];
+    _buildCost = cost();
+}
+
+unsigned int BVH::buildNode(unsigned int first, unsigned int count, std::vector<glm::vec3>& centroids)
+{
+    unsigned int index = static_cast<unsigned int>(_nodes.size());
+    _nodes.push_back(Node());
+    glm::vec3 min, max, centroidMin, centroidMax;
+    emptyBounds(min, max);
+    emptyBounds(centroidMin, centroidMax);
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        growBounds(min, max, _spheres[_primitives[i]]);
+        centroidMin = glm::min(centroidMin, centroids[_primitives[i]]);
+        centroidMax = glm::max(centroidMax, centroids[_primitives[i]]);
+    }
+    _nodes[index].min = min;
+    _nodes[index].max = max;
+    _nodes[index].index = first;
+    _nodes[index].count = count;
+    if (count <= LEAF_SIZE)
+        return index;
+
+    // binned SAH: the split between bins with the lowest expected cost, over all three axes
+    float bestCost = INFINITE;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.0f)
+            continue;
+        glm::vec3 binMin[BINS], binMax[BINS];
+        unsigned int binCount[BINS] = {};
+        for (int b = 0; b < BINS; b++)
+            emptyBounds(binMin[b], binMax[b]);
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            int b = std::min(BINS - 1, static_cast<int>((centroids[_primitives[i]][axis] - centroidMin[axis]) / extent * BINS));
+            growBounds(binMin[b], binMax[b], _spheres[_primitives[i]]);
+            binCount[b]++;
+        }
+        // areas and counts to the right of every split, then sweep from the left
+        float rightArea[BINS];
+        unsigned int rightCount[BINS];
+        glm::vec3 sweepMin, sweepMax;
+        emptyBounds(sweepMin, sweepMax);
+        unsigned int sweepCount = 0;
+        for (int b = BINS - 1; b > 0; b--)
+        {
+            sweepMin = glm::min(sweepMin, binMin[b]);
+            sweepMax = glm::max(sweepMax, binMax[b]);
+            sweepCount += binCount[b];
+            rightArea[b] = surfaceArea(sweepMin, sweepMax);
+            rightCount[b] = sweepCount;
+        }
+        emptyBounds(sweepMin, sweepMax);
+        sweepCount = 0;
+        for (int b = 1; b < BINS; b++)
+        {
+            sweepMin = glm::min(sweepMin, binMin[b - 1]);
+            sweepMax = glm::max(sweepMax, binMax[b - 1]);
+            sweepCount += binCount[b - 1];
+            if (sweepCount == 0 || rightCount[b] == 0)
+                continue;
+            float splitCost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b] * rightCount[b];
+            if (splitCost < bestCost)
+            {
+                bestCost = splitCost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    float area = surfaceArea(min, max);
+    bool worthSplitting = bestAxis >= 0 && TRAVERSAL_COST * area + bestCost < area * count;
+    if (!worthSplitting && count <= MAX_LEAF_SIZE)
+        return index;
+
+    unsigned int* begin = _primitives.data() + first;
+    unsigned int* end = begin + count;
+    unsigned int* middle;
+    if (bestAxis >= 0)
+    {
+        float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+        middle = std::partition(begin, end, [&](unsigned int primitive) {
+            int b = std::min(BINS - 1, static_cast<int>((centroids[primitive][bestAxis] - centroidMin[bestAxis]) / extent * BINS));
+            return b < bestSplit;
+        });
+    }
+    else
+    {
+        // every centroid in the same place, split the range in half so the leaves stay small
+        middle = begin + count / 2;
+    }
+    unsigned int leftCount = static_cast<unsigned int>(middle - begin);
+
+    buildNode(first, leftCount, centroids);
+    unsigned int right = buildNode(first + leftCount, count - leftCount, centroids);
+    _nodes[index].index = right;
+    _nodes[index].count = 0;
+    return index;
+}
+
+void BVH::updateBounds(Node& node) const
+{
+    emptyBounds(node.min, node.max);
+    for (unsigned int i = node.index; i < node.index + node.count; i++)
+        growBounds(node.min, node.max, _spheres[i]);
+}
+
+float BVH::refit(const std::vector<glm::vec4>& spheres)
+{
+    for (size_t i = 0; i < _primitives.size(); i++)
+        _spheres[i] = spheres[_primitives[i]];
+
+    // children come after their parent, so walking backwards updates them first
+    for (size_t i = _nodes.size(); i-- > 0;)
+    {
+        Node& node = _nodes[i];
+        if (node.count > 0)
+        {
+            updateBounds(node);
+            continue;
+        }
+        const Node& left = _nodes[i + 1];
+        const Node& right = _nodes[node.index];
+        node.min = glm::min(left.min, right.min);
+        node.max = glm::max(left.max, right.max);
+    }
+    return _buildCost > 0.0f ? cost() / _buildCost : 1.0f;
+}
+
+float BVH::cost() const
+{
+    if (_nodes.empty())
+        return 0.0f;
+    float rootArea = surfaceArea(_nodes[0].min, _nodes[0].max);
+    if (rootArea <= 0.0f)
+        return 0.0f;
+    float total = 0.0f;
+    for (auto& node : _nodes)
+        total += surfaceArea(node.min, node.max) * (node.count > 0 ? node.count : TRAVERSAL_COST);
+    return total / rootArea;
+}
+
+void BVH::cullFrustum(const Frustum& frustum, std::vector<unsigned char>& visible) const
+{
+    visible.assign(_spheres.size(), 0);
+    if (_nodes.empty())
+        return;
+
+    // a node entirely inside the frustum doesn't need any more plane tests below it
+    std::vector<std::pair<unsigned int, bool>> stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, false));
+    while (!stack.empty())
+    {
+        unsigned int index = stack.back().first;
+        bool inside = stack.back().second;
+        stack.pop_back();
+        const Node& node = _nodes[index];
+        if (node.min.x > node.max.x)
+            continue;
+
+        if (!inside)
+        {
+            bool outside = false;
+            inside = true;
+            for (const auto& plane : frustum.planes)
+            {
+                glm::vec3 normal(plane);
+                glm::vec3 farthest(normal.x >= 0.0f ? node.max.x : node.min.x, normal.y >= 0.0f ? node.max.y : node.min.y, normal.z >= 0.0f ? node.max.z : node.min.z);
+                glm::vec3 nearest(normal.x >= 0.0f ? node.min.x : node.max.x, normal.y >= 0.0f ? node.min.y : node.max.y, normal.z >= 0.0f ? node.min.z : node.max.z);
+                if (glm::dot(normal, farthest) + plane.w < 0.0f)
+                {
+                    outside = true;
+                    break;
+                }
+                if (glm::dot(normal, nearest) + plane.w < 0.0f)
+                    inside = false;
+            }
+            if (outside)
+                continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.index; i < node.index + node.count; i++)
+            {
+                const glm::vec4& sphere = _spheres[i];
+                if (sphere.w >= 0.0f && (inside || frustum.intersectsSphere(glm::vec3(sphere), sphere.w)))
+                    visible[_primitives[i]] = 1;
+            }
+            continue;
+        }
+        stack.push_back(std::make_pair(node.index, inside));
+        stack.push_back(std::make_pair(index + 1, inside));
+    }
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, unsigned int& hit, float& distance) const
+{
+    float best = INFINITE;
+    if (_nodes.empty())
+        return false;
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    std::vector<unsigned int> stack;
+    stack.reserve(64);
+    if (boxEntry(_nodes[0], origin, inverseDirection) < best)
+        stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = _nodes[stack.back()];
+        unsigned int index = stack.back();
+        stack.pop_back();
+        if (boxEntry(node, origin, inverseDirection) >= best)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.index; i < node.index + node.count; i++)
+            {
+                const glm::vec4& sphere = _spheres[i];
+                if (sphere.w < 0.0f)
+                    continue;
+                glm::vec3 offset = origin - glm::vec3(sphere);
+                float b = glm::dot(offset, direction);
+                float c = glm::dot(offset, offset) - sphere.w * sphere.w;
+                float t;
+                if (c <= 0.0f)
+                    t = 0.0f;
+                else
+                {
+                    float discriminant = b * b - c;
+                    if (discriminant < 0.0f)
+                        continue;
+                    t = -b - std::sqrt(discriminant);
+                    if (t < 0.0f)
+                        continue;
+                }
+                if (t < best)
+                {
+                    best = t;
+                    hit = _primitives[i];
+                }
+            }
+            continue;
+        }
+        // the nearer child goes on top of the stack, its hits prune the other one
+        unsigned int left = index + 1;
+        unsigned int right = node.index;
+        float leftEntry = boxEntry(_nodes[left], origin, inverseDirection);
+        float rightEntry = boxEntry(_nodes[right], origin, inverseDirection);
+        if (leftEntry > rightEntry)
+        {
+            std::swap(left, right);
+            std::swap(leftEntry, rightEntry);
+        }
+        if (rightEntry < best)
+            stack.push_back(right);
+        if (leftEntry < best)
+            stack.push_back(left);
+    }
+    distance = best;
+    return best < INFINITE;
+}
+
+bool BVH::nearest(const glm::vec3& point, unsigned int& hit, float& distance) const
+{
+    float best = INFINITE;
+    if (_nodes.empty())
+        return false;
+
+    std::vector<unsigned int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        unsigned int index = stack.back();
+        stack.pop_back();
+        const Node& node = _nodes[index];
+        if (boxDistance(node, point) >= best)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.index; i < node.index + node.count; i++)
+            {
+                if (_spheres[i].w < 0.0f)
+                    continue;
+                float d = sphereDistance(_spheres[i], point);
+                if (d < best)
+                {
+                    best = d;
+                    hit = _primitives[i];
+                }
+            }
+            continue;
+        }
+        unsigned int left = index + 1;
+        unsigned int right = node.index;
+        float leftDistance = boxDistance(_nodes[left], point);
+        float rightDistance = boxDistance(_nodes[right], point);
+        if (leftDistance > rightDistance)
+        {
+            std::swap(left, right);
+            std::swap(leftDistance, rightDistance);
+        }
+        if (rightDistance < best)
+            stack.push_back(right);
+        if (leftDistance < best)
+            stack.push_back(left);
+    }
+    distance = best;
+    return best < INFINITE;
+}
+
+void BVH::queryRadius(const glm::vec3& point, float radius, std::vector<unsigned int>& result) const
+{
+    result.clear();
+    if (_nodes.empty())
+        return;
+
+    std::vector<unsigned int> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        unsigned int index = stack.back();
+        stack.pop_back();
+        const Node& node = _nodes[index];
+        if (boxDistance(node, point) > radius)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.index; i < node.index + node.count; i++)
+            {
+                if (_spheres[i].w >= 0.0f && sphereDistance(_spheres[i], point) <= radius)
+                    result.push_back(_primitives[i]);
+            }
+            continue;
+        }
+        stack.push_back(node.index);
+        stack.push_back(index + 1);
+    }
+}
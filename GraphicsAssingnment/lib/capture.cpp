@@ -0,0 +1,278 @@
+#include "capture.h"
+#include "gpumemory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+// frames allowed to wait for the encoders before capture() blocks on the oldest one
+static const size_t MAX_FRAMES_IN_FLIGHT = 8;
+
+FrameCapture::FrameCapture(int width, int height, const std::string& output, CaptureFormat format, unsigned int ringSize)
+    : _width(width), _height(height), _output(output), _format(format), _slots(ringSize)
+{
+    size_t frameSize = static_cast<size_t>(width) * height * 4;
+    for (auto& slot : _slots)
+    {
+        glGenBuffers(1, &slot.PBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    gpuMemory().allocate(GPU_MEMORY_RENDER_TARGETS, _slots.size() * frameSize);
+
+    if (_format == CAPTURE_RAW)
+    {
+        _rawFile = std::fopen(_output.c_str(), "wb");
+        if (_rawFile == nullptr)
+            std::cout << "ERROR::CAPTURE::FILE_NOT_OPENED: " << _output << std::endl;
+        else
+            std::cout << "Capturing raw video, convert with: ffmpeg -f rawvideo -pixel_format rgba -video_size "
+                << _width << "x" << _height << " -i " << _output << " capture.mp4" << std::endl;
+    }
+}
+
+FrameCapture::~FrameCapture()
+{
+    finish();
+    for (auto& slot : _slots)
+        glDeleteBuffers(1, &slot.PBO);
+    gpuMemory().release(GPU_MEMORY_RENDER_TARGETS, _slots.size() * static_cast<size_t>(_width) * _height * 4);
+    if (_rawFile != nullptr)
+        std::fclose(_rawFile);
+}
+
+void FrameCapture::capture()
+{
+    Slot& slot = _slots[_next];
+    _next = (_next + 1) % _slots.size();
+
+    // the slot still holds a frame from a full ring ago, by now the GPU has long finished it
+    if (slot.fence != 0)
+        collect(slot);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = _framesQueued++;
+}
+
+void FrameCapture::finish()
+{
+    // collect the slots oldest first so raw frames stay in order
+    for (size_t i = 0; i < _slots.size(); i++)
+    {
+        Slot& slot = _slots[(_next + i) % _slots.size()];
+        if (slot.fence != 0)
+            collect(slot);
+    }
+    while (!_encoding.empty())
+    {
+        jobSystem().wait(_encoding.front());
+        _encoding.pop_front();
+    }
+    if (_lastWrite)
+        jobSystem().wait(_lastWrite);
+    if (_rawFile != nullptr)
+        std::fflush(_rawFile);
+}
+
+void FrameCapture::collect(Slot& slot)
+{
+    // one second is plenty, a timeout means the context is gone
+    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    size_t frameSize = static_cast<size_t>(_width) * _height * 4;
+    std::vector<unsigned char> pixels(frameSize);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+    if (mapped != NULL)
+    {
+        std::memcpy(pixels.data(), mapped, frameSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (mapped == NULL)
+        return;
+
+    if (_encoding.size() >= MAX_FRAMES_IN_FLIGHT)
+    {
+        jobSystem().wait(_encoding.front());
+        _encoding.pop_front();
+    }
+    while (!_encoding.empty() && _encoding.front()->finished.load())
+        _encoding.pop_front();
+
+    encode(std::move(pixels), slot.frame);
+}
+
+void FrameCapture::encode(std::vector<unsigned char> pixels, unsigned int frame)
+{
+    std::shared_ptr<std::vector<unsigned char>> shared = std::make_shared<std::vector<unsigned char>>(std::move(pixels));
+    int width = _width;
+    int height = _height;
+
+    // OpenGL returns the bottom row first, images are stored top row first
+    JobHandle flip = jobSystem().run([shared, width, height] {
+        size_t rowSize = static_cast<size_t>(width) * 4;
+        std::vector<unsigned char> row(rowSize);
+        unsigned char* data = shared->data();
+        for (int y = 0; y < height / 2; y++)
+        {
+            unsigned char* top = data + y * rowSize;
+            unsigned char* bottom = data + (height - 1 - y) * rowSize;
+            std::memcpy(row.data(), top, rowSize);
+            std::memcpy(top, bottom, rowSize);
+            std::memcpy(bottom, row.data(), rowSize);
+        }
+    });
+
+    if (_format == CAPTURE_PNG)
+    {
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), "_%05u.png", frame);
+        std::string path = _output + suffix;
+        _encoding.push_back(jobSystem().continueWith(flip, [shared, width, height, path] {
+            if (!writePNG(path, width, height, 4, shared->data()))
+                std::cout << "ERROR::CAPTURE::PNG_NOT_WRITTEN: " << path << std::endl;
+        }));
+    }
+    else
+    {
+        std::vector<JobHandle> dependencies = { flip };
+        if (_lastWrite)
+            dependencies.push_back(_lastWrite);
+        std::FILE* file = _rawFile;
+        _lastWrite = jobSystem().continueWith(dependencies, [shared, file] {
+            if (file != nullptr)
+                std::fwrite(shared->data(), 1, shared->size(), file);
+        });
+        _encoding.push_back(_lastWrite);
+    }
+}
+
+// PNG encoding
+// ------------
+static uint32_t crcTable[256];
+
+static void makeCrcTable()
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t length)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t value)
+{
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static void writeChunk(std::FILE* file, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> header;
+    putBigEndian(header, static_cast<uint32_t>(data.size()));
+    header.insert(header.end(), type, type + 4);
+    std::fwrite(header.data(), 1, header.size(), file);
+    if (!data.empty())
+        std::fwrite(data.data(), 1, data.size(), file);
+
+    uint32_t crc = crc32(0, reinterpret_cast<const unsigned char*>(type), 4);
+    crc = crc32(crc, data.data(), data.size());
+    std::vector<unsigned char> footer;
+    putBigEndian(footer, crc);
+    std::fwrite(footer.data(), 1, footer.size(), file);
+}
+
+bool writePNG(const std::string& path, int width, int height, int channels, const unsigned char* pixels)
+{
+    static bool tableReady = (makeCrcTable(), true);
+    (void)tableReady;
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, static_cast<uint32_t>(width));
+    putBigEndian(header, static_cast<uint32_t>(height));
+    header.push_back(8);                        // bit depth
+    header.push_back(channels == 4 ? 6 : 2);    // colour type: RGBA or RGB
+    header.push_back(0);                        // deflate
+    header.push_back(0);                        // adaptive filtering
+    header.push_back(0);                        // no interlacing
+    writeChunk(file, "IHDR", header);
+
+    // the image data is a zlib stream of stored (uncompressed) deflate blocks, every row starts with
+    // filter type 0. Compressing would cost far more than the capture is allowed to.
+    size_t rowSize = static_cast<size_t>(width) * channels;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + y * rowSize, pixels + (y + 1) * rowSize);
+    }
+
+    std::vector<unsigned char> idat;
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min<size_t>(65535, raw.size() - offset);
+        bool last = offset + blockSize == raw.size();
+        idat.push_back(last ? 1 : 0);
+        idat.push_back(static_cast<unsigned char>(blockSize));
+        idat.push_back(static_cast<unsigned char>(blockSize >> 8));
+        idat.push_back(static_cast<unsigned char>(~blockSize));
+        idat.push_back(static_cast<unsigned char>(~blockSize >> 8));
+        idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    // adler32, 5552 bytes is the longest run that can't overflow before the modulo
+    uint32_t a = 1, b = 0;
+    for (size_t start = 0; start < raw.size(); start += 5552)
+    {
+        size_t end = std::min(raw.size(), start + 5552);
+        for (size_t i = start; i < end; i++)
+        {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    putBigEndian(idat, (b << 16) | a);
+    writeChunk(file, "IDAT", idat);
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+
+    bool written = std::ferror(file) == 0;
+    std::fclose(file);
+    return written;
+}
@@ -0,0 +1,311 @@
+#include "catalog.h"
+#include "gpumemory.h"
+#include "stats.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the fields of a CSV line, quoted fields may contain commas
+static void splitCsv(const std::string& line, std::vector<std::string>& fields)
+{
+    fields.clear();
+    std::string field;
+    bool quoted = false;
+    for (char c : line)
+    {
+        if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+        {
+            fields.push_back(field);
+            field.clear();
+        }
+        else if (c != '\r')
+            field.push_back(c);
+    }
+    fields.push_back(field);
+}
+
+static bool parseNumber(const std::string& field, double& value)
+{
+    if (field.empty())
+        return false;
+    char* end = nullptr;
+    value = std::strtod(field.c_str(), &end);
+    return end != field.c_str();
+}
+
+static int16_t quantize(double value, double scale)
+{
+    return static_cast<int16_t>(std::max(-32767.0, std::min(32767.0, std::round(value * scale))));
+}
+
+// octahedral mapping of a unit vector to [-1, 1]^2, the inverse of StarCatalog::direction()
+static void encodeDirection(const glm::vec3& direction, int16_t encoded[2])
+{
+    glm::vec3 d = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+    glm::vec2 p(d.x, d.y);
+    if (d.z < 0.0f)
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    encoded[0] = quantize(p.x, 32767.0);
+    encoded[1] = quantize(p.y, 32767.0);
+}
+
+bool importStarCatalog(const std::string& csvPath, const std::string& outputPath)
+{
+    PROFILE_SCOPE("importStarCatalog");
+    std::ifstream csv(csvPath);
+    if (!csv)
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_NOT_SUCCESSFULLY_READ: " << csvPath << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::vector<std::string> fields;
+    std::getline(csv, line);
+    splitCsv(line, fields);
+    int ra = -1, dec = -1, mag = -1, ci = -1, dist = -1;
+    for (int i = 0; i < static_cast<int>(fields.size()); i++)
+    {
+        if (fields[i] == "ra") ra = i;
+        else if (fields[i] == "dec") dec = i;
+        else if (fields[i] == "mag") mag = i;
+        else if (fields[i] == "ci") ci = i;
+        else if (fields[i] == "dist") dist = i;
+    }
+    if (ra < 0 || dec < 0 || mag < 0)
+    {
+        std::cout << "ERROR::STAR_CATALOG::MISSING_COLUMN: " << csvPath << " needs ra, dec and mag columns" << std::endl;
+        return false;
+    }
+    int lastColumn = std::max(std::max(ra, dec), std::max(mag, std::max(ci, dist)));
+
+    std::vector<PackedStar> stars;
+    size_t skipped = 0;
+    const double DEGREES = 3.14159265358979323846 / 180.0;
+    while (std::getline(csv, line))
+    {
+        splitCsv(line, fields);
+        double rightAscension, declination, magnitude, color = 0.65, distance = 1.0;
+        if (static_cast<int>(fields.size()) <= lastColumn || !parseNumber(fields[ra], rightAscension) ||
+            !parseNumber(fields[dec], declination) || !parseNumber(fields[mag], magnitude))
+        {
+            skipped++;
+            continue;
+        }
+        // the Sun is the one star at distance 0
+        if (dist >= 0 && parseNumber(fields[dist], distance) && distance <= 0.0)
+            continue;
+        // stars without a measured colour get the Sun's
+        if (ci >= 0)
+            parseNumber(fields[ci], color);
+
+        double alpha = rightAscension * 15.0 * DEGREES;
+        double delta = declination * DEGREES;
+        glm::vec3 direction(static_cast<float>(std::cos(delta) * std::cos(alpha)), static_cast<float>(std::sin(delta)),
+            static_cast<float>(-std::cos(delta) * std::sin(alpha)));
+        PackedStar star;
+        encodeDirection(direction, star.direction);
+        star.magnitude = quantize(magnitude, 1000.0);
+        star.colorIndex = quantize(color, 1000.0);
+        stars.push_back(star);
+    }
+    std::stable_sort(stars.begin(), stars.end(), [](const PackedStar& a, const PackedStar& b) { return a.magnitude < b.magnitude; });
+
+    std::FILE* file = std::fopen(outputPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_NOT_OPENED: " << outputPath << std::endl;
+        return false;
+    }
+    StarCatalogHeader header = { { 'S', 'T', 'A', 'R' }, STAR_CATALOG_VERSION, static_cast<uint32_t>(stars.size()), 0 };
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(stars.data(), sizeof(PackedStar), stars.size(), file) == stars.size();
+    std::fclose(file);
+    if (!written)
+    {
+        std::cout << "ERROR::STAR_CATALOG::WRITE_FAILED: " << outputPath << std::endl;
+        return false;
+    }
+    std::printf("Star catalog %s: %u stars written to %s, %u rows skipped\n", csvPath.c_str(),
+        static_cast<unsigned int>(stars.size()), outputPath.c_str(), static_cast<unsigned int>(skipped));
+    return true;
+}
+
+StarCatalog::~StarCatalog()
+{
+    close();
+}
+
+bool StarCatalog::open(const std::string& path)
+{
+    close();
+    // the mapping keeps the file alive, the handles can go right away
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    if (mapping != NULL)
+    {
+        _mapping = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    _bytes = static_cast<size_t>(size.QuadPart);
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        _bytes = static_cast<size_t>(status.st_size);
+        _mapping = mmap(nullptr, _bytes, PROT_READ, MAP_PRIVATE, file, 0);
+        if (_mapping == MAP_FAILED)
+            _mapping = nullptr;
+    }
+    ::close(file);
+#endif
+    if (_mapping == nullptr)
+    {
+        std::cout << "ERROR::STAR_CATALOG::MAPPING_FAILED: " << path << std::endl;
+        _bytes = 0;
+        return false;
+    }
+
+    StarCatalogHeader header;
+    if (_bytes >= sizeof(header))
+        std::memcpy(&header, _mapping, sizeof(header));
+    if (_bytes < sizeof(header) || std::memcmp(header.magic, "STAR", 4) != 0 || header.version != STAR_CATALOG_VERSION ||
+        _bytes < sizeof(header) + static_cast<size_t>(header.count) * sizeof(PackedStar))
+    {
+        std::cout << "ERROR::STAR_CATALOG::INVALID_FILE: " << path << std::endl;
+        close();
+        return false;
+    }
+    _stars = reinterpret_cast<const PackedStar*>(static_cast<const char*>(_mapping) + sizeof(header));
+    _count = header.count;
+    std::printf("Star catalog %s: %u stars\n", path.c_str(), header.count);
+    return true;
+}
+
+void StarCatalog::close()
+{
+    if (_mapping != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(_mapping);
+#else
+        munmap(_mapping, _bytes);
+#endif
+    }
+    _mapping = nullptr;
+    _bytes = 0;
+    _stars = nullptr;
+    _count = 0;
+}
+
+size_t StarCatalog::countBrighterThan(float magnitude) const
+{
+    int16_t limit = quantize(magnitude, 1000.0);
+    const PackedStar* end = std::upper_bound(_stars, _stars + _count, limit,
+        [](int16_t value, const PackedStar& star) { return value < star.magnitude; });
+    return static_cast<size_t>(end - _stars);
+}
+
+glm::vec3 StarCatalog::direction(const PackedStar& star)
+{
+    glm::vec2 p(star.direction[0] / 32767.0f, star.direction[1] / 32767.0f);
+    glm::vec3 d(p, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if (d.z < 0.0f)
+    {
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(d.y, d.x))) * glm::vec2(d.x >= 0.0f ? 1.0f : -1.0f, d.y >= 0.0f ? 1.0f : -1.0f);
+        d.x = folded.x;
+        d.y = folded.y;
+    }
+    return glm::normalize(d);
+}
+
+StarCatalogRenderer::StarCatalogRenderer()
+    : _shader("./assets/shaders/vertex_catalog.glsl", "./assets/shaders/fragment_catalog.glsl")
+{
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_VBO);
+}
+
+StarCatalogRenderer::~StarCatalogRenderer()
+{
+    glDeleteBuffers(1, &_VBO);
+    glDeleteVertexArrays(1, &_VAO);
+    gpuMemory().release(GPU_MEMORY_BUFFERS, _count * sizeof(PackedStar));
+}
+
+void StarCatalogRenderer::upload(const StarCatalog& catalog)
+{
+    // straight from the mapped file, the packed stars are the vertex format
+    gpuMemory().release(GPU_MEMORY_BUFFERS, _count * sizeof(PackedStar));
+    _count = catalog.size();
+    gpuMemory().allocate(GPU_MEMORY_BUFFERS, _count * sizeof(PackedStar));
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+    glBufferData(GL_ARRAY_BUFFER, _count * sizeof(PackedStar), catalog.stars(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_TRUE, sizeof(PackedStar), (void*)offsetof(PackedStar, direction));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(PackedStar), (void*)offsetof(PackedStar, magnitude));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+}
+
+void StarCatalogRenderer::draw(const glm::mat4& projection, const glm::mat4& view, size_t count)
+{
+    count = std::min(count, _count);
+    if (count == 0)
+        return;
+
+    // the points are at the far plane and add up, so they go over the background without sorting
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    _shader.use();
+    _shader.setMat4("projection", projection);
+    _shader.setMat4("view", view);
+    glBindVertexArray(_VAO);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    renderStats().addDraw(0);
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
@@ -0,0 +1,256 @@
+#include "compression.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPRESSION_SSE2
+#endif
+
+// rows of blocks a job encodes
+static const size_t ROWS_PER_JOB = 8;
+
+// the index of each step from the first endpoint to the second, BC1 puts the endpoints at 0 and 1 and
+// the two steps between them at 2 and 3, BC4 the endpoints at 0 and 1 and six steps at 2 to 7
+static const unsigned int COLOR_INDEX[4] = { 1, 3, 2, 0 };
+static const unsigned int CHANNEL_INDEX[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+GLenum compressedFormat(int channels)
+{
+    if (channels == 1)
+        return GL_COMPRESSED_RED_RGTC1;
+    else if (channels == 2)
+        return GL_COMPRESSED_RG_RGTC2;
+    else if (channels == 3)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+static size_t blockBytes(int channels)
+{
+    return channels == 1 || channels == 3 ? 8 : 16;
+}
+
+size_t compressedSize(int width, int height, int channels)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(channels);
+}
+
+// the smallest and largest value of every channel over the 16 RGBA texels of a block
+static void blockRange(const unsigned char* texels, unsigned char low[4], unsigned char high[4])
+{
+#ifdef COMPRESSION_SSE2
+    __m128i minimum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels));
+    __m128i maximum = minimum;
+    for (int i = 1; i < 4; i++)
+    {
+        __m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 16 * i));
+        minimum = _mm_min_epu8(minimum, row);
+        maximum = _mm_max_epu8(maximum, row);
+    }
+    minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 8));
+    maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 8));
+    minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+    maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+    int lowBytes = _mm_cvtsi128_si32(minimum), highBytes = _mm_cvtsi128_si32(maximum);
+    std::memcpy(low, &lowBytes, 4);
+    std::memcpy(high, &highBytes, 4);
+#else
+    for (int c = 0; c < 4; c++)
+    {
+        low[c] = 255;
+        high[c] = 0;
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            low[c] = std::min(low[c], texels[4 * i + c]);
+            high[c] = std::max(high[c], texels[4 * i + c]);
+        }
+    }
+#endif
+}
+
+// the step of every texel between two endpoints: the texel's distance along weights past offset,
+// times scale, rounded and clamped to the steps there are
+static void quantize(const unsigned char* texels, const float weights[4], float offset, float scale, int steps, int indices[16])
+{
+#ifdef COMPRESSION_SSE2
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i last = _mm_set1_epi32(steps - 1);
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 16 * i));
+        __m128 distance = _mm_set1_ps(-offset);
+        for (int c = 0; c < 4; c++)
+        {
+            if (weights[c] == 0.0f)
+                continue;
+            __m128 channel = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(row, 8 * c), mask));
+            distance = _mm_add_ps(distance, _mm_mul_ps(channel, _mm_set1_ps(weights[c])));
+        }
+        __m128i step = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(distance, _mm_set1_ps(scale)), half));
+        // SSE2 has no 32 bit min and max, the steps fit in 16 bits
+        step = _mm_packs_epi32(step, step);
+        step = _mm_max_epi16(_mm_min_epi16(step, _mm_packs_epi32(last, last)), _mm_setzero_si128());
+        step = _mm_unpacklo_epi16(step, _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + 4 * i), step);
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        float distance = -offset;
+        for (int c = 0; c < 4; c++)
+        {
+            if (weights[c] != 0.0f)
+                distance += texels[4 * i + c] * weights[c];
+        }
+        int step = static_cast<int>(distance * scale + 0.5f);
+        indices[i] = std::max(0, std::min(step, steps - 1));
+    }
+#endif
+}
+
+static void writeBits(unsigned char* block, uint64_t bits, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        block[i] = static_cast<unsigned char>(bits >> (8 * i));
+}
+
+static unsigned int pack565(const unsigned char color[4])
+{
+    return ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3);
+}
+
+// the colour the GPU decodes a 5:6:5 endpoint to
+static void unpack565(unsigned int packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// BC1: two 5:6:5 endpoints and a 2 bit index a texel into the four colours on the line between them
+static void encodeColor(const unsigned char* texels, const unsigned char low[4], const unsigned char high[4], unsigned char* block)
+{
+    // pulling the box in by a sixteenth of its size puts the steps closer to the bulk of the texels
+    unsigned char inner[2][4];
+    for (int c = 0; c < 3; c++)
+    {
+        int inset = (high[c] - low[c]) >> 4;
+        inner[0][c] = static_cast<unsigned char>(high[c] - inset);
+        inner[1][c] = static_cast<unsigned char>(low[c] + inset);
+    }
+    unsigned int color0 = pack565(inner[0]), color1 = pack565(inner[1]);
+    uint64_t bits = 0;
+    // the first endpoint has to be the larger one for four colours, equal endpoints take index 0 throughout
+    if (color0 != color1)
+    {
+        int end0[3], end1[3];
+        unpack565(color0, end0);
+        unpack565(color1, end1);
+        float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float offset = 0.0f, length = 0.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            float d = static_cast<float>(end0[c] - end1[c]);
+            weights[c] = d;
+            offset += end1[c] * d;
+            length += d * d;
+        }
+        int steps[16];
+        quantize(texels, weights, offset, 3.0f / length, 4, steps);
+        for (int i = 0; i < 16; i++)
+            bits |= static_cast<uint64_t>(COLOR_INDEX[steps[i]]) << (2 * i);
+    }
+    writeBits(block, color0 | (color1 << 16) | (bits << 32), 8);
+}
+
+// BC4: two 8 bit endpoints and a 3 bit index a texel into the eight values between them, the alpha of BC3
+static void encodeChannel(const unsigned char* texels, int channel, unsigned char low, unsigned char high, unsigned char* block)
+{
+    int inset = (high - low) >> 5;
+    high = static_cast<unsigned char>(high - inset);
+    low = static_cast<unsigned char>(low + inset);
+    uint64_t bits = 0;
+    if (high != low)
+    {
+        float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        weights[channel] = 1.0f;
+        int steps[16];
+        quantize(texels, weights, low, 7.0f / (high - low), 8, steps);
+        for (int i = 0; i < 16; i++)
+            bits |= static_cast<uint64_t>(CHANNEL_INDEX[steps[i]]) << (3 * i);
+    }
+    writeBits(block, high | (low << 8) | (bits << 16), 8);
+}
+
+static void encodeBlock(const unsigned char* texels, int channels, unsigned char* block)
+{
+    unsigned char low[4], high[4];
+    blockRange(texels, low, high);
+    if (channels == 1)
+        encodeChannel(texels, 0, low[0], high[0], block);
+    else if (channels == 2)
+    {
+        encodeChannel(texels, 0, low[0], high[0], block);
+        encodeChannel(texels, 1, low[1], high[1], block + 8);
+    }
+    else if (channels == 3)
+        encodeColor(texels, low, high, block);
+    else
+    {
+        encodeChannel(texels, 3, low[3], high[3], block);
+        encodeColor(texels, low, high, block + 8);
+    }
+}
+
+void compressImage(const unsigned char* pixels, int width, int height, int channels, unsigned char* blocks)
+{
+    size_t blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    size_t bytes = blockBytes(channels);
+    jobSystem().parallelFor(0, blocksHigh, ROWS_PER_JOB, [&](size_t begin, size_t end) {
+        // every block is gathered into 16 RGBA texels, the last row and column repeat past the edges
+        unsigned char texels[64];
+        for (size_t row = begin; row < end; row++)
+        {
+            for (size_t column = 0; column < blocksWide; column++)
+            {
+                for (int y = 0; y < 4; y++)
+                {
+                    int sourceY = std::min(static_cast<int>(row) * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sourceX = std::min(static_cast<int>(column) * 4 + x, width - 1);
+                        const unsigned char* source = pixels + (static_cast<size_t>(sourceY) * width + sourceX) * channels;
+                        unsigned char* texel = texels + 4 * (4 * y + x);
+                        texel[0] = source[0];
+                        texel[1] = channels > 1 ? source[1] : 0;
+                        texel[2] = channels > 2 ? source[2] : 0;
+                        texel[3] = channels > 3 ? source[3] : 255;
+                    }
+                }
+                encodeBlock(texels, channels, blocks + (row * blocksWide + column) * bytes);
+            }
+        }
+    });
+}
+
+bool textureCompressionSupported()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name != nullptr && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            return true;
+    }
+    return false;
+}
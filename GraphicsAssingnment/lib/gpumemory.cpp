@@ -0,0 +1,86 @@
+#include "gpumemory.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static const char* CATEGORY_NAMES[GPU_MEMORY_CATEGORIES] = {
+    "meshes", "textures", "terrain", "point cloud", "universe", "buffers", "render targets"
+};
+
+const char* gpuMemoryCategoryName(GpuMemoryCategory category)
+{
+    return CATEGORY_NAMES[category];
+}
+
+size_t textureBytes(int width, int height, int channels, bool mipmapped)
+{
+    size_t bytes = static_cast<size_t>(width) * height * (channels == 3 ? 4 : channels);
+    return mipmapped ? bytes * 4 / 3 : bytes;
+}
+
+void GpuMemory::allocate(GpuMemoryCategory category, size_t bytes)
+{
+    Category& counted = _categories[category];
+    counted.used += bytes;
+    counted.peak = std::max(counted.peak, counted.used);
+    _used += bytes;
+}
+
+void GpuMemory::release(GpuMemoryCategory category, size_t bytes)
+{
+    _categories[category].used -= bytes;
+    _used -= bytes;
+}
+
+void GpuMemory::addCache(GpuCache* cache)
+{
+    _caches.push_back(cache);
+}
+
+void GpuMemory::removeCache(GpuCache* cache)
+{
+    _caches.erase(std::remove(_caches.begin(), _caches.end(), cache), _caches.end());
+}
+
+bool GpuMemory::makeRoom(size_t bytes)
+{
+    if (_budget == 0)
+        return true;
+    while (_used + bytes > _budget)
+    {
+        // the cache holding the least recently drawn resource gives it up
+        GpuCache* victim = nullptr;
+        unsigned int victimFrame = 0;
+        for (GpuCache* cache : _caches)
+        {
+            unsigned int frame;
+            if (cache->oldest(frame) && frame < _frame && (victim == nullptr || frame < victimFrame))
+            {
+                victim = cache;
+                victimFrame = frame;
+            }
+        }
+        if (victim == nullptr)
+            return false;
+        victim->evictOldest();
+        _evictions++;
+    }
+    return true;
+}
+
+void GpuMemory::print() const
+{
+    const double MB = 1024.0 * 1024.0;
+    if (_budget != 0)
+        std::printf("GPU memory: %.1f MB of %.1f MB, %zu evictions\n", _used / MB, _budget / MB, _evictions);
+    else
+        std::printf("GPU memory: %.1f MB\n", _used / MB);
+    for (int category = 0; category < GPU_MEMORY_CATEGORIES; category++)
+        std::printf("  %-15s %8.1f MB  peak %8.1f MB\n", CATEGORY_NAMES[category], _categories[category].used / MB, _categories[category].peak / MB);
+}
+
+GpuMemory& gpuMemory()
+{
+    static GpuMemory memory;
+    return memory;
+}
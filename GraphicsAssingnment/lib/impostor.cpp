@@ -0,0 +1,172 @@
+#include "impostor.h"
+#include "gpumemory.h"
+#include "profiler.h"
+#include "stats.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+
+// the corners of the quad, expanded around the sphere by the vertex shader
+static const float QUAD_CORNERS[] = {
+    -1.0f, -1.0f, 0.0f,
+     1.0f, -1.0f, 0.0f,
+    -1.0f,  1.0f, 0.0f,
+     1.0f,  1.0f, 0.0f
+};
+
+ImpostorRenderer::ImpostorRenderer(const ModelLibrary& models, unsigned int faceSize)
+    : _shader("./assets/shaders/vertex_impostor.glsl", "./assets/shaders/fragment_impostor.glsl")
+{
+    PROFILE_SCOPE("ImpostorRenderer::bake");
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_VBO);
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_CORNERS), QUAD_CORNERS, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glBindVertexArray(0);
+
+    // the luminous shader draws the texture without lighting, which is what goes into the cubemap, the
+    // models with a material (see material.h) are coloured from its layers
+    Shader bakeShader("./assets/shaders/vertex_luminous.glsl", "./assets/shaders/fragment_luminous.glsl");
+    Shader layeredBakeShader("./assets/shaders/vertex_luminous.glsl", "./assets/shaders/fragment_luminous_layered.glsl");
+    _spheres.resize(models.size());
+    size_t baked = 0;
+    for (ModelHandle handle = 0; handle < models.size(); handle++)
+    {
+        const Model& model = models.get(handle);
+        if (model.boundingRadius > 0.0f && model.occluderRadius >= IMPOSTOR_ROUNDNESS * model.boundingRadius)
+        {
+            bool layered = !model.meshes[0].textures.empty() && model.meshes[0].textures[0].layer >= 0;
+            bake(model, _spheres[handle], faceSize, layered ? layeredBakeShader : bakeShader);
+            baked++;
+        }
+    }
+    std::cout << "Impostors: " << baked << " of " << models.size() << " models are round enough" << std::endl;
+}
+
+ImpostorRenderer::~ImpostorRenderer()
+{
+    for (auto& sphere : _spheres)
+        glDeleteTextures(1, &sphere.texture);
+    glDeleteBuffers(1, &_VBO);
+    glDeleteVertexArrays(1, &_VAO);
+    gpuMemory().release(GPU_MEMORY_TEXTURES, _textureBytes);
+}
+
+void ImpostorRenderer::bake(const Model& model, Sphere& sphere, unsigned int faceSize, Shader& bakeShader)
+{
+    // the faces are drawn from the model's origin with the usual cubemap orientations, so the texture
+    // is looked up with the direction from the centre in model space
+    static const glm::vec3 FACE_DIRECTIONS[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    static const glm::vec3 FACE_UPS[6] = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+    GLint previousFramebuffer;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glGenTextures(1, &sphere.texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, sphere.texture);
+    for (unsigned int face = 0; face < 6; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, faceSize, faceSize, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    unsigned int framebuffer, depth;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &depth);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, faceSize, faceSize);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glViewport(0, 0, faceSize, faceSize);
+
+    // from the inside the nearest surface in every direction is the shell, whichever way its triangles face
+    GLboolean culling = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.001f * model.boundingRadius, 2.0f * model.boundingRadius);
+    bakeShader.use();
+    bakeShader.setMat4("projection", projection);
+    bakeShader.setMat4("model", glm::mat4(1.0f));
+    for (unsigned int face = 0; face < 6; face++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, sphere.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::IMPOSTOR::FRAMEBUFFER_INCOMPLETE" << std::endl;
+            glDeleteTextures(1, &sphere.texture);
+            sphere.texture = 0;
+            break;
+        }
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bakeShader.setMat4("view", glm::lookAt(glm::vec3(0.0f), FACE_DIRECTIONS[face], FACE_UPS[face]));
+        model.Draw(bakeShader);
+    }
+    if (culling)
+        glEnable(GL_CULL_FACE);
+
+    if (sphere.texture != 0)
+    {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, sphere.texture);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        sphere.radius = model.boundingRadius;
+        _textureBytes += 6 * textureBytes(faceSize, faceSize, 3, true);
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, 6 * textureBytes(faceSize, faceSize, 3, true));
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+void ImpostorRenderer::add(ModelHandle model, const glm::mat4& world)
+{
+    _spheres[model].instances.push_back(world);
+    _queued++;
+}
+
+void ImpostorRenderer::bind(ModelHandle model)
+{
+    _shader.setFloat("sphereRadius", _spheres[model].radius);
+    _shader.setInt("sphereMap", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _spheres[model].texture);
+}
+
+void ImpostorRenderer::draw(const std::function<void(Shader&)>& prepare)
+{
+    if (_queued == 0)
+        return;
+    _matrices.clear();
+    for (auto& sphere : _spheres)
+        _matrices.insert(_matrices.end(), sphere.instances.begin(), sphere.instances.end());
+    _instanceBuffer.upload(_matrices);
+
+    _shader.use();
+    prepare(_shader);
+    glBindVertexArray(_VAO);
+    size_t first = 0;
+    for (ModelHandle handle = 0; handle < _spheres.size(); handle++)
+    {
+        Sphere& sphere = _spheres[handle];
+        if (sphere.instances.empty())
+            continue;
+        bind(handle);
+        _instanceBuffer.bind(first);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(sphere.instances.size()));
+        renderStats().addDraw(2 * sphere.instances.size());
+        first += sphere.instances.size();
+        sphere.instances.clear();
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    _queued = 0;
+}
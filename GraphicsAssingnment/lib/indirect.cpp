@@ -0,0 +1,325 @@
+#include "indirect.h"
+#include "gpumemory.h"
+#include "culling.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+// objects whose on-screen radius is below this many pixels are dropped
+static const float MINIMUM_RADIUS = 0.25f;
+static const unsigned int WORK_GROUP_SIZE = 64;
+// the batch of an object without an impostor, and the shader key of the impostor batches
+static const GLuint NO_BATCH = 0xFFFFFFFFu;
+static const unsigned int IMPOSTOR_SHADER = 0xFFFFFFFFu;
+
+// mirrors ObjectRecord in compute_cull.glsl (std430)
+struct ObjectRecord {
+    glm::vec4 scale;
+    GLuint firstMotion;
+    GLuint motionCount;
+    GLuint batch;
+    GLuint impostorBatch;       // NO_BATCH for models that aren't round
+};
+
+// where a mesh sits in the shared buffers
+struct MeshRange {
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint indexCount;
+};
+
+static unsigned int createStorage(const void* data, size_t size, GLenum usage)
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(size, 4), data, usage);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return buffer;
+}
+
+static bool textureOrder(const Mesh& a, const Mesh& b)
+{
+    return std::lexicographical_compare(a.textures.begin(), a.textures.end(), b.textures.begin(), b.textures.end(),
+        [](const Texture& x, const Texture& y) { return x.id < y.id || (x.id == y.id && x.layer < y.layer); });
+}
+
+static bool sameTextures(const Mesh& a, const Mesh& b)
+{
+    return !textureOrder(a, b) && !textureOrder(b, a);
+}
+
+IndirectRenderer::IndirectRenderer()
+    : _cullShader("./assets/shaders/compute_cull.glsl"),
+      _commandShader("./assets/shaders/compute_commands.glsl")
+{
+}
+
+IndirectRenderer::~IndirectRenderer()
+{
+    unsigned int buffers[] = { _VBO, _EBO, _objectBuffer, _motionBuffer, _batchCountBuffer, _batchFirstBuffer, _commandBuffer, _commandBatchBuffer };
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    glDeleteVertexArrays(1, &_VAO);
+    glDeleteTextures(1, &_depthPyramid);
+    gpuMemory().release(GPU_MEMORY_MESHES, _meshBytes);
+    gpuMemory().release(GPU_MEMORY_BUFFERS, _bufferBytes);
+    gpuMemory().release(GPU_MEMORY_RENDER_TARGETS, _pyramidBytes);
+}
+
+void IndirectRenderer::build(const ModelLibrary& models, const std::vector<IndirectObject>& objects, const std::vector<Transformation>& motions,
+                             ImpostorRenderer* impostors, float impostorRadius)
+{
+    PROFILE_SCOPE("IndirectRenderer::build");
+    // every mesh of every model goes into the shared buffers
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<std::vector<MeshRange>> ranges(models.size());
+    for (ModelHandle handle = 0; handle < models.size(); handle++)
+    {
+        for (auto& mesh : models.get(handle).meshes)
+        {
+            ranges[handle].push_back({ static_cast<GLuint>(indices.size()), static_cast<GLint>(vertices.size()), static_cast<GLuint>(mesh.indices.size()) });
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+    }
+    // the impostor quad, two triangles over the corners the impostor vertex shader expands
+    MeshRange quad = { static_cast<GLuint>(indices.size()), static_cast<GLint>(vertices.size()), 6 };
+    for (int corner = 0; corner < 4; corner++)
+    {
+        Vertex vertex = {};
+        vertex.Position = glm::vec3(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, 0.0f);
+        vertices.push_back(vertex);
+    }
+    const unsigned int quadIndices[] = { 0, 1, 2, 2, 1, 3 };
+    indices.insert(indices.end(), quadIndices, quadIndices + 6);
+    _impostors = impostors;
+    _impostorRadius = impostorRadius;
+
+    // a batch is every object with the same shader and model, their instances are stored together. The
+    // impostors of a model are a batch of their own, and an object has room in both of its batches.
+    std::map<std::pair<unsigned int, ModelHandle>, GLuint> batchIndex;
+    std::vector<std::pair<unsigned int, ModelHandle>> batches;
+    std::vector<GLuint> batchFirsts;
+    auto findBatch = [&](unsigned int shader, ModelHandle model) {
+        auto key = std::make_pair(shader, model);
+        auto found = batchIndex.find(key);
+        if (found == batchIndex.end())
+        {
+            found = batchIndex.insert(std::make_pair(key, static_cast<GLuint>(batches.size()))).first;
+            batches.push_back(key);
+            batchFirsts.push_back(0);
+        }
+        batchFirsts[found->second]++;
+        return found->second;
+    };
+    std::vector<ObjectRecord> records;
+    records.reserve(objects.size());
+    for (auto& object : objects)
+    {
+        GLuint batch = findBatch(object.shader, object.model);
+        GLuint impostorBatch = impostors != nullptr && impostors->has(object.model) ? findBatch(IMPOSTOR_SHADER, object.model) : NO_BATCH;
+        float radius = models.get(object.model).boundingRadius;
+        records.push_back({ glm::vec4(object.scale, radius), object.firstMotion, object.motionCount, batch, impostorBatch });
+    }
+    // object counts to offsets
+    GLuint first = 0;
+    for (auto& batchFirst : batchFirsts)
+    {
+        GLuint count = batchFirst;
+        batchFirst = first;
+        first += count;
+    }
+
+    std::vector<glm::vec4> motionRecords;
+    for (auto& motion : motions)
+        motionRecords.push_back(glm::vec4(motion.radius(), motion.period(), motion.phase(), 0.0f));
+
+    // one command per mesh of every batch, ordered so the commands sharing shader and textures are neighbours
+    struct PendingCommand {
+        DrawElementsIndirectCommand command;
+        GLuint batch;
+        unsigned int shader;
+        const Mesh* mesh;
+        ModelHandle impostor;
+    };
+    std::vector<PendingCommand> pending;
+    for (GLuint b = 0; b < batches.size(); b++)
+    {
+        if (batches[b].first == IMPOSTOR_SHADER)
+        {
+            DrawElementsIndirectCommand command = { quad.indexCount, 0, quad.firstIndex, quad.baseVertex, batchFirsts[b] };
+            pending.push_back({ command, b, IMPOSTOR_SHADER, nullptr, batches[b].second });
+            continue;
+        }
+        const Model& model = models.get(batches[b].second);
+        for (unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            const MeshRange& range = ranges[batches[b].second][m];
+            DrawElementsIndirectCommand command = { range.indexCount, 0, range.firstIndex, range.baseVertex, batchFirsts[b] };
+            pending.push_back({ command, b, batches[b].first, &model.meshes[m], INVALID_MODEL });
+        }
+    }
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingCommand& a, const PendingCommand& b) {
+        if (a.shader != b.shader)
+            return a.shader < b.shader;
+        if (a.shader == IMPOSTOR_SHADER)
+            return a.impostor < b.impostor;
+        return textureOrder(*a.mesh, *b.mesh);
+    });
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<GLuint> commandBatches;
+    _groups.clear();
+    for (auto& command : pending)
+    {
+        DrawGroup* last = _groups.empty() ? nullptr : &_groups.back();
+        bool sameGroup = last != nullptr && last->shader == command.shader &&
+            (command.shader == IMPOSTOR_SHADER ? last->impostor == command.impostor : sameTextures(*last->material, *command.mesh));
+        if (sameGroup)
+            last->commandCount++;
+        else
+            _groups.push_back({ command.shader, command.mesh, command.impostor, static_cast<unsigned int>(commands.size()), 1 });
+        commands.push_back(command.command);
+        commandBatches.push_back(command.batch);
+    }
+    _objectCount = static_cast<unsigned int>(records.size());
+    _commandCount = static_cast<unsigned int>(commands.size());
+
+    // buffers
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_VBO);
+    glGenBuffers(1, &_EBO);
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    Mesh::setVertexAttributes();
+    // the base instance of each command picks its batch's range, so the attributes start at 0
+    _instances.resize(first);
+    _instances.bind(0);
+    glBindVertexArray(0);
+
+    _objectBuffer = createStorage(records.data(), records.size() * sizeof(ObjectRecord), GL_STATIC_DRAW);
+    _motionBuffer = createStorage(motionRecords.data(), motionRecords.size() * sizeof(glm::vec4), GL_STATIC_DRAW);
+    _batchCountBuffer = createStorage(NULL, batches.size() * sizeof(GLuint), GL_DYNAMIC_COPY);
+    _batchFirstBuffer = createStorage(batchFirsts.data(), batchFirsts.size() * sizeof(GLuint), GL_STATIC_DRAW);
+    _commandBuffer = createStorage(commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand), GL_DYNAMIC_COPY);
+    _commandBatchBuffer = createStorage(commandBatches.data(), commandBatches.size() * sizeof(GLuint), GL_STATIC_DRAW);
+    _meshBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+    _bufferBytes = records.size() * sizeof(ObjectRecord) + motionRecords.size() * sizeof(glm::vec4) + batches.size() * sizeof(GLuint) +
+        batchFirsts.size() * sizeof(GLuint) + commands.size() * sizeof(DrawElementsIndirectCommand) + commandBatches.size() * sizeof(GLuint);
+    gpuMemory().allocate(GPU_MEMORY_MESHES, _meshBytes);
+    gpuMemory().allocate(GPU_MEMORY_BUFFERS, _bufferBytes);
+
+    // the pyramid halves down to 1x1 like a mipmap chain, so it maps onto the levels of one texture
+    OcclusionBuffer layout;
+    glGenTextures(1, &_depthPyramid);
+    glBindTexture(GL_TEXTURE_2D, _depthPyramid);
+    for (int level = 0; level < layout.levels(); level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, layout.levelWidth(level), layout.levelHeight(level), 0, GL_RED, GL_FLOAT, NULL);
+        _pyramidBytes += static_cast<size_t>(layout.levelWidth(level)) * layout.levelHeight(level) * sizeof(float);
+    }
+    gpuMemory().allocate(GPU_MEMORY_RENDER_TARGETS, _pyramidBytes);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, layout.levels() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    std::cout << "GPU-driven: " << _objectCount << " objects, " << batches.size() << " batches, " << _commandCount
+        << " draw commands in " << _groups.size() << " multi-draws" << std::endl;
+}
+
+void IndirectRenderer::cull(float time, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, int viewportHeight,
+                            const OcclusionBuffer* occlusion)
+{
+    PROFILE_SCOPE("IndirectRenderer::cull");
+    // the compute shader counts the instances of each batch from zero
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _batchCountBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _motionBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _batchCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _batchFirstBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _instances.buffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _commandBatchBuffer);
+
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    _cullShader.use();
+    _cullShader.setUint("objectCount", _objectCount);
+    _cullShader.setFloat("time", time);
+    _cullShader.setVec4Array("planes", frustum.planes, 6);
+    _cullShader.setVec3("cameraPosition", cameraPosition);
+    _cullShader.setFloat("projectedScale", projection[1][1] * viewportHeight * 0.5f);
+    _cullShader.setFloat("minimumRadius", MINIMUM_RADIUS);
+    _cullShader.setFloat("impostorRadius", _impostors != nullptr ? _impostorRadius : 0.0f);
+
+    bool occlusionCulling = occlusion != nullptr && !occlusion->empty();
+    _cullShader.setBool("occlusion", occlusionCulling);
+    if (occlusionCulling)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _depthPyramid);
+        for (int level = 0; level < occlusion->levels(); level++)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, occlusion->levelWidth(level), occlusion->levelHeight(level), GL_RED, GL_FLOAT, occlusion->level(level).data());
+        _cullShader.setInt("depthPyramid", 0);
+        _cullShader.setMat4("view", view);
+        _cullShader.setVec2("projectionScale", glm::vec2(projection[0][0], projection[1][1]));
+        _cullShader.setFloat("nearPlane", projection[3][2] / (projection[2][2] - 1.0f));
+    }
+    _cullShader.dispatch((_objectCount + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    _commandShader.use();
+    _commandShader.setUint("commandCount", _commandCount);
+    _commandShader.dispatch((_commandCount + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE);
+    // the commands are read by the multi-draw, the instances as vertex attributes
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void IndirectRenderer::draw(std::vector<Shader>& shaders, const std::function<void(Shader&)>& prepare)
+{
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+    int currentShader = -1;
+    bool impostorShader = false;
+    for (auto& group : _groups)
+    {
+        if (group.impostor != INVALID_MODEL)
+        {
+            // the impostor groups sort after every other shader
+            if (!impostorShader)
+            {
+                impostorShader = true;
+                _impostors->shader().use();
+                prepare(_impostors->shader());
+            }
+            _impostors->bind(group.impostor);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)), group.commandCount, 0);
+            renderStats().addDraw(0);
+            continue;
+        }
+        Shader& shader = shaders[group.shader];
+        if (static_cast<int>(group.shader) != currentShader)
+        {
+            currentShader = group.shader;
+            shader.use();
+            prepare(shader);
+            shader.setBool("instanced", true);
+        }
+        group.material->bindTextures(shader);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(group.firstCommand * sizeof(DrawElementsIndirectCommand)), group.commandCount, 0);
+        // how many triangles that was is only known on the GPU
+        renderStats().addDraw(0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
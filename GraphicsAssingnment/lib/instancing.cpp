@@ -0,0 +1,55 @@
+#include "instancing.h"
+#include "gpumemory.h"
+
+#include <algorithm>
+
+InstanceBuffer::InstanceBuffer()
+{
+    glGenBuffers(1, &_buffer);
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    glDeleteBuffers(1, &_buffer);
+    gpuMemory().release(GPU_MEMORY_BUFFERS, _capacity * sizeof(glm::mat4));
+}
+
+void InstanceBuffer::upload(const std::vector<glm::mat4>& matrices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    // grow in powers of two so a slowly growing scene doesn't reallocate every frame
+    if (matrices.size() > _capacity)
+    {
+        size_t grown = std::max(matrices.size(), _capacity * 2);
+        gpuMemory().allocate(GPU_MEMORY_BUFFERS, (grown - _capacity) * sizeof(glm::mat4));
+        _capacity = grown;
+    }
+    glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(_capacity, 1) * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+    if (!matrices.empty())
+        glBufferSubData(GL_ARRAY_BUFFER, 0, matrices.size() * sizeof(glm::mat4), matrices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::resize(size_t count)
+{
+    gpuMemory().release(GPU_MEMORY_BUFFERS, _capacity * sizeof(glm::mat4));
+    gpuMemory().allocate(GPU_MEMORY_BUFFERS, count * sizeof(glm::mat4));
+    _capacity = count;
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(_capacity, 1) * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::bind(size_t first) const
+{
+    // a mat4 attribute takes four locations, one vec4 column each, advancing once per instance
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        unsigned int location = INSTANCE_MATRIX_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
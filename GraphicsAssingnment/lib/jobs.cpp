@@ -0,0 +1,341 @@
+#include "jobs.h"
+
+#include <algorithm>
+
+// index of the worker running on the current thread, -1 for threads the scheduler does not own
+static thread_local int tlsWorkerIndex = -1;
+static thread_local JobSystem* tlsOwner = nullptr;
+
+WorkStealingDeque::WorkStealingDeque(size_t capacity) : _buffer(capacity), _mask(capacity - 1), _top(0), _bottom(0)
+{
+    // the ring buffer is indexed with a mask, so the capacity has to be a power of two
+    for (auto& slot : _buffer)
+        slot.store(nullptr, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::push(Job* job)
+{
+    int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top > static_cast<int64_t>(_mask))
+        return false;
+    _buffer[bottom & _mask].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+Job* WorkStealingDeque::pop()
+{
+    int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // empty, restore the bottom
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = _buffer[bottom & _mask].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // last element, race against the thieves for it
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+Job* WorkStealingDeque::steal()
+{
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return nullptr;
+
+    Job* job = _buffer[top & _mask].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+JobSystem::JobSystem(unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    _mainThreadId = std::this_thread::get_id();
+    for (unsigned int i = 0; i < threadCount; i++)
+        _queues.push_back(std::make_unique<WorkStealingDeque>());
+
+    // the creating thread is worker 0, it runs jobs whenever it waits for one
+    tlsWorkerIndex = 0;
+    tlsOwner = this;
+    for (unsigned int i = 1; i < threadCount; i++)
+        _threads.emplace_back(&JobSystem::workerLoop, this, static_cast<int>(i));
+}
+
+JobSystem::~JobSystem()
+{
+    _stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(_sleepLock);
+    }
+    _wake.notify_all();
+    for (auto& thread : _threads)
+        thread.join();
+    if (tlsOwner == this)
+    {
+        tlsWorkerIndex = -1;
+        tlsOwner = nullptr;
+    }
+}
+
+JobHandle JobSystem::createJob(std::function<void()> function, const JobHandle& parent)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->function = std::move(function);
+    job->parent = parent;
+    job->keepAlive = job;
+    return job;
+}
+
+JobHandle JobSystem::run(std::function<void()> function)
+{
+    JobHandle job = createJob(std::move(function), nullptr);
+    schedule(job);
+    return job;
+}
+
+JobHandle JobSystem::runOrInline(std::function<void()> function)
+{
+    if (threadCount() > 1)
+        return run(std::move(function));
+    function();
+    return JobHandle();
+}
+
+JobHandle JobSystem::runChild(const JobHandle& parent, std::function<void()> function)
+{
+    parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    JobHandle job = createJob(std::move(function), parent);
+    schedule(job);
+    return job;
+}
+
+JobHandle JobSystem::runOnMainThread(std::function<void()> function)
+{
+    JobHandle job = createJob(std::move(function), nullptr);
+    job->mainThreadOnly = true;
+    schedule(job);
+    return job;
+}
+
+JobHandle JobSystem::continueWith(const std::vector<JobHandle>& dependencies, std::function<void()> function, bool mainThread)
+{
+    JobHandle job = createJob(std::move(function), nullptr);
+    job->mainThreadOnly = mainThread;
+    // one extra dependency so the job cannot start while we are still registering it
+    job->dependencies.store(static_cast<int>(dependencies.size()) + 1);
+    for (auto& dependency : dependencies)
+    {
+        std::lock_guard<std::mutex> lock(dependency->continuationLock);
+        if (dependency->finished.load(std::memory_order_acquire))
+            job->dependencies.fetch_sub(1);
+        else
+            dependency->continuations.push_back(job);
+    }
+    if (job->dependencies.fetch_sub(1) == 1)
+        schedule(job);
+    return job;
+}
+
+JobHandle JobSystem::continueWith(const JobHandle& dependency, std::function<void()> function, bool mainThread)
+{
+    return continueWith(std::vector<JobHandle>{ dependency }, std::move(function), mainThread);
+}
+
+void JobSystem::schedule(const JobHandle& job)
+{
+    if (job->mainThreadOnly)
+    {
+        std::lock_guard<std::mutex> lock(_mainThreadLock);
+        _mainThreadJobs.push_back(job.get());
+        return;
+    }
+
+    _pending.fetch_add(1);
+    bool queued = false;
+    if (tlsOwner == this && tlsWorkerIndex >= 0)
+        queued = _queues[tlsWorkerIndex]->push(job.get());
+    if (!queued)
+    {
+        std::lock_guard<std::mutex> lock(_injectionLock);
+        _injected.push_back(job.get());
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepLock);
+    }
+    _wake.notify_one();
+}
+
+void JobSystem::execute(Job* job)
+{
+    if (job->function)
+        job->function();
+    finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->continuationLock);
+        job->finished.store(true, std::memory_order_release);
+        continuations.swap(job->continuations);
+    }
+    for (auto& continuation : continuations)
+    {
+        if (continuation->dependencies.fetch_sub(1) == 1)
+            schedule(continuation);
+    }
+
+    JobHandle parent = std::move(job->parent);
+    // may release the last reference to the job, so nothing touches it after this point
+    JobHandle self = std::move(job->keepAlive);
+    if (parent)
+        finish(parent.get());
+}
+
+Job* JobSystem::findWork(int workerIndex)
+{
+    Job* job = nullptr;
+    if (workerIndex >= 0)
+        job = _queues[workerIndex]->pop();
+
+    if (job == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(_injectionLock);
+        if (!_injected.empty())
+        {
+            job = _injected.back();
+            _injected.pop_back();
+        }
+    }
+
+    if (job == nullptr)
+    {
+        // start stealing from the neighbour so the workers don't all hammer the same deque
+        size_t count = _queues.size();
+        size_t start = static_cast<size_t>(workerIndex + 1);
+        for (size_t i = 0; i < count && job == nullptr; i++)
+        {
+            size_t victim = (start + i) % count;
+            if (static_cast<int>(victim) != workerIndex)
+                job = _queues[victim]->steal();
+        }
+    }
+
+    if (job != nullptr)
+        _pending.fetch_sub(1);
+    return job;
+}
+
+bool JobSystem::runOne(int workerIndex)
+{
+    Job* job = findWork(workerIndex);
+    if (job != nullptr)
+    {
+        execute(job);
+        return true;
+    }
+    return pumpMainThread() > 0;
+}
+
+void JobSystem::wait(const JobHandle& job)
+{
+    int workerIndex = tlsOwner == this ? tlsWorkerIndex : -1;
+    while (!job->finished.load(std::memory_order_acquire))
+    {
+        if (!runOne(workerIndex))
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& function)
+{
+    if (end <= begin)
+        return;
+    size_t count = end - begin;
+    if (grainSize == 0)
+        grainSize = 1;
+    if (count <= grainSize || _queues.size() == 1)
+    {
+        function(begin, end);
+        return;
+    }
+
+    // a few ranges per thread is enough for load balancing, more only adds scheduling overhead
+    size_t maxRanges = _queues.size() * 4;
+    if ((count + grainSize - 1) / grainSize > maxRanges)
+        grainSize = (count + maxRanges - 1) / maxRanges;
+
+    JobHandle root = createJob(std::function<void()>(), nullptr);
+    for (size_t start = begin + grainSize; start < end; start += grainSize)
+    {
+        size_t stop = std::min(start + grainSize, end);
+        runChild(root, [&function, start, stop] { function(start, stop); });
+    }
+    // the calling thread takes the first range itself
+    function(begin, std::min(begin + grainSize, end));
+    finish(root.get());
+    wait(root);
+}
+
+size_t JobSystem::pumpMainThread()
+{
+    if (!isMainThread())
+        return 0;
+
+    std::vector<Job*> jobs;
+    {
+        std::lock_guard<std::mutex> lock(_mainThreadLock);
+        jobs.swap(_mainThreadJobs);
+    }
+    for (Job* job : jobs)
+        execute(job);
+    return jobs.size();
+}
+
+bool JobSystem::isMainThread() const
+{
+    return std::this_thread::get_id() == _mainThreadId;
+}
+
+void JobSystem::workerLoop(int workerIndex)
+{
+    tlsWorkerIndex = workerIndex;
+    tlsOwner = this;
+    while (!_stopping.load())
+    {
+        if (runOne(workerIndex))
+            continue;
+        std::unique_lock<std::mutex> lock(_sleepLock);
+        _wake.wait(lock, [this] { return _pending.load() > 0 || _stopping.load(); });
+    }
+}
+
+JobSystem& jobSystem()
+{
+    // created on first use, which has to happen on the main thread
+    static JobSystem instance;
+    return instance;
+}
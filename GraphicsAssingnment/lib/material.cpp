@@ -0,0 +1,182 @@
+#include "material.h"
+#include "texture.h"
+#include "compression.h"
+#include "gpumemory.h"
+#include "profiler.h"
+
+#include <iostream>
+
+MaterialLibrary::MaterialLibrary(bool compress)
+    : _compress(compress)
+{
+}
+
+MaterialLibrary::~MaterialLibrary()
+{
+    // the jobs write into the pending materials
+    for (auto& job : _loading)
+        jobSystem().wait(job);
+    if (!_arrays.empty())
+        glDeleteTextures(static_cast<GLsizei>(_arrays.size()), _arrays.data());
+    gpuMemory().release(GPU_MEMORY_TEXTURES, _textureBytes);
+}
+
+bool MaterialLibrary::available(const SceneLayers& layers)
+{
+    int width, height, channels;
+    if (!layers.color.empty() && stbi_info(layers.color.c_str(), &width, &height, &channels))
+        return true;
+    std::cout << "ERROR::MATERIAL::IMAGE_NOT_LOADED: " << layers.color << ", drawing the model with its own textures" << std::endl;
+    return false;
+}
+
+unsigned int MaterialLibrary::add(const SceneLayers& layers)
+{
+    unsigned int material = static_cast<unsigned int>(_materials.size());
+    _materials.emplace_back();
+    _pending.emplace_back(new PendingMaterial());
+    PendingMaterial* pending = _pending.back().get();
+    bool compress = _compress;
+    _loading.push_back(jobSystem().run([layers, compress, pending]() { pack(layers, compress, *pending); }));
+    return material;
+}
+
+void MaterialLibrary::pack(const SceneLayers& layers, bool compress, PendingMaterial& result)
+{
+    PROFILE_SCOPE("MaterialLibrary::pack");
+    int width, height, channels;
+    unsigned char* color = stbi_load(layers.color.c_str(), &width, &height, &channels, 4);
+    if (!color)
+    {
+        std::cout << "ERROR::MATERIAL::IMAGE_NOT_LOADED: " << layers.color << std::endl;
+        return;
+    }
+
+    // every mask is one channel of the mask layer, the ones that are missing stay black
+    std::vector<unsigned char> masks(static_cast<size_t>(width) * height * 4, 0);
+    const std::string* sources[4] = { &layers.ocean, &layers.clouds, &layers.night, &layers.height };
+    for (int channel = 0; channel < 4; channel++)
+    {
+        if (sources[channel]->empty())
+            continue;
+        int maskWidth, maskHeight, maskChannels;
+        unsigned char* mask = stbi_load(sources[channel]->c_str(), &maskWidth, &maskHeight, &maskChannels, 1);
+        if (!mask)
+        {
+            std::cout << "ERROR::MATERIAL::IMAGE_NOT_LOADED: " << *sources[channel] << std::endl;
+            continue;
+        }
+        if (maskWidth != width || maskHeight != height)
+            std::cout << "ERROR::MATERIAL::LAYER_SIZE: " << *sources[channel] << " isn't the size of " << layers.color << std::endl;
+        else
+        {
+            for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+                masks[4 * i + channel] = mask[i];
+        }
+        stbi_image_free(mask);
+    }
+
+    result.color = buildMipChain(color, width, height, 4);
+    stbi_image_free(color);
+    result.masks = buildMipChain(masks.data(), width, height, 4);
+    if (compress)
+    {
+        for (size_t level = 0; level < result.color.size(); level++)
+        {
+            int levelWidth = mipLevelSize(width, static_cast<int>(level)), levelHeight = mipLevelSize(height, static_cast<int>(level));
+            for (auto* layer : { &result.color[level], &result.masks[level] })
+            {
+                std::vector<unsigned char> blocks(compressedSize(levelWidth, levelHeight, 4));
+                compressImage(layer->data(), levelWidth, levelHeight, 4, blocks.data());
+                layer->swap(blocks);
+            }
+        }
+    }
+    // a width of 0 is a material that didn't load
+    result.width = width;
+    result.height = height;
+}
+
+void MaterialLibrary::build()
+{
+    PROFILE_SCOPE("MaterialLibrary::build");
+    for (auto& job : _loading)
+        jobSystem().wait(job);
+    _loading.clear();
+
+    for (size_t first = 0; first < _pending.size(); first++)
+    {
+        if (!_pending[first] || _pending[first]->width == 0)
+        {
+            _pending[first].reset();
+            continue;
+        }
+        // every material of this size goes into the array, two layers each
+        int width = _pending[first]->width, height = _pending[first]->height;
+        std::vector<size_t> group;
+        for (size_t i = first; i < _pending.size(); i++)
+        {
+            if (_pending[i] && _pending[i]->width == width && _pending[i]->height == height)
+                group.push_back(i);
+        }
+        int layers = static_cast<int>(2 * group.size());
+        int levels = static_cast<int>(_pending[first]->color.size());
+
+        unsigned int array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        size_t bytes = 0;
+        for (int level = 0; level < levels; level++)
+        {
+            // the layers of a level are consecutive images
+            std::vector<unsigned char> data;
+            for (size_t i : group)
+            {
+                data.insert(data.end(), _pending[i]->color[level].begin(), _pending[i]->color[level].end());
+                data.insert(data.end(), _pending[i]->masks[level].begin(), _pending[i]->masks[level].end());
+            }
+            int levelWidth = mipLevelSize(width, level), levelHeight = mipLevelSize(height, level);
+            if (_compress)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressedFormat(4), levelWidth, levelHeight, layers, 0, static_cast<GLsizei>(data.size()), data.data());
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+            bytes += data.size();
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        _textureBytes += bytes;
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, bytes);
+        _arrays.push_back(array);
+
+        for (size_t k = 0; k < group.size(); k++)
+        {
+            LayeredMaterial& material = _materials[group[k]];
+            material.array = array;
+            material.colorLayer = static_cast<int>(2 * k);
+            material.maskLayer = static_cast<int>(2 * k + 1);
+            _pending[group[k]].reset();
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+std::vector<Texture> MaterialLibrary::textures(unsigned int material) const
+{
+    std::vector<Texture> textures;
+    const LayeredMaterial& layered = _materials[material];
+    if (layered.array == 0)
+        return textures;
+    Texture color;
+    color.id = layered.array;
+    color.type = "layer_color";
+    color.layer = layered.colorLayer;
+    textures.push_back(color);
+    Texture masks = color;
+    masks.type = "layer_mask";
+    masks.layer = layered.maskLayer;
+    textures.push_back(masks);
+    return textures;
+}
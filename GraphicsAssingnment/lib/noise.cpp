@@ -0,0 +1,222 @@
+#include "noise_lanes.h"
+#include "jobs.h"
+#include "profiler.h"
+#include "random.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+// in noise_avx2.cpp and noise_avx512.cpp, built for those instruction sets
+void evaluateNoiseAVX2(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count);
+void evaluateNoiseAVX512(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count);
+
+static const int TILE_SIZE = 64;
+// entries of the colour ramp a texel looks its colour up in, a power of two
+static const int RAMP_SIZE = 1024;
+static const float PI = 3.14159265358979323846f;
+
+enum InstructionSet { BASELINE, AVX2, AVX512 };
+
+// what the CPU and the operating system support, checked once
+static InstructionSet detectInstructionSet()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return BASELINE;
+    __cpuid(info, 1);
+    // the OS has to save the AVX registers on a context switch
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 0x6) != 0x6)
+        return BASELINE;
+    // /arch:AVX2 lets the compiler contract into FMA instructions
+    bool fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = fma && (info[1] & (1 << 5)) != 0;
+    // /arch:AVX512 is F, CD, BW, DQ and VL together, the compiler may use any of them
+    const unsigned int AVX512_FEATURES = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);
+    bool avx512 = avx2 && (static_cast<unsigned int>(info[1]) & AVX512_FEATURES) == AVX512_FEATURES && (_xgetbv(0) & 0xE6) == 0xE6;
+    return avx512 ? AVX512 : avx2 ? AVX2 : BASELINE;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return AVX512;
+    return __builtin_cpu_supports("avx2") ? AVX2 : BASELINE;
+#else
+    return BASELINE;
+#endif
+}
+
+static InstructionSet instructionSet()
+{
+    static const InstructionSet detected = detectInstructionSet();
+    return detected;
+}
+
+void evaluateNoise(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count)
+{
+    switch (instructionSet())
+    {
+    case AVX512:
+        evaluateNoiseAVX512(settings, x, y, z, result, count);
+        break;
+    case AVX2:
+        evaluateNoiseAVX2(settings, x, y, z, result, count);
+        break;
+    default:
+        evaluateBatch(settings, x, y, z, result, count);
+        break;
+    }
+}
+
+const char* noiseInstructionSet()
+{
+    switch (instructionSet())
+    {
+    case AVX512:
+        return "AVX-512";
+    case AVX2:
+        return "AVX2";
+    default:
+        return Lanes::WIDTH == 4 ? "SSE2" : "scalar";
+    }
+}
+
+PlanetStyle randomPlanetStyle(unsigned int seed, bool gasGiant)
+{
+    DeterministicRandom random(seed);
+    PlanetStyle style;
+    style.gasGiant = gasGiant;
+    style.terrain.seed = random.next();
+    style.mountains.seed = random.next();
+    if (gasGiant)
+    {
+        // soft, stretched swirls and no ice
+        style.terrain.frequency = 3.0f;
+        style.terrain.octaves = 4;
+        style.terrain.warp = random.uniform(0.1f, 0.4f);
+        style.iceLatitude = 1.0f;
+        style.lowColor = random.color(glm::vec3(0.3f, 0.2f, 0.1f), glm::vec3(0.8f, 0.6f, 0.5f));
+        style.highColor = random.color(glm::vec3(0.6f, 0.5f, 0.4f), glm::vec3(1.0f, 0.95f, 0.9f));
+        return style;
+    }
+    style.terrain.frequency = random.uniform(1.5f, 3.0f);
+    style.terrain.octaves = 6;
+    style.mountains.fractal = NOISE_RIDGED;
+    style.mountains.frequency = style.terrain.frequency * 2.0f;
+    style.mountains.octaves = 5;
+    style.seaLevel = random.uniform(-0.3f, 0.2f);
+    style.iceLatitude = random.uniform(0.75f, 1.0f);
+    style.deepColor = random.color(glm::vec3(0.0f, 0.02f, 0.1f), glm::vec3(0.1f, 0.1f, 0.3f));
+    style.shallowColor = random.color(glm::vec3(0.05f, 0.2f, 0.3f), glm::vec3(0.2f, 0.45f, 0.6f));
+    style.lowColor = random.color(glm::vec3(0.1f, 0.2f, 0.05f), glm::vec3(0.6f, 0.5f, 0.3f));
+    style.highColor = random.color(glm::vec3(0.3f, 0.25f, 0.2f), glm::vec3(0.6f, 0.5f, 0.45f));
+    return style;
+}
+
+// the colour of the ground (or the sea) at a height, without the ice
+static glm::vec3 surfaceColor(const PlanetStyle& style, float height)
+{
+    float above = height - style.seaLevel;
+    if (above < 0.0f)
+        return glm::mix(style.deepColor, style.shallowColor, glm::clamp(1.0f + above * 4.0f, 0.0f, 1.0f));
+    float t = glm::clamp(above * 2.0f, 0.0f, 1.0f);
+    glm::vec3 color = glm::mix(style.lowColor, style.highColor, t);
+    return glm::mix(color, style.snowColor, glm::smoothstep(0.75f, 0.9f, t));
+}
+
+void generatePlanetMaps(const PlanetStyle& style, int width, int height, PlanetMaps& maps)
+{
+    PROFILE_SCOPE("generatePlanetMaps");
+    maps.width = width;
+    maps.height = height;
+    maps.albedo.resize(static_cast<size_t>(width) * height * 4);
+    maps.heights.resize(static_cast<size_t>(width) * height);
+
+    // the directions of a texel's column and row are the same for every tile
+    std::vector<float> cosLongitude(width), sinLongitude(width), sinLatitude(height), cosLatitude(height);
+    for (int x = 0; x < width; x++)
+    {
+        float longitude = 2.0f * PI * (x + 0.5f) / width;
+        cosLongitude[x] = std::cos(longitude);
+        sinLongitude[x] = std::sin(longitude);
+    }
+    for (int y = 0; y < height; y++)
+    {
+        // the first row is the north pole, like the texture coordinates of the spheres
+        float polar = PI * (y + 0.5f) / height;
+        sinLatitude[y] = std::cos(polar);
+        cosLatitude[y] = std::sin(polar);
+    }
+
+    // the colour only depends on the height (or the band's phase), so it is blended once per ramp entry
+    // instead of once per texel. Heights cover [-2, 2), phases one period of the bands.
+    std::vector<glm::vec3> ramp(RAMP_SIZE);
+    float rampLow = style.gasGiant ? 0.0f : -2.0f;
+    float rampScale = RAMP_SIZE / (style.gasGiant ? 2.0f * PI : 4.0f);
+    for (int i = 0; i < RAMP_SIZE; i++)
+    {
+        float value = rampLow + (i + 0.5f) / rampScale;
+        ramp[i] = style.gasGiant ? glm::mix(style.lowColor, style.highColor, 0.5f + 0.5f * std::sin(value)) : surfaceColor(style, value);
+        ramp[i] = glm::clamp(ramp[i], 0.0f, 1.0f);
+    }
+
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    jobSystem().parallelFor(0, static_cast<size_t>(tilesX) * tilesY, 1, [&](size_t begin, size_t end) {
+        float px[TILE_SIZE], py[TILE_SIZE], pz[TILE_SIZE], terrain[TILE_SIZE], mountains[TILE_SIZE];
+        for (size_t tile = begin; tile < end; tile++)
+        {
+            int x0 = static_cast<int>(tile % tilesX) * TILE_SIZE;
+            int y0 = static_cast<int>(tile / tilesX) * TILE_SIZE;
+            int columns = std::min(TILE_SIZE, width - x0);
+            for (int y = y0; y < std::min(y0 + TILE_SIZE, height); y++)
+            {
+                // a row of the tile is one batch, the points on the unit sphere
+                for (int i = 0; i < columns; i++)
+                {
+                    px[i] = cosLatitude[y] * cosLongitude[x0 + i];
+                    py[i] = sinLatitude[y];
+                    pz[i] = -cosLatitude[y] * sinLongitude[x0 + i];
+                }
+                evaluateNoise(style.terrain, px, py, pz, terrain, columns);
+                if (!style.gasGiant)
+                    evaluateNoise(style.mountains, px, py, pz, mountains, columns);
+                float latitude = sinLatitude[y];
+                // the coastline of the ice caps follows the height a little, |height| stays below about 1
+                bool nearIce = std::fabs(latitude) > style.iceLatitude - 0.07f;
+                for (int i = 0; i < columns; i++)
+                {
+                    size_t index = static_cast<size_t>(y) * width + x0 + i;
+                    float h = terrain[i];
+                    int entry;
+                    if (style.gasGiant)
+                    {
+                        // bands along the latitude, bent by the noise
+                        float phase = latitude * 14.0f + h * 3.0f;
+                        entry = static_cast<int>((phase - std::floor(phase / (2.0f * PI)) * 2.0f * PI) * rampScale) & (RAMP_SIZE - 1);
+                    }
+                    else
+                    {
+                        // mountains rise from the coast inland
+                        h += 0.5f * mountains[i] * glm::clamp((h - style.seaLevel) * 4.0f, 0.0f, 1.0f);
+                        entry = glm::clamp(static_cast<int>((h - rampLow) * rampScale), 0, RAMP_SIZE - 1);
+                    }
+                    maps.heights[index] = h;
+                    glm::vec3 color = ramp[entry];
+                    if (nearIce)
+                        color = glm::mix(color, style.snowColor, glm::smoothstep(style.iceLatitude - 0.02f, style.iceLatitude + 0.02f, std::fabs(latitude) + 0.05f * h));
+                    unsigned char* pixel = &maps.albedo[index * 4];
+                    pixel[0] = static_cast<unsigned char>(color.r * 255.0f + 0.5f);
+                    pixel[1] = static_cast<unsigned char>(color.g * 255.0f + 0.5f);
+                    pixel[2] = static_cast<unsigned char>(color.b * 255.0f + 0.5f);
+                    pixel[3] = 255;
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,13 @@
+// the noise kernels for AVX2, built with /arch:AVX2 (see the project file). Only called once noise.cpp
+// has checked that the CPU has AVX2.
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+
+#define NOISE_AVX2
+#include "noise_lanes.h"
+
+void evaluateNoiseAVX2(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count)
+{
+    evaluateBatch(settings, x, y, z, result, count);
+}
@@ -0,0 +1,13 @@
+// the noise kernels for AVX-512, built with /arch:AVX512 (see the project file). Only called once noise.cpp
+// has checked that the CPU has AVX-512F.
+#if defined(__GNUC__) && !defined(__AVX512F__)
+#pragma GCC target("avx512f")
+#endif
+
+#define NOISE_AVX512
+#include "noise_lanes.h"
+
+void evaluateNoiseAVX512(const NoiseSettings& settings, const float* x, const float* y, const float* z, float* result, size_t count)
+{
+    evaluateBatch(settings, x, y, z, result, count);
+}
@@ -0,0 +1,157 @@
+#include "occlusion.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const float FAR_AWAY = std::numeric_limits<float>::max();
+
+OcclusionBuffer::OcclusionBuffer()
+{
+    for (int level = 0; (WIDTH >> level) > 0 || (HEIGHT >> level) > 0; level++)
+        _levels.push_back(std::vector<float>(levelWidth(level) * levelHeight(level), FAR_AWAY));
+}
+
+void OcclusionBuffer::begin(const glm::mat4& view, const glm::mat4& projection)
+{
+    _view = view;
+    _p00 = projection[0][0];
+    _p11 = projection[1][1];
+    // near plane of a glm::perspective matrix
+    _near = projection[3][2] / (projection[2][2] - 1.0f);
+    std::fill(_levels[0].begin(), _levels[0].end(), FAR_AWAY);
+    _empty = true;
+}
+
+void OcclusionBuffer::addOccluder(const glm::vec3& center, float radius)
+{
+    glm::vec3 viewCenter = glm::vec3(_view * glm::vec4(center, 1.0f));
+    float depth = -viewCenter.z;
+    if (depth - radius < _near)
+        return;
+
+    // the silhouette of a sphere contains the disc of angular radius radius / distance around the
+    // projected center, on every part of the screen. Only pixels that are inside it as a whole are covered.
+    float distance = glm::length(viewCenter);
+    float centerX = (viewCenter.x * _p00 / depth * 0.5f + 0.5f) * WIDTH;
+    float centerY = (viewCenter.y * _p11 / depth * 0.5f + 0.5f) * HEIGHT;
+    float radiusX = radius / distance * _p00 * 0.5f * WIDTH - 0.71f;
+    float radiusY = radius / distance * _p11 * 0.5f * HEIGHT - 0.71f;
+    if (radiusX <= 0.0f || radiusY <= 0.0f)
+        return;
+
+    float farSide = depth + radius;
+    int x0 = std::max(0, static_cast<int>(std::ceil(centerX - radiusX - 0.5f)));
+    int x1 = std::min(WIDTH - 1, static_cast<int>(std::floor(centerX + radiusX - 0.5f)));
+    int y0 = std::max(0, static_cast<int>(std::ceil(centerY - radiusY - 0.5f)));
+    int y1 = std::min(HEIGHT - 1, static_cast<int>(std::floor(centerY + radiusY - 0.5f)));
+    std::vector<float>& pixels = _levels[0];
+    for (int y = y0; y <= y1; y++)
+    {
+        float dy = (y + 0.5f - centerY) / radiusY;
+        for (int x = x0; x <= x1; x++)
+        {
+            float dx = (x + 0.5f - centerX) / radiusX;
+            if (dx * dx + dy * dy <= 1.0f)
+            {
+                float& pixel = pixels[y * WIDTH + x];
+                pixel = std::min(pixel, farSide);
+                _empty = false;
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::finish()
+{
+    for (int level = 1; level < levels(); level++)
+    {
+        const std::vector<float>& source = _levels[level - 1];
+        std::vector<float>& target = _levels[level];
+        int sourceWidth = levelWidth(level - 1);
+        int sourceHeight = levelHeight(level - 1);
+        int width = levelWidth(level);
+        int height = levelHeight(level);
+        for (int y = 0; y < height; y++)
+        {
+            int sy0 = std::min(y * 2, sourceHeight - 1);
+            int sy1 = std::min(y * 2 + 1, sourceHeight - 1);
+            for (int x = 0; x < width; x++)
+            {
+                int sx0 = std::min(x * 2, sourceWidth - 1);
+                int sx1 = std::min(x * 2 + 1, sourceWidth - 1);
+                target[y * width + x] = std::max(std::max(source[sy0 * sourceWidth + sx0], source[sy0 * sourceWidth + sx1]),
+                                                 std::max(source[sy1 * sourceWidth + sx0], source[sy1 * sourceWidth + sx1]));
+            }
+        }
+    }
+}
+
+// 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere (Mara and McGuire 2013)
+bool OcclusionBuffer::projectSphere(const glm::vec3& viewCenter, float radius, glm::vec4& bounds) const
+{
+    // the view looks down -z, the math below wants the distance in front of the camera
+    glm::vec3 c(viewCenter.x, viewCenter.y, -viewCenter.z);
+    if (c.z < radius + _near)
+        return false;
+
+    glm::vec2 cx(c.x, c.z);
+    glm::vec2 vx(std::sqrt(glm::dot(cx, cx) - radius * radius), radius);
+    glm::vec2 minX(vx.x * cx.x - vx.y * cx.y, vx.y * cx.x + vx.x * cx.y);
+    glm::vec2 maxX(vx.x * cx.x + vx.y * cx.y, -vx.y * cx.x + vx.x * cx.y);
+    glm::vec2 cy(c.y, c.z);
+    glm::vec2 vy(std::sqrt(glm::dot(cy, cy) - radius * radius), radius);
+    glm::vec2 minY(vy.x * cy.x - vy.y * cy.y, vy.y * cy.x + vy.x * cy.y);
+    glm::vec2 maxY(vy.x * cy.x + vy.y * cy.y, -vy.y * cy.x + vy.x * cy.y);
+
+    bounds = glm::vec4(minX.x / minX.y * _p00, minY.x / minY.y * _p11, maxX.x / maxX.y * _p00, maxY.x / maxY.y * _p11);
+    bounds = (bounds * 0.5f + 0.5f) * glm::vec4(WIDTH, HEIGHT, WIDTH, HEIGHT);
+    return true;
+}
+
+bool OcclusionBuffer::occluded(const glm::vec3& center, float radius) const
+{
+    if (_empty)
+        return false;
+    glm::vec3 viewCenter = glm::vec3(_view * glm::vec4(center, 1.0f));
+    glm::vec4 bounds;
+    if (!projectSphere(viewCenter, radius, bounds))
+        return false;
+
+    int x0 = std::max(0, static_cast<int>(std::floor(bounds.x)));
+    int y0 = std::max(0, static_cast<int>(std::floor(bounds.y)));
+    int x1 = std::min(WIDTH - 1, static_cast<int>(std::floor(bounds.z)));
+    int y1 = std::min(HEIGHT - 1, static_cast<int>(std::floor(bounds.w)));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    // the level where the rectangle spans at most two texels each way, a handful of reads
+    int level = 0;
+    while (level + 1 < levels() && std::max(x1 - x0, y1 - y0) >> level > 1)
+        level++;
+    const std::vector<float>& texels = _levels[level];
+    int width = levelWidth(level);
+    int height = levelHeight(level);
+    float farthest = 0.0f;
+    for (int y = std::min(y0 >> level, height - 1); y <= std::min(y1 >> level, height - 1); y++)
+    {
+        for (int x = std::min(x0 >> level, width - 1); x <= std::min(x1 >> level, width - 1); x++)
+            farthest = std::max(farthest, texels[y * width + x]);
+    }
+    float nearSide = -viewCenter.z - radius;
+    return nearSide > farthest;
+}
+
+void cullOccluded(const OcclusionBuffer& buffer, const std::vector<glm::vec4>& spheres, std::vector<unsigned char>& visible)
+{
+    if (buffer.empty())
+        return;
+    jobSystem().parallelFor(0, spheres.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (visible[i] && buffer.occluded(glm::vec3(spheres[i]), spheres[i].w))
+                visible[i] = 0;
+        }
+    });
+}
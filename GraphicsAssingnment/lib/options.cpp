@@ -0,0 +1,260 @@
+#include "options.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --scene FILE                    scene to load (default: ./assets/scenes/solar.json)\n"
+        << "  --planets N                     generate a stress scene with N planets (default: 8)\n"
+        << "  --moons M                       moons per planet of the stress scene (default: 2)\n"
+        << "  --asteroids K                   asteroids of the stress scene (default: 0)\n"
+        << "  --stars S                       stars of the stress scene (default: 1000)\n"
+        << "  --unique-models                 every planet and moon of the stress scene loads its own model\n"
+        << "  --save-scene FILE               write the simulated scene as a scene file\n"
+        << "  --import-catalog CSV            convert a CSV star catalog to a .stars file next to it and exit\n"
+        << "  --headless [egl|osmesa|hidden]  render offscreen without a visible window\n"
+        << "  --frames N                      exit after N frames (headless default: 100)\n"
+        << "  --capture PREFIX                record every frame to PREFIX_NNNNN.png (or PREFIX for raw)\n"
+        << "  --capture-format png|raw        numbered PNG files or one raw RGBA video file\n"
+        << "  --trace FILE                    write a Chrome trace of the profiled scopes at exit\n"
+        << "  --no-instancing                 draw every object with its own call instead of instancing\n"
+        << "  --no-gpu-driven                 cull and batch on the CPU even if OpenGL 4.3 is available\n"
+        << "  --no-occlusion                  don't cull the bodies hidden behind the biggest ones\n"
+        << "  --skybox SIZE                   bake the stars into a SIZE x SIZE cubemap drawn behind everything\n"
+        << "  --magnitude M                   draw the catalog stars up to magnitude M (default: 6.5)\n"
+        << "  --galaxy FILE                   draw the point cloud in FILE around the scene\n"
+        << "  --build-galaxy N                generate a galaxy of N stars into the --galaxy file first\n"
+        << "  --point-budget N                draw at most N galaxy points a frame (default: 4000000)\n"
+        << "  --galaxy-raster points|compute  draw the galaxy as GL_POINTS or with the compute rasterizer\n"
+        << "  --universe                      generate star systems around the scene as the camera flies, from --seed\n"
+        << "  --no-terrain                    draw the bodies with height maps as their models instead of as terrain\n"
+        << "  --impostor-radius PIXELS        draw round bodies smaller than this as impostors, 0 never (default: 16)\n"
+        << "  --no-texture-streaming          load the model textures whole instead of streaming their mip levels\n"
+        << "  --no-texture-compression        upload the model textures uncompressed instead of block compressing them\n"
+        << "  --gpu-memory MB                 video memory budget, least recently drawn resources go first (default: 0, none)\n"
+        << "  --benchmark                     deterministic run with a frame time report (default: 1000 frames)\n"
+        << "  --seed N                        seed for every random number (default: 1)\n"
+        << "  --fixed-step S                  simulation seconds per benchmark frame (default: 1/60)\n"
+        << "  --camera-path FILE              replay a camera spline instead of the mouse and keyboard\n"
+        << "  --report FILE                   write the benchmark report as JSON\n"
+        << "  --curve FILE                    append frame time and scene size to a CSV file\n"
+        << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+        // the value of an option is the next argument, unless that is another option
+        const char* value = (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0) ? argv[i + 1] : nullptr;
+
+        if (std::strcmp(argument, "--scene") == 0 && value != nullptr)
+        {
+            options.scenePath = value;
+            i++;
+        }
+        else if ((std::strcmp(argument, "--planets") == 0 || std::strcmp(argument, "--moons") == 0
+            || std::strcmp(argument, "--asteroids") == 0 || std::strcmp(argument, "--stars") == 0) && value != nullptr)
+        {
+            unsigned int count = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            if (argument[2] == 'p')
+                options.stressSettings.planets = count;
+            else if (argument[2] == 'm')
+                options.stressSettings.moons = count;
+            else if (argument[2] == 'a')
+                options.stressSettings.asteroids = count;
+            else
+                options.stressSettings.stars = count;
+            options.stress = true;
+            i++;
+        }
+        else if (std::strcmp(argument, "--unique-models") == 0)
+        {
+            options.stressSettings.uniqueModels = true;
+            options.stress = true;
+        }
+        else if (std::strcmp(argument, "--save-scene") == 0 && value != nullptr)
+        {
+            options.saveScenePath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--import-catalog") == 0 && value != nullptr)
+        {
+            options.importCatalogPath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--headless") == 0)
+        {
+            options.backend = defaultHeadlessBackend();
+            if (value != nullptr)
+            {
+                if (!parseWindowBackend(value, options.backend) || options.backend == BACKEND_WINDOW)
+                {
+                    std::cout << "Unknown headless backend: " << value << std::endl;
+                    printUsage(argv[0]);
+                    return false;
+                }
+                i++;
+            }
+        }
+        else if (std::strcmp(argument, "--frames") == 0 && value != nullptr)
+        {
+            options.frames = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--capture") == 0 && value != nullptr)
+        {
+            options.capturePath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--no-instancing") == 0)
+        {
+            options.instancing = false;
+        }
+        else if (std::strcmp(argument, "--no-gpu-driven") == 0)
+        {
+            options.gpuDriven = false;
+        }
+        else if (std::strcmp(argument, "--no-occlusion") == 0)
+        {
+            options.occlusion = false;
+        }
+        else if (std::strcmp(argument, "--skybox") == 0 && value != nullptr)
+        {
+            options.skyboxSize = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--magnitude") == 0 && value != nullptr)
+        {
+            options.magnitudeLimit = std::strtof(value, nullptr);
+            i++;
+        }
+        else if (std::strcmp(argument, "--galaxy") == 0 && value != nullptr)
+        {
+            options.galaxyPath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--build-galaxy") == 0 && value != nullptr)
+        {
+            options.galaxyStars = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--point-budget") == 0 && value != nullptr)
+        {
+            options.pointBudget = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--galaxy-raster") == 0 && value != nullptr)
+        {
+            if (std::strcmp(value, "points") == 0)
+                options.galaxyRaster = POINT_RASTER_FIXED;
+            else if (std::strcmp(value, "compute") == 0)
+                options.galaxyRaster = POINT_RASTER_COMPUTE;
+            else
+            {
+                std::cout << "Unknown galaxy raster: " << value << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+            i++;
+        }
+        else if (std::strcmp(argument, "--universe") == 0)
+        {
+            options.universe = true;
+        }
+        else if (std::strcmp(argument, "--no-terrain") == 0)
+        {
+            options.terrain = false;
+        }
+        else if (std::strcmp(argument, "--impostor-radius") == 0 && value != nullptr)
+        {
+            options.impostorRadius = std::strtof(value, nullptr);
+            i++;
+        }
+        else if (std::strcmp(argument, "--no-texture-streaming") == 0)
+        {
+            options.textureStreaming = false;
+        }
+        else if (std::strcmp(argument, "--no-texture-compression") == 0)
+        {
+            options.textureCompression = false;
+        }
+        else if (std::strcmp(argument, "--gpu-memory") == 0 && value != nullptr)
+        {
+            options.gpuMemory = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--benchmark") == 0)
+        {
+            options.benchmark = true;
+        }
+        else if (std::strcmp(argument, "--seed") == 0 && value != nullptr)
+        {
+            options.seed = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            i++;
+        }
+        else if (std::strcmp(argument, "--fixed-step") == 0 && value != nullptr)
+        {
+            options.fixedStep = std::strtof(value, nullptr);
+            i++;
+        }
+        else if (std::strcmp(argument, "--camera-path") == 0 && value != nullptr)
+        {
+            options.cameraPath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--report") == 0 && value != nullptr)
+        {
+            options.reportPath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--curve") == 0 && value != nullptr)
+        {
+            options.curvePath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--trace") == 0 && value != nullptr)
+        {
+            options.tracePath = value;
+            i++;
+        }
+        else if (std::strcmp(argument, "--capture-format") == 0 && value != nullptr)
+        {
+            if (std::strcmp(value, "png") == 0)
+                options.captureFormat = CAPTURE_PNG;
+            else if (std::strcmp(value, "raw") == 0)
+                options.captureFormat = CAPTURE_RAW;
+            else
+            {
+                std::cout << "Unknown capture format: " << value << std::endl;
+                printUsage(argv[0]);
+                return false;
+            }
+            i++;
+        }
+        else
+        {
+            std::cout << "Unknown argument: " << argument << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.galaxyStars > 0 && options.galaxyPath.empty())
+    {
+        std::cout << "--build-galaxy needs a --galaxy file to write to" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+
+    // a benchmark or a headless run has nobody to close its window
+    if (options.benchmark && options.frames == 0)
+        options.frames = 1000;
+    if (options.backend != BACKEND_WINDOW && options.frames == 0)
+        options.frames = 100;
+    return true;
+}
@@ -0,0 +1,87 @@
+#include "point_raster.h"
+#include "gpumemory.h"
+#include "stats.h"
+
+#include <cmath>
+#include <vector>
+
+// an empty pixel, every packed point compares less
+static const GLuint EMPTY = 0xFFFFFFFFu;
+
+PointRasterizer::PointRasterizer()
+    : _splatShader("./assets/shaders/compute_points.glsl"),
+      _resolveShader("./assets/shaders/vertex_points_resolve.glsl", "./assets/shaders/fragment_points_resolve.glsl")
+{
+    glGenTextures(1, &_target);
+    glGenVertexArrays(1, &_VAO);
+}
+
+PointRasterizer::~PointRasterizer()
+{
+    glDeleteTextures(1, &_target);
+    glDeleteVertexArrays(1, &_VAO);
+    gpuMemory().release(GPU_MEMORY_RENDER_TARGETS, static_cast<size_t>(_width) * _height * sizeof(GLuint));
+}
+
+void PointRasterizer::begin(const glm::mat4& projection, const glm::mat4& view)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (viewport[2] != _width || viewport[3] != _height)
+    {
+        // only the first frame at a size needs an upload, resolve() leaves the image empty again
+        gpuMemory().release(GPU_MEMORY_RENDER_TARGETS, static_cast<size_t>(_width) * _height * sizeof(GLuint));
+        gpuMemory().allocate(GPU_MEMORY_RENDER_TARGETS, static_cast<size_t>(viewport[2]) * viewport[3] * sizeof(GLuint));
+        _width = viewport[2];
+        _height = viewport[3];
+        std::vector<GLuint> empty(static_cast<size_t>(_width) * _height, EMPTY);
+        glBindTexture(GL_TEXTURE_2D, _target);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, _width, _height, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, empty.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    _projection = projection;
+
+    // the near and far planes of a perspective projection, the depth is packed between them
+    float nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    float farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindImageTexture(0, _target, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    _splatShader.use();
+    _splatShader.setMat4("viewProjection", projection * view);
+    _splatShader.setVec2("size", glm::vec2(static_cast<float>(_width), static_cast<float>(_height)));
+    _splatShader.setFloat("nearPlane", nearPlane);
+    _splatShader.setFloat("depthScale", 1.0f / std::log2(farPlane / nearPlane));
+    _resolveShader.use();
+    _resolveShader.setFloat("nearPlane", nearPlane);
+    _resolveShader.setFloat("depthScale", 1.0f / std::log2(farPlane / nearPlane));
+    _resolveShader.setFloat("projection22", projection[2][2]);
+    _resolveShader.setFloat("projection32", projection[3][2]);
+}
+
+void PointRasterizer::splat(unsigned int buffer, unsigned int count)
+{
+    if (count == 0)
+        return;
+    _splatShader.use();
+    _splatShader.setUint("count", count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffer);
+    _splatShader.dispatch((count + 255) / 256);
+    renderStats().addDraw(0);
+}
+
+void PointRasterizer::resolve()
+{
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // like the GL_POINTS path the points add to what is behind them, but only the planets hide them
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    _resolveShader.use();
+    glBindVertexArray(_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    renderStats().addDraw(1);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
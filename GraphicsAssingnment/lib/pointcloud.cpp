@@ -0,0 +1,423 @@
+#include "pointcloud.h"
+#include "culling.h"
+#include "stats.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <random>
+#include <utility>
+
+// a node deeper than this keeps all of its points, whatever their number (duplicates can't be split)
+static const int MAX_DEPTH = 24;
+// node reads running at once, and nodes uploaded per frame so streaming never stalls a frame for long
+static const unsigned int MAX_IN_FLIGHT = 8;
+static const unsigned int MAX_UPLOADS = 8;
+// a node is refined while its points are farther apart than this many pixels
+static const float MIN_POINT_SPACING = 1.0f;
+
+static const float PI = 3.14159265358979323846f;
+
+static uint32_t packColor(const glm::vec3& color)
+{
+    glm::uvec3 c = glm::uvec3(glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return c.r | (c.g << 8) | (c.b << 16) | (255u << 24);
+}
+
+// one star of the galaxy in its own frame: an old round bulge, and a thin disc whose young stars crowd into
+// logarithmic spiral arms
+static CloudPoint galaxyStar(std::mt19937& random, const GalaxySettings& settings)
+{
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    CloudPoint point;
+    glm::vec3 color;
+    if (uniform(random) < 0.15f) {
+        float scale = 0.12f * settings.radius;
+        point.position = glm::vec3(normal(random) * scale, normal(random) * scale * 0.6f, normal(random) * scale);
+        color = glm::vec3(1.0f, 0.85f, 0.6f);
+    }
+    else {
+        // exponential profile, cut at the edge
+        float radius;
+        do {
+            radius = -settings.radius / 3.5f * std::log(1.0f - uniform(random));
+        } while (radius > settings.radius);
+        float angle;
+        if (settings.arms > 0 && uniform(random) < 0.7f) {
+            // a 12 degree pitch log spiral, stars scattered around it
+            unsigned int arm = static_cast<unsigned int>(uniform(random) * settings.arms) % settings.arms;
+            angle = arm * 2.0f * PI / settings.arms + std::log(std::max(radius, 1.0f) / (0.05f * settings.radius)) / std::tan(12.0f * PI / 180.0f);
+            angle += normal(random) * 0.25f;
+            color = glm::vec3(0.7f, 0.8f, 1.0f);
+        }
+        else {
+            angle = uniform(random) * 2.0f * PI;
+            color = glm::vec3(1.0f, 0.95f, 0.85f);
+        }
+        float height = normal(random) * settings.thickness * (1.0f - 0.5f * radius / settings.radius);
+        point.position = glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle));
+    }
+    point.color = packColor(color * (0.3f + 0.7f * uniform(random)));
+    return point;
+}
+
+bool buildGalaxy(const GalaxySettings& settings, const std::string& path)
+{
+    PROFILE_SCOPE("buildGalaxy");
+    // fixed size chunks with their own seed, so the galaxy doesn't depend on the number of threads
+    const size_t CHUNK = 1 << 20;
+    std::vector<CloudPoint> points(settings.stars);
+    size_t chunks = (points.size() + CHUNK - 1) / CHUNK;
+    jobSystem().parallelFor(0, chunks, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            std::mt19937 random(static_cast<unsigned int>(settings.seed * 7919u + chunk));
+            size_t last = std::min(points.size(), (chunk + 1) * CHUNK);
+            for (size_t i = chunk * CHUNK; i < last; i++) {
+                do {
+                    points[i] = galaxyStar(random, settings);
+                    points[i].position += settings.center;
+                } while (glm::length(points[i].position) < settings.clearRadius);
+            }
+        }
+    });
+    return writePointCloud(points, path);
+}
+
+// The points of a node are [first, first + count). The node keeps the first POINT_CLOUD_NODE_POINTS of them,
+// which are a random sample because the points come in random order and the partitions below don't sort
+// them, and the rest go to the children.
+static int32_t buildNode(std::vector<CloudNode>& nodes, std::vector<CloudPoint>& points, size_t first, size_t count,
+    const glm::vec3& center, float halfSize, int depth)
+{
+    int32_t index = static_cast<int32_t>(nodes.size());
+    CloudNode node;
+    node.center = center;
+    node.halfSize = halfSize;
+    node.firstPoint = static_cast<uint32_t>(first);
+    node.pointCount = static_cast<uint32_t>(std::min<size_t>(count, POINT_CLOUD_NODE_POINTS));
+    std::fill(node.children, node.children + 8, -1);
+    if (count <= POINT_CLOUD_NODE_POINTS || depth >= MAX_DEPTH)
+        node.pointCount = static_cast<uint32_t>(count);
+    nodes.push_back(node);
+    if (node.pointCount == count)
+        return index;
+
+    // eight octants from three rounds of partitioning: x, y within each x half, z within each quarter.
+    // The ranges come out in the order of the octant index, x the high bit and z the low one.
+    typedef std::vector<CloudPoint>::iterator Iterator;
+    Iterator bounds[9];
+    bounds[0] = points.begin() + first + node.pointCount;
+    bounds[8] = points.begin() + first + count;
+    bounds[4] = std::partition(bounds[0], bounds[8], [&](const CloudPoint& p) { return p.position.x < center.x; });
+    for (int x = 0; x < 8; x += 4)
+        bounds[x + 2] = std::partition(bounds[x], bounds[x + 4], [&](const CloudPoint& p) { return p.position.y < center.y; });
+    for (int xy = 0; xy < 8; xy += 2)
+        bounds[xy + 1] = std::partition(bounds[xy], bounds[xy + 2], [&](const CloudPoint& p) { return p.position.z < center.z; });
+
+    for (int octant = 0; octant < 8; octant++) {
+        if (bounds[octant] == bounds[octant + 1])
+            continue;
+        glm::vec3 offset((octant & 4) ? 0.5f : -0.5f, (octant & 2) ? 0.5f : -0.5f, (octant & 1) ? 0.5f : -0.5f);
+        int32_t child = buildNode(nodes, points, static_cast<size_t>(bounds[octant] - points.begin()), static_cast<size_t>(bounds[octant + 1] - bounds[octant]),
+            center + offset * halfSize, halfSize * 0.5f, depth + 1);
+        nodes[index].children[octant] = child;
+    }
+    return index;
+}
+
+bool writePointCloud(std::vector<CloudPoint>& points, const std::string& path)
+{
+    PROFILE_SCOPE("writePointCloud");
+    if (points.empty() || points.size() > UINT32_MAX)
+    {
+        std::cout << "ERROR::POINT_CLOUD::INVALID_POINT_COUNT: " << points.size() << std::endl;
+        return false;
+    }
+    glm::vec3 min(points[0].position), max(points[0].position);
+    for (auto& point : points)
+    {
+        min = glm::min(min, point.position);
+        max = glm::max(max, point.position);
+    }
+    glm::vec3 extent = max - min;
+    float halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z)) * 1.001f + 1e-3f;
+
+    std::vector<CloudNode> nodes;
+    buildNode(nodes, points, 0, points.size(), 0.5f * (min + max), halfSize, 0);
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::POINT_CLOUD::FILE_NOT_OPENED: " << path << std::endl;
+        return false;
+    }
+    PointCloudHeader header = { { 'P', 'C', 'L', 'D' }, POINT_CLOUD_VERSION, static_cast<uint32_t>(nodes.size()), static_cast<uint32_t>(points.size()) };
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(nodes.data(), sizeof(CloudNode), nodes.size(), file) == nodes.size() &&
+        std::fwrite(points.data(), sizeof(CloudPoint), points.size(), file) == points.size();
+    std::fclose(file);
+    if (!written)
+    {
+        std::cout << "ERROR::POINT_CLOUD::WRITE_FAILED: " << path << std::endl;
+        return false;
+    }
+    std::printf("Point cloud %s: %u points in %u nodes\n", path.c_str(), header.pointCount, header.nodeCount);
+    return true;
+}
+
+PointCloud::PointCloud()
+    : _shader("./assets/shaders/vertex_points.glsl", "./assets/shaders/fragment_points.glsl")
+{
+    glGenVertexArrays(1, &_VAO);
+    gpuMemory().addCache(this);
+}
+
+PointCloud::~PointCloud()
+{
+    // the jobs write into this object
+    for (auto& job : _jobs)
+        jobSystem().wait(job);
+    for (auto& state : _state)
+    {
+        if (state.buffer != 0)
+            glDeleteBuffers(1, &state.buffer);
+    }
+    glDeleteVertexArrays(1, &_VAO);
+    gpuMemory().removeCache(this);
+    gpuMemory().release(GPU_MEMORY_POINT_CLOUD, _residentBytes);
+}
+
+bool PointCloud::open(const std::string& path, size_t memoryBudget)
+{
+    std::ifstream file(path, std::ios::binary);
+    PointCloudHeader header;
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        std::cout << "ERROR::POINT_CLOUD::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    if (std::memcmp(header.magic, "PCLD", 4) != 0 || header.version != POINT_CLOUD_VERSION || header.nodeCount == 0)
+    {
+        std::cout << "ERROR::POINT_CLOUD::INVALID_FILE: " << path << std::endl;
+        return false;
+    }
+    _nodes.resize(header.nodeCount);
+    if (!file.read(reinterpret_cast<char*>(_nodes.data()), header.nodeCount * sizeof(CloudNode)))
+    {
+        std::cout << "ERROR::POINT_CLOUD::INVALID_FILE: " << path << std::endl;
+        _nodes.clear();
+        return false;
+    }
+
+    _path = path;
+    _pointsOffset = sizeof(header) + header.nodeCount * sizeof(CloudNode);
+    _memoryBudget = memoryBudget;
+    _state.assign(_nodes.size(), Node());
+    std::printf("Point cloud %s: %u points in %u nodes\n", path.c_str(), header.pointCount, header.nodeCount);
+    return true;
+}
+
+void PointCloud::request(unsigned int node)
+{
+    _state[node].state = NODE_REQUESTED;
+    _inFlight++;
+    std::string path = _path;
+    size_t offset = _pointsOffset + static_cast<size_t>(_nodes[node].firstPoint) * sizeof(CloudPoint);
+    size_t count = _nodes[node].pointCount;
+    auto load = [this, node, path, offset, count]() {
+        LoadedNode loaded;
+        loaded.node = node;
+        loaded.points.resize(count);
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(offset));
+        if (!file.read(reinterpret_cast<char*>(loaded.points.data()), count * sizeof(CloudPoint)))
+        {
+            std::cout << "ERROR::POINT_CLOUD::NODE_NOT_READ: " << path << " node " << node << std::endl;
+            loaded.points.clear();
+        }
+        std::lock_guard<std::mutex> lock(_loadedLock);
+        _loaded.push_back(std::move(loaded));
+    };
+    if (JobHandle job = jobSystem().runOrInline(load))
+        _jobs.push_back(job);
+}
+
+void PointCloud::upload()
+{
+    std::vector<LoadedNode> loaded;
+    {
+        std::lock_guard<std::mutex> lock(_loadedLock);
+        size_t count = std::min<size_t>(_loaded.size(), MAX_UPLOADS);
+        loaded.assign(std::make_move_iterator(_loaded.begin()), std::make_move_iterator(_loaded.begin() + count));
+        _loaded.erase(_loaded.begin(), _loaded.begin() + count);
+    }
+    for (auto& node : loaded)
+    {
+        Node& state = _state[node.node];
+        _inFlight--;
+        if (node.points.empty())
+        {
+            // a failed read is retried when the node is wanted again
+            state.state = NODE_ON_DISK;
+            continue;
+        }
+        glGenBuffers(1, &state.buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, state.buffer);
+        glBufferData(GL_ARRAY_BUFFER, node.points.size() * sizeof(CloudPoint), node.points.data(), GL_STATIC_DRAW);
+        state.state = NODE_RESIDENT;
+        state.lastFrame = gpuMemory().frame();
+        _recent.push_front(node.node);
+        state.recent = _recent.begin();
+        _residentBytes += node.points.size() * sizeof(CloudPoint);
+        gpuMemory().allocate(GPU_MEMORY_POINT_CLOUD, node.points.size() * sizeof(CloudPoint));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PointCloud::evict()
+{
+    while (_residentBytes > _memoryBudget && !_recent.empty())
+    {
+        // everything left is drawn this frame, the budget is too small for the point budget
+        if (_state[_recent.back()].lastFrame == gpuMemory().frame())
+            break;
+        evictOldest();
+    }
+}
+
+bool PointCloud::oldest(unsigned int& frame) const
+{
+    if (_recent.empty())
+        return false;
+    frame = _state[_recent.back()].lastFrame;
+    return true;
+}
+
+void PointCloud::evictOldest()
+{
+    unsigned int node = _recent.back();
+    Node& state = _state[node];
+    glDeleteBuffers(1, &state.buffer);
+    state.buffer = 0;
+    state.state = NODE_ON_DISK;
+    size_t bytes = static_cast<size_t>(_nodes[node].pointCount) * sizeof(CloudPoint);
+    _residentBytes -= bytes;
+    gpuMemory().release(GPU_MEMORY_POINT_CLOUD, bytes);
+    _recent.pop_back();
+}
+
+void PointCloud::update(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, float viewportHeight, size_t pointBudget)
+{
+    PROFILE_SCOPE("PointCloud::update");
+    _jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(), [](const JobHandle& job) { return job->finished.load(); }), _jobs.end());
+    upload();
+
+    _selected.clear();
+    _drawnPoints = 0;
+    if (_nodes.empty())
+        return;
+
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    // pixels covered by one unit at distance one
+    float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    auto screenSpacing = [&](unsigned int index) {
+        const CloudNode& node = _nodes[index];
+        float spacing = 2.0f * node.halfSize / std::cbrt(static_cast<float>(std::max(node.pointCount, 1u)));
+        float distance = std::max(glm::length(node.center - cameraPosition) - node.halfSize * 1.7320508f, 1e-3f);
+        return spacing * pixelsPerUnit / distance;
+    };
+
+    // the nodes whose points are farthest apart on screen are refined first
+    std::priority_queue<std::pair<float, unsigned int>> queue;
+    queue.push(std::make_pair(std::numeric_limits<float>::max(), 0u));
+    while (!queue.empty())
+    {
+        unsigned int index = queue.top().second;
+        queue.pop();
+        const CloudNode& node = _nodes[index];
+        if (!frustum.intersectsSphere(node.center, node.halfSize * 1.7320508f))
+            continue;
+        if (_drawnPoints + node.pointCount > pointBudget)
+            break;
+
+        Node& state = _state[index];
+        if (state.state != NODE_RESIDENT)
+        {
+            // its children only add detail to it, they wait until it is in
+            if (state.state == NODE_ON_DISK && _inFlight < MAX_IN_FLIGHT && gpuMemory().makeRoom(node.pointCount * sizeof(CloudPoint)))
+                request(index);
+            continue;
+        }
+        _selected.push_back(index);
+        _drawnPoints += node.pointCount;
+        state.lastFrame = gpuMemory().frame();
+        _recent.splice(_recent.begin(), _recent, state.recent);
+
+        for (int32_t child : node.children)
+        {
+            if (child < 0)
+                continue;
+            float spacing = screenSpacing(static_cast<unsigned int>(child));
+            if (spacing > MIN_POINT_SPACING)
+                queue.push(std::make_pair(spacing, static_cast<unsigned int>(child)));
+        }
+    }
+    evict();
+}
+
+void PointCloud::draw(const glm::mat4& projection, const glm::mat4& view)
+{
+    if (_selected.empty())
+        return;
+
+    if (_rasterMode == POINT_RASTER_COMPUTE)
+    {
+        _rasterizer->begin(projection, view);
+        for (unsigned int index : _selected)
+            _rasterizer->splat(_state[index].buffer, _nodes[index].pointCount);
+        _rasterizer->resolve();
+        return;
+    }
+
+    // the points add up instead of hiding each other, and only the planets hide them
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    _shader.use();
+    _shader.setMat4("projection", projection);
+    _shader.setMat4("view", view);
+    glBindVertexArray(_VAO);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    for (unsigned int index : _selected)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _state[index].buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CloudPoint), (void*)0);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CloudPoint), (void*)sizeof(glm::vec3));
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(_nodes[index].pointCount));
+        renderStats().addDraw(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+}
+
+void PointCloud::setRasterMode(PointRasterMode mode)
+{
+    if (mode == POINT_RASTER_COMPUTE && !hasGL43())
+    {
+        std::cout << "ERROR::POINT_CLOUD::COMPUTE_RASTER_UNSUPPORTED: needs OpenGL 4.3, drawing GL_POINTS" << std::endl;
+        mode = POINT_RASTER_FIXED;
+    }
+    if (mode == POINT_RASTER_COMPUTE && !_rasterizer)
+        _rasterizer.reset(new PointRasterizer());
+    _rasterMode = mode;
+}
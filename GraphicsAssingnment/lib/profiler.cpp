@@ -0,0 +1,237 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <thread>
+
+// frames kept in the rolling history
+static const size_t HISTORY_LENGTH = 300;
+// the trace stops growing after this many events so long runs don't eat all memory
+static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+static thread_local int scopeDepth = 0;
+static thread_local unsigned int traceThread = 0;
+
+static int64_t steadyMicroseconds()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler() : _epoch(steadyMicroseconds()), _mainThreadId(std::this_thread::get_id())
+{
+    _threadNames.push_back("GPU");
+    _threadNames.push_back("Main");
+}
+
+int64_t Profiler::now() const
+{
+    return steadyMicroseconds() - _epoch;
+}
+
+unsigned int Profiler::threadIndex()
+{
+    // 0 is the GPU and 1 the thread that created the profiler, the others are numbered on first use
+    if (traceThread == 0)
+    {
+        if (std::this_thread::get_id() == _mainThreadId)
+            traceThread = 1;
+        else
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            traceThread = static_cast<unsigned int>(_threadNames.size());
+            _threadNames.push_back("Worker " + std::to_string(traceThread - 1));
+        }
+    }
+    return traceThread;
+}
+
+void Profiler::addEvent(const TraceEvent& event)
+{
+    if (_events.size() < MAX_TRACE_EVENTS)
+        _events.push_back(event);
+}
+
+void Profiler::initGpu()
+{
+    _gpuReady = true;
+}
+
+void Profiler::beginFrame()
+{
+    threadIndex();
+    _frameStart = now();
+    _current = FrameTiming();
+    _current.frame = _frame;
+
+    if (!_gpuReady)
+        return;
+    // this slot was last used two frames ago, its queries have certainly completed by now
+    GpuFrame& slot = _gpuFrames[_frame % 2];
+    if (slot.pending)
+        resolveGpu(slot);
+    slot.frame = _frame;
+    slot.used = 0;
+    slot.scopes.clear();
+    slot.open.clear();
+
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    slot.clockOffset = now() - gpuTime / 1000;
+}
+
+void Profiler::endFrame()
+{
+    int64_t end = now();
+    _current.cpuMs = (end - _frameStart) / 1000.0f;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        addEvent({ "Frame", _frameStart, end - _frameStart, threadIndex() });
+        _history.push_back(_current);
+        if (_history.size() > HISTORY_LENGTH)
+            _history.pop_front();
+    }
+    if (_gpuReady)
+        _gpuFrames[_frame % 2].pending = true;
+    _frame++;
+}
+
+void Profiler::recordCpu(const char* name, int64_t startUs, int64_t durationUs, bool topLevel)
+{
+    unsigned int thread = threadIndex();
+    std::lock_guard<std::mutex> lock(_lock);
+    addEvent({ name, startUs, durationUs, thread });
+    if (topLevel && thread == 1)
+        _current.phases.push_back(std::make_pair(name, durationUs / 1000.0f));
+}
+
+void Profiler::beginGpu(const char* name)
+{
+    if (!_gpuReady)
+        return;
+    GpuFrame& slot = _gpuFrames[_frame % 2];
+    // every scope needs two queries, the pool grows on demand and is reused afterwards
+    while (slot.queries.size() < slot.used + 2)
+    {
+        unsigned int query;
+        glGenQueries(1, &query);
+        slot.queries.push_back(query);
+    }
+    GpuRange scope = { name, slot.used, slot.used + 1, static_cast<int>(slot.open.size()) };
+    slot.used += 2;
+    glQueryCounter(slot.queries[scope.begin], GL_TIMESTAMP);
+    slot.open.push_back(slot.scopes.size());
+    slot.scopes.push_back(scope);
+}
+
+void Profiler::endGpu()
+{
+    if (!_gpuReady)
+        return;
+    GpuFrame& slot = _gpuFrames[_frame % 2];
+    if (slot.open.empty())
+        return;
+    GpuRange& scope = slot.scopes[slot.open.back()];
+    slot.open.pop_back();
+    glQueryCounter(slot.queries[scope.end], GL_TIMESTAMP);
+}
+
+void Profiler::resolveGpu(GpuFrame& slot)
+{
+    slot.pending = false;
+    float frameGpuMs = 0.0f;
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto& scope : slot.scopes)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[scope.end], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(slot.queries[scope.begin], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot.queries[scope.end], GL_QUERY_RESULT, &end);
+        int64_t start = static_cast<int64_t>(begin / 1000) + slot.clockOffset;
+        int64_t duration = static_cast<int64_t>((end - begin) / 1000);
+        addEvent({ scope.name, start, duration, 0 });
+        if (scope.depth == 0)
+            frameGpuMs += (end - begin) / 1000000.0f;
+    }
+    for (auto& timing : _history)
+    {
+        if (timing.frame == slot.frame)
+            timing.gpuMs = frameGpuMs;
+    }
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::PROFILER::FILE_NOT_OPENED: " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < _threadNames.size(); i++)
+    {
+        std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", static_cast<unsigned int>(i), _threadNames[i].c_str());
+        first = false;
+    }
+    for (auto& event : _events)
+    {
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld}",
+            event.name, event.thread, static_cast<long long>(event.start), static_cast<long long>(event.duration));
+    }
+    std::fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    std::fclose(file);
+    std::cout << "Wrote " << _events.size() << " trace events to " << path << std::endl;
+    return true;
+}
+
+void Profiler::printSummary() const
+{
+    if (_history.empty())
+        return;
+
+    // averages over the rolling history, phases in the order they first appeared
+    std::vector<const char*> order;
+    std::map<std::string, float> totals;
+    float cpu = 0.0f, gpu = 0.0f;
+    for (auto& timing : _history)
+    {
+        cpu += timing.cpuMs;
+        gpu += timing.gpuMs;
+        for (auto& phase : timing.phases)
+        {
+            if (totals.find(phase.first) == totals.end())
+                order.push_back(phase.first);
+            totals[phase.first] += phase.second;
+        }
+    }
+    float count = static_cast<float>(_history.size());
+    std::printf("Last %u frames: cpu %.3f ms, gpu %.3f ms\n", static_cast<unsigned int>(_history.size()), cpu / count, gpu / count);
+    for (auto name : order)
+        std::printf("  %-12s %.3f ms\n", name, totals[name] / count);
+}
+
+Profiler& profiler()
+{
+    static Profiler instance;
+    return instance;
+}
+
+CpuScope::CpuScope(const char* name) : _name(name), _start(profiler().now())
+{
+    scopeDepth++;
+}
+
+CpuScope::~CpuScope()
+{
+    scopeDepth--;
+    profiler().recordCpu(_name, _start, profiler().now() - _start, scopeDepth == 0);
+}
@@ -0,0 +1,73 @@
+#include "resources.h"
+
+ModelLibrary::ModelLibrary()
+{
+    gpuMemory().addCache(this);
+}
+
+ModelLibrary::~ModelLibrary()
+{
+    gpuMemory().removeCache(this);
+}
+
+ModelHandle ModelLibrary::load(const std::string& path, bool unique, bool textures)
+{
+    if (!unique)
+    {
+        auto found = _byPath.find(std::make_pair(path, textures));
+        if (found != _byPath.end())
+            return found->second;
+    }
+
+    // a deque never moves its elements, loadAsync needs the model to stay where it is
+    ModelHandle handle = static_cast<ModelHandle>(_models.size());
+    _models.emplace_back();
+    _models.back().streamer = _streamer;
+    _models.back().compressTextures = _compressTextures;
+    _models.back().loadTextures = textures;
+    _loading.push_back(_models.back().loadAsync(path));
+    if (!unique)
+        _byPath[std::make_pair(path, textures)] = handle;
+    return handle;
+}
+
+void ModelLibrary::wait()
+{
+    for (auto& load : _loading)
+        jobSystem().wait(load);
+    _loading.clear();
+}
+
+void ModelLibrary::addTextures(ModelHandle handle, const std::vector<Texture>& textures)
+{
+    for (auto& mesh : _models[handle].meshes)
+        mesh.textures.insert(mesh.textures.end(), textures.begin(), textures.end());
+}
+
+ModelHandle ModelLibrary::leastRecentlyDrawn() const
+{
+    ModelHandle oldest = INVALID_MODEL;
+    for (ModelHandle handle = 0; handle < _models.size(); handle++)
+    {
+        const Model& model = _models[handle];
+        if (model.resident() && model.lastDrawn < gpuMemory().frame() && (oldest == INVALID_MODEL || model.lastDrawn < _models[oldest].lastDrawn))
+            oldest = handle;
+    }
+    return oldest;
+}
+
+bool ModelLibrary::oldest(unsigned int& frame) const
+{
+    ModelHandle handle = leastRecentlyDrawn();
+    if (handle == INVALID_MODEL)
+        return false;
+    frame = _models[handle].lastDrawn;
+    return true;
+}
+
+void ModelLibrary::evictOldest()
+{
+    ModelHandle handle = leastRecentlyDrawn();
+    if (handle != INVALID_MODEL)
+        _models[handle].release();
+}
@@ -0,0 +1,621 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+// A pull parser over the whole file in memory. The scene loader walks the document with it and fills
+// its structures directly, no tree of values is built, which keeps scenes with tens of thousands of
+// bodies in the milliseconds. The first error stops every further read.
+class JsonReader {
+public:
+    JsonReader(const char* begin, const char* end) : _cursor(begin), _end(end) {}
+
+    bool failed() const { return !_error.empty(); }
+    const std::string& error() const { return _error; }
+    unsigned int line() const { return _line; }
+
+    void fail(const std::string& message)
+    {
+        if (_error.empty())
+            _error = message;
+        _cursor = _end;
+    }
+
+    char peek()
+    {
+        skipWhitespace();
+        return _cursor < _end ? *_cursor : '\0';
+    }
+
+    bool beginObject() { return _first = expect('{'); }
+    bool beginArray() { return _first = expect('['); }
+
+    // reads the key of the next member of an object, false once the closing brace is consumed
+    bool nextMember(std::string& key)
+    {
+        if (!nextItem('}'))
+            return false;
+        readString(key);
+        expect(':');
+        return !failed();
+    }
+
+    // moves to the next element of an array, false once the closing bracket is consumed
+    bool nextElement()
+    {
+        return nextItem(']');
+    }
+
+    // plain decimal numbers are parsed by hand, strtof goes through the locale and is several times slower
+    float readNumber()
+    {
+        skipWhitespace();
+        const char* start = _cursor;
+        bool negative = _cursor < _end && *_cursor == '-';
+        if (negative)
+            _cursor++;
+        double value = 0.0;
+        int digits = 0;
+        while (_cursor < _end && *_cursor >= '0' && *_cursor <= '9')
+        {
+            value = value * 10.0 + (*_cursor++ - '0');
+            digits++;
+        }
+        if (_cursor < _end && *_cursor == '.')
+        {
+            _cursor++;
+            double scale = 0.1;
+            while (_cursor < _end && *_cursor >= '0' && *_cursor <= '9')
+            {
+                value += (*_cursor++ - '0') * scale;
+                scale *= 0.1;
+                digits++;
+            }
+        }
+        if (_cursor < _end && (*_cursor == 'e' || *_cursor == 'E'))
+        {
+            // the file buffer ends with a '\0', so strtof can't run past it
+            char* end = nullptr;
+            float exact = std::strtof(start, &end);
+            _cursor = end;
+            return exact;
+        }
+        if (digits == 0)
+        {
+            fail("expected a number");
+            return 0.0f;
+        }
+        return static_cast<float>(negative ? -value : value);
+    }
+
+    void readString(std::string& value)
+    {
+        value.clear();
+        if (!expect('"'))
+            return;
+        while (_cursor < _end && *_cursor != '"')
+        {
+            // copy the run up to the next quote, escape or line break in one go
+            const char* run = _cursor;
+            while (_cursor < _end && *_cursor != '"' && *_cursor != '\\' && *_cursor != '\n')
+                _cursor++;
+            value.append(run, _cursor);
+            if (_cursor >= _end || *_cursor == '"')
+                break;
+
+            char c = *_cursor++;
+            if (c == '\\' && _cursor < _end)
+            {
+                char escaped = *_cursor++;
+                switch (escaped)
+                {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': c = '?'; _cursor += std::min<ptrdiff_t>(4, _end - _cursor); break;
+                default: c = escaped; break;
+                }
+            }
+            else if (c == '\n')
+                _line++;
+            value.push_back(c);
+        }
+        if (_cursor >= _end)
+        {
+            fail("unterminated string");
+            return;
+        }
+        _cursor++;
+    }
+
+    std::string readString()
+    {
+        std::string value;
+        readString(value);
+        return value;
+    }
+
+    bool readBool()
+    {
+        char c = peek();
+        const char* word = c == 't' ? "true" : "false";
+        size_t length = c == 't' ? 4 : 5;
+        if (static_cast<size_t>(_end - _cursor) < length || std::string(_cursor, length) != word)
+        {
+            fail("expected true or false");
+            return false;
+        }
+        _cursor += length;
+        return c == 't';
+    }
+
+    glm::vec3 readVec3()
+    {
+        glm::vec3 value(0.0f);
+        beginArray();
+        for (int i = 0; nextElement(); i++)
+        {
+            float component = readNumber();
+            if (i < 3)
+                value[i] = component;
+        }
+        return value;
+    }
+
+    // skips whatever value comes next, used for members the loader doesn't know
+    void skipValue()
+    {
+        char c = peek();
+        if (c == '{')
+        {
+            beginObject();
+            std::string key;
+            while (nextMember(key))
+                skipValue();
+        }
+        else if (c == '[')
+        {
+            beginArray();
+            while (nextElement())
+                skipValue();
+        }
+        else if (c == '"')
+            readString();
+        else if (c == 't' || c == 'f' || c == 'n')
+        {
+            while (_cursor < _end && *_cursor >= 'a' && *_cursor <= 'z')
+                _cursor++;
+        }
+        else
+            readNumber();
+    }
+
+private:
+    void skipWhitespace()
+    {
+        while (_cursor < _end && (*_cursor == ' ' || *_cursor == '\t' || *_cursor == '\n' || *_cursor == '\r'))
+        {
+            if (*_cursor == '\n')
+                _line++;
+            _cursor++;
+        }
+    }
+
+    bool expect(char c)
+    {
+        if (peek() != c)
+        {
+            fail(std::string("expected '") + c + "'");
+            return false;
+        }
+        _cursor++;
+        return true;
+    }
+
+    // handles the commas between items and the closing character
+    bool nextItem(char close)
+    {
+        if (failed())
+            return false;
+        char c = peek();
+        if (c == close)
+        {
+            _cursor++;
+            _first = false;
+            return false;
+        }
+        if (!_first)
+        {
+            if (c != ',')
+            {
+                fail(std::string("expected ',' or '") + close + "'");
+                return false;
+            }
+            _cursor++;
+        }
+        _first = false;
+        return true;
+    }
+
+    const char* _cursor;
+    const char* _end;
+    unsigned int _line = 1;
+    // set right after an opening bracket, the first item isn't preceded by a comma
+    bool _first = false;
+    std::string _error;
+};
+
+std::vector<SceneMotion> SceneDescription::motionChain(size_t body) const
+{
+    std::vector<int> lineage;
+    for (int i = static_cast<int>(body); i >= 0; i = bodies[i].parent)
+        lineage.push_back(i);
+
+    std::vector<SceneMotion> chain;
+    for (auto it = lineage.rbegin(); it != lineage.rend(); ++it)
+        chain.insert(chain.end(), bodies[*it].orbits.begin(), bodies[*it].orbits.end());
+    if (bodies[body].spin != 0.0f)
+        chain.push_back({ 0.0f, bodies[body].spin, 0.0f });
+    return chain;
+}
+
+static void readBody(JsonReader& json, SceneDescription& scene, std::unordered_map<std::string, unsigned int>& bodyIndex,
+    const std::unordered_map<std::string, unsigned int>& modelIndex, const std::unordered_map<std::string, unsigned int>& shaderIndex)
+{
+    SceneBody body;
+    bool hasModel = false, hasShader = false;
+    std::string key, value;
+    json.beginObject();
+    while (json.nextMember(key))
+    {
+        if (key == "name")
+            json.readString(body.name);
+        else if (key == "model" || key == "shader" || key == "parent")
+        {
+            json.readString(value);
+            const std::unordered_map<std::string, unsigned int>& names = key == "model" ? modelIndex : key == "shader" ? shaderIndex : bodyIndex;
+            auto found = names.find(value);
+            if (found == names.end())
+            {
+                json.fail("unknown " + key + " '" + value + "'");
+                return;
+            }
+            if (key == "model")
+            {
+                body.model = found->second;
+                hasModel = true;
+            }
+            else if (key == "shader")
+            {
+                body.shader = found->second;
+                hasShader = true;
+            }
+            else
+                body.parent = static_cast<int>(found->second);
+        }
+        else if (key == "scale")
+            body.scale = json.peek() == '[' ? json.readVec3() : glm::vec3(json.readNumber());
+        else if (key == "orbits")
+        {
+            json.beginArray();
+            while (json.nextElement())
+            {
+                SceneMotion orbit = { 0.0f, 1.0f, 0.0f };
+                json.beginArray();
+                for (int i = 0; json.nextElement(); i++)
+                {
+                    float number = json.readNumber();
+                    if (i == 0)
+                        orbit.radius = number;
+                    else if (i == 1)
+                        orbit.period = number;
+                    else if (i == 2)
+                        orbit.phase = number;
+                }
+                body.orbits.push_back(orbit);
+            }
+        }
+        else if (key == "spin")
+            body.spin = json.readNumber();
+        else if (key == "hidden")
+            body.hidden = json.readBool();
+        else if (key == "terrain")
+        {
+            std::string member;
+            json.beginObject();
+            while (json.nextMember(member))
+            {
+                if (member == "height")
+                    json.readString(body.terrainHeight);
+                else if (member == "color")
+                    json.readString(body.terrainColor);
+                else if (member == "relief")
+                    body.terrainRelief = json.readNumber();
+                else
+                    json.skipValue();
+            }
+        }
+        else
+            json.skipValue();
+    }
+    if (json.failed())
+        return;
+    if (!hasModel || !hasShader)
+    {
+        json.fail("body '" + body.name + "' needs a model and a shader");
+        return;
+    }
+
+    if (!body.name.empty())
+        bodyIndex[body.name] = static_cast<unsigned int>(scene.bodies.size());
+    scene.bodies.push_back(std::move(body));
+}
+
+bool loadScene(const std::string& path, SceneDescription& scene)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::SCENE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::string text(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0, std::ios::beg);
+    file.read(&text[0], text.size());
+
+    scene = SceneDescription();
+    std::unordered_map<std::string, unsigned int> shaderIndex, modelIndex, bodyIndex;
+    JsonReader json(text.c_str(), text.c_str() + text.size());
+    std::string key;
+    json.beginObject();
+    while (json.nextMember(key))
+    {
+        if (key == "stars")
+        {
+            std::string member;
+            json.beginObject();
+            while (json.nextMember(member))
+            {
+                if (member == "count")
+                    scene.starCount = static_cast<unsigned int>(json.readNumber());
+                else if (member == "radius")
+                    scene.starRadius = json.readNumber();
+                else if (member == "catalog")
+                    json.readString(scene.starCatalog);
+                else
+                    json.skipValue();
+            }
+        }
+        else if (key == "light")
+            scene.light = json.readVec3();
+        else if (key == "shaders")
+        {
+            SceneShader shader;
+            json.beginObject();
+            while (json.nextMember(shader.name))
+            {
+                std::string member;
+                json.beginObject();
+                while (json.nextMember(member))
+                {
+                    if (member == "vertex")
+                        json.readString(shader.vertex);
+                    else if (member == "fragment")
+                        json.readString(shader.fragment);
+                    else
+                        json.skipValue();
+                }
+                shaderIndex[shader.name] = static_cast<unsigned int>(scene.shaders.size());
+                scene.shaders.push_back(shader);
+            }
+        }
+        else if (key == "models")
+        {
+            SceneModel model;
+            json.beginObject();
+            while (json.nextMember(model.name))
+            {
+                model.unique = false;
+                model.layers = SceneLayers();
+                if (json.peek() == '{')
+                {
+                    std::string member;
+                    json.beginObject();
+                    while (json.nextMember(member))
+                    {
+                        if (member == "path")
+                            json.readString(model.path);
+                        else if (member == "unique")
+                            model.unique = json.readBool();
+                        else if (member == "layers")
+                        {
+                            std::string layer;
+                            json.beginObject();
+                            while (json.nextMember(layer))
+                            {
+                                if (layer == "color")
+                                    json.readString(model.layers.color);
+                                else if (layer == "ocean")
+                                    json.readString(model.layers.ocean);
+                                else if (layer == "clouds")
+                                    json.readString(model.layers.clouds);
+                                else if (layer == "night")
+                                    json.readString(model.layers.night);
+                                else if (layer == "height")
+                                    json.readString(model.layers.height);
+                                else
+                                    json.skipValue();
+                            }
+                        }
+                        else
+                            json.skipValue();
+                    }
+                }
+                else
+                    json.readString(model.path);
+                modelIndex[model.name] = static_cast<unsigned int>(scene.models.size());
+                scene.models.push_back(model);
+            }
+        }
+        else if (key == "bodies")
+        {
+            json.beginArray();
+            while (json.nextElement())
+                readBody(json, scene, bodyIndex, modelIndex, shaderIndex);
+        }
+        else
+            json.skipValue();
+    }
+
+    if (json.failed())
+    {
+        std::cout << "ERROR::SCENE::PARSE_FAILED: " << path << ":" << json.line() << ": " << json.error() << std::endl;
+        return false;
+    }
+    float milliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("Scene %s: %u bodies, %u models, %u stars, parsed in %.2f ms\n", path.c_str(),
+        static_cast<unsigned int>(scene.bodies.size()), static_cast<unsigned int>(scene.models.size()), scene.starCount, milliseconds);
+    return true;
+}
+
+// JSON strings only need quotes, backslashes and control characters escaped
+static void writeString(std::FILE* file, const std::string& value)
+{
+    std::fputc('"', file);
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+            std::fputc('\\', file);
+        if (c == '\n')
+            std::fputs("\\n", file);
+        else if (c == '\t')
+            std::fputs("\\t", file);
+        else
+            std::fputc(c, file);
+    }
+    std::fputc('"', file);
+}
+
+bool saveScene(const std::string& path, const SceneDescription& scene)
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        std::cout << "ERROR::SCENE::FILE_NOT_OPENED: " << path << std::endl;
+        return false;
+    }
+
+    std::fprintf(file, "{\n    \"stars\": { \"count\": %u, \"radius\": %g", scene.starCount, scene.starRadius);
+    if (!scene.starCatalog.empty())
+    {
+        std::fprintf(file, ", \"catalog\": ");
+        writeString(file, scene.starCatalog);
+    }
+    std::fprintf(file, " },\n");
+    std::fprintf(file, "    \"light\": [%g, %g, %g],\n", scene.light.x, scene.light.y, scene.light.z);
+    std::fprintf(file, "    \"shaders\": {");
+    for (size_t i = 0; i < scene.shaders.size(); i++)
+    {
+        std::fprintf(file, "%s\n        ", i > 0 ? "," : "");
+        writeString(file, scene.shaders[i].name);
+        std::fprintf(file, ": { \"vertex\": ");
+        writeString(file, scene.shaders[i].vertex);
+        std::fprintf(file, ", \"fragment\": ");
+        writeString(file, scene.shaders[i].fragment);
+        std::fprintf(file, " }");
+    }
+    std::fprintf(file, "\n    },\n    \"models\": {");
+    for (size_t i = 0; i < scene.models.size(); i++)
+    {
+        std::fprintf(file, "%s\n        ", i > 0 ? "," : "");
+        writeString(file, scene.models[i].name);
+        const SceneLayers& layers = scene.models[i].layers;
+        if (scene.models[i].unique || !layers.color.empty())
+        {
+            std::fprintf(file, ": { \"path\": ");
+            writeString(file, scene.models[i].path);
+            if (scene.models[i].unique)
+                std::fprintf(file, ", \"unique\": true");
+            if (!layers.color.empty())
+            {
+                // the masks that are missing are left out
+                const char* names[] = { "color", "ocean", "clouds", "night", "height" };
+                const std::string* paths[] = { &layers.color, &layers.ocean, &layers.clouds, &layers.night, &layers.height };
+                std::fprintf(file, ", \"layers\": {");
+                bool first = true;
+                for (int layer = 0; layer < 5; layer++)
+                {
+                    if (paths[layer]->empty())
+                        continue;
+                    std::fprintf(file, "%s \"%s\": ", first ? "" : ",", names[layer]);
+                    writeString(file, *paths[layer]);
+                    first = false;
+                }
+                std::fprintf(file, " }");
+            }
+            std::fprintf(file, " }");
+        }
+        else
+        {
+            std::fprintf(file, ": ");
+            writeString(file, scene.models[i].path);
+        }
+    }
+    std::fprintf(file, "\n    },\n    \"bodies\": [");
+    for (size_t i = 0; i < scene.bodies.size(); i++)
+    {
+        const SceneBody& body = scene.bodies[i];
+        std::fprintf(file, "%s\n        { \"name\": ", i > 0 ? "," : "");
+        // references are by name, unnamed bodies get one so their children can point at them
+        writeString(file, body.name.empty() ? "body" + std::to_string(i) : body.name);
+        if (body.parent >= 0)
+        {
+            const SceneBody& parent = scene.bodies[body.parent];
+            std::fprintf(file, ", \"parent\": ");
+            writeString(file, parent.name.empty() ? "body" + std::to_string(body.parent) : parent.name);
+        }
+        std::fprintf(file, ", \"model\": ");
+        writeString(file, scene.models[body.model].name);
+        std::fprintf(file, ", \"shader\": ");
+        writeString(file, scene.shaders[body.shader].name);
+        if (body.scale.x == body.scale.y && body.scale.y == body.scale.z)
+            std::fprintf(file, ", \"scale\": %g", body.scale.x);
+        else
+            std::fprintf(file, ", \"scale\": [%g, %g, %g]", body.scale.x, body.scale.y, body.scale.z);
+        if (!body.orbits.empty())
+        {
+            std::fprintf(file, ", \"orbits\": [");
+            for (size_t j = 0; j < body.orbits.size(); j++)
+                std::fprintf(file, "%s[%g, %g, %g]", j > 0 ? ", " : "", body.orbits[j].radius, body.orbits[j].period, body.orbits[j].phase);
+            std::fprintf(file, "]");
+        }
+        if (body.spin != 0.0f)
+            std::fprintf(file, ", \"spin\": %g", body.spin);
+        if (body.hidden)
+            std::fprintf(file, ", \"hidden\": true");
+        if (!body.terrainHeight.empty())
+        {
+            std::fprintf(file, ", \"terrain\": { \"height\": ");
+            writeString(file, body.terrainHeight);
+            std::fprintf(file, ", \"color\": ");
+            writeString(file, body.terrainColor);
+            std::fprintf(file, ", \"relief\": %g }", body.terrainRelief);
+        }
+        std::fprintf(file, " }");
+    }
+    std::fprintf(file, "\n    ]\n}\n");
+
+    bool written = std::ferror(file) == 0;
+    std::fclose(file);
+    return written;
+}
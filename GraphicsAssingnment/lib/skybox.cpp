@@ -0,0 +1,135 @@
+#include "skybox.h"
+#include "gpumemory.h"
+#include "jobs.h"
+#include "stats.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the face a direction points at and where it lands on it, as GL picks them when sampling a cubemap
+static int cubemapFace(const glm::vec3& direction, float& s, float& t, float& major)
+{
+    glm::vec3 a = glm::abs(direction);
+    float sc, tc;
+    int face;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = direction.x > 0.0f ? 0 : 1;
+        major = a.x;
+        sc = direction.x > 0.0f ? -direction.z : direction.z;
+        tc = -direction.y;
+    }
+    else if (a.y >= a.z) {
+        face = direction.y > 0.0f ? 2 : 3;
+        major = a.y;
+        sc = direction.x;
+        tc = direction.y > 0.0f ? direction.z : -direction.z;
+    }
+    else {
+        face = direction.z > 0.0f ? 4 : 5;
+        major = a.z;
+        sc = direction.z > 0.0f ? direction.x : -direction.x;
+        tc = -direction.y;
+    }
+    s = 0.5f * (sc / major + 1.0f);
+    t = 0.5f * (tc / major + 1.0f);
+    return face;
+}
+
+CubemapImage bakeStarfield(const std::vector<glm::vec3>& positions, float halfSize, unsigned int size, const glm::vec3& background)
+{
+    PROFILE_SCOPE("bakeStarfield");
+    CubemapImage image;
+    image.size = size;
+    jobSystem().parallelFor(0, 6, 1, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; face++) {
+            std::vector<float> coverage(static_cast<size_t>(size) * size, 0.0f);
+            for (auto& position : positions) {
+                float s, t, major;
+                if (position == glm::vec3(0.0f) || cubemapFace(position, s, t, major) != static_cast<int>(face))
+                    continue;
+                // the square's half size in texels, the face spans 2 units of tangent at distance 1
+                float half = std::max(0.75f, halfSize / major * 0.5f * size);
+                float x = s * size;
+                float y = t * size;
+                int x0 = std::max(0, static_cast<int>(std::floor(x - half)));
+                int x1 = std::min(static_cast<int>(size) - 1, static_cast<int>(std::floor(x + half)));
+                int y0 = std::max(0, static_cast<int>(std::floor(y - half)));
+                int y1 = std::min(static_cast<int>(size) - 1, static_cast<int>(std::floor(y + half)));
+                // each texel gets the part of it the square covers
+                for (int row = y0; row <= y1; row++) {
+                    float height = std::min(row + 1.0f, y + half) - std::max(static_cast<float>(row), y - half);
+                    for (int column = x0; column <= x1; column++) {
+                        float width = std::min(column + 1.0f, x + half) - std::max(static_cast<float>(column), x - half);
+                        coverage[static_cast<size_t>(row) * size + column] += width * height;
+                    }
+                }
+            }
+
+            std::vector<unsigned char>& pixels = image.faces[face];
+            pixels.resize(coverage.size() * 3);
+            for (size_t i = 0; i < coverage.size(); i++) {
+                glm::vec3 color = glm::mix(background, glm::vec3(1.0f), std::min(coverage[i], 1.0f));
+                for (int c = 0; c < 3; c++)
+                    pixels[i * 3 + c] = static_cast<unsigned char>(color[c] * 255.0f + 0.5f);
+            }
+        }
+    });
+    return image;
+}
+
+Skybox::Skybox()
+    : _shader("./assets/shaders/vertex_skybox.glsl", "./assets/shaders/fragment_skybox.glsl")
+{
+    glGenVertexArrays(1, &_VAO);
+    glGenTextures(1, &_texture);
+}
+
+Skybox::~Skybox()
+{
+    glDeleteTextures(1, &_texture);
+    glDeleteVertexArrays(1, &_VAO);
+    gpuMemory().release(GPU_MEMORY_TEXTURES, _textureBytes);
+}
+
+void Skybox::upload(const CubemapImage& image)
+{
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (unsigned int face = 0; face < 6; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, image.size, image.size, 0, GL_RGB, GL_UNSIGNED_BYTE, image.faces[face].data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // a star is a few texels across, without mipmaps a pixel covering more texels than that could miss it
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    gpuMemory().release(GPU_MEMORY_TEXTURES, _textureBytes);
+    _textureBytes = 6 * textureBytes(image.size, image.size, 3, true);
+    gpuMemory().allocate(GPU_MEMORY_TEXTURES, _textureBytes);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // filter across the edges of the faces
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+void Skybox::draw(const glm::mat4& projection, const glm::mat4& view)
+{
+    // only the rotation of the view, the background doesn't move with the camera
+    glm::mat4 inverseViewProjection = glm::inverse(projection * glm::mat4(glm::mat3(view)));
+
+    // the triangle is at depth 1, which passes only where nothing was drawn
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    _shader.use();
+    _shader.setMat4("inverseViewProjection", inverseViewProjection);
+    _shader.setInt("background", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _texture);
+    glBindVertexArray(_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    renderStats().addDraw(1);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
@@ -0,0 +1,413 @@
+#include "streaming.h"
+#include "profiler.h"
+#include "compression.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+static const uint32_t MIP_FILE_VERSION = 2;
+// level reads at once, one when there are no worker threads since the read then runs on the main thread
+static const unsigned int MAX_IN_FLIGHT = 4;
+static const size_t MAX_UPLOADS = 2;
+
+static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    size = static_cast<uint64_t>(info.st_size);
+    time = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+// reads the header and the level offsets, false if the file is missing, malformed, from another image
+// or not compressed the way it is asked for
+static bool readMipHeader(std::ifstream& file, const std::string& imagePath, bool compress, MipFileHeader& header, std::vector<uint64_t>& offsets)
+{
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (std::memcmp(header.magic, "MIPS", 4) != 0 || header.version != MIP_FILE_VERSION || header.levels == 0 || header.levels > 32)
+        return false;
+    if (header.format != (compress ? compressedFormat(header.channels) : 0))
+        return false;
+    uint64_t size;
+    int64_t time;
+    if (sourceStamp(imagePath, size, time) && (size != header.sourceSize || time != header.sourceTime))
+        return false;
+    offsets.resize(header.levels + 1);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint64_t)));
+}
+
+// Models load in parallel and may share an image, only one of them builds its file. The lock is per
+// file, so different images build at the same time.
+static std::mutex& mipFileLock(const std::string& mipPath)
+{
+    static std::mutex locksLock;
+    static std::unordered_map<std::string, std::unique_ptr<std::mutex>> locks;
+    std::lock_guard<std::mutex> lock(locksLock);
+    std::unique_ptr<std::mutex>& fileLock = locks[mipPath];
+    if (!fileLock)
+        fileLock.reset(new std::mutex());
+    return *fileLock;
+}
+
+std::string mipFilePath(const std::string& imagePath)
+{
+    return imagePath + ".mips";
+}
+
+bool buildMipFile(const std::string& imagePath, const std::string& mipPath, bool compress)
+{
+    PROFILE_SCOPE("buildMipFile");
+    MipFileHeader header = {};
+    int width, height, channels;
+    unsigned char* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        std::cout << "ERROR::STREAMING::IMAGE_NOT_LOADED: " << imagePath << std::endl;
+        return false;
+    }
+    std::vector<std::vector<unsigned char>> levels = buildMipChain(data, width, height, channels);
+    stbi_image_free(data);
+    std::memcpy(header.magic, "MIPS", 4);
+    header.version = MIP_FILE_VERSION;
+    header.width = width;
+    header.height = height;
+    header.channels = channels;
+    header.levels = static_cast<uint32_t>(levels.size());
+    header.format = compress ? compressedFormat(channels) : 0;
+    sourceStamp(imagePath, header.sourceSize, header.sourceTime);
+
+    // the levels are encoded once here, every later run reads the blocks straight from the file
+    if (compress)
+    {
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            int levelWidth = mipLevelSize(width, level), levelHeight = mipLevelSize(height, level);
+            std::vector<unsigned char> blocks(compressedSize(levelWidth, levelHeight, channels));
+            compressImage(levels[level].data(), levelWidth, levelHeight, channels, blocks.data());
+            levels[level].swap(blocks);
+        }
+    }
+
+    std::vector<uint64_t> offsets(header.levels + 1);
+    offsets[0] = sizeof(header) + offsets.size() * sizeof(uint64_t);
+    for (uint32_t level = 0; level < header.levels; level++)
+        offsets[level + 1] = offsets[level] + levels[level].size();
+
+    // written under another name first, so an interrupted build never leaves a file that looks complete
+    std::string temporaryPath = mipPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+        for (auto& level : levels)
+            file.write(reinterpret_cast<const char*>(level.data()), level.size());
+        if (!file)
+        {
+            std::cout << "ERROR::STREAMING::MIP_FILE_NOT_WRITTEN: " << mipPath << std::endl;
+            file.close();
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    std::remove(mipPath.c_str());
+    return std::rename(temporaryPath.c_str(), mipPath.c_str()) == 0;
+}
+
+TextureImage decodeStreamedTexture(const std::string& imagePath, bool compress)
+{
+    PROFILE_SCOPE("decodeStreamedTexture");
+    std::string mipPath = mipFilePath(imagePath);
+    MipFileHeader header;
+    std::vector<uint64_t> offsets;
+    std::ifstream file;
+    bool ready;
+    {
+        std::lock_guard<std::mutex> lock(mipFileLock(mipPath));
+        file.open(mipPath, std::ios::binary);
+        ready = readMipHeader(file, imagePath, compress, header, offsets);
+        if (!ready)
+        {
+            file.close();
+            if (buildMipFile(imagePath, mipPath, compress))
+            {
+                file.clear();
+                file.open(mipPath, std::ios::binary);
+                ready = file.is_open() && readMipHeader(file, imagePath, compress, header, offsets);
+            }
+        }
+    }
+    // an image whose file can't be built is decoded whole, outside the lock
+    if (!ready)
+        return decodeTexture(imagePath, compress);
+
+    TextureImage image;
+    image.path = imagePath;
+    image.mipPath = mipPath;
+    image.width = header.width;
+    image.height = header.height;
+    image.nrComponents = header.channels;
+    image.levelOffsets = offsets;
+    image.compressedFormat = header.format;
+    int first = 0;
+    while (std::max(mipLevelSize(header.width, first), mipLevelSize(header.height, first)) > STREAMING_TAIL_SIZE)
+        first++;
+    image.firstLevel = first;
+    // the small levels are the end of the file
+    image.levels.resize(offsets[header.levels] - offsets[first]);
+    file.seekg(static_cast<std::streamoff>(offsets[first]));
+    if (!file.read(reinterpret_cast<char*>(image.levels.data()), image.levels.size()))
+        return decodeTexture(imagePath, compress);
+    return image;
+}
+
+TextureStreamer::TextureStreamer(size_t memoryBudget)
+    : _memoryBudget(memoryBudget)
+{
+    gpuMemory().addCache(this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // the jobs write into this object
+    for (auto& job : _jobs)
+        jobSystem().wait(job);
+    gpuMemory().removeCache(this);
+}
+
+size_t TextureStreamer::levelBytes(const StreamedTexture& texture, int level) const
+{
+    if (texture.compressedFormat != 0)
+        return compressedSize(mipLevelSize(texture.width, level), mipLevelSize(texture.height, level), texture.channels);
+    return textureBytes(mipLevelSize(texture.width, level), mipLevelSize(texture.height, level), texture.channels, false);
+}
+
+void TextureStreamer::uploadLevel(const StreamedTexture& texture, int level, const unsigned char* pixels, size_t size)
+{
+    int width = mipLevelSize(texture.width, level), height = mipLevelSize(texture.height, level);
+    if (texture.compressedFormat != 0)
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.compressedFormat, width, height, 0, static_cast<GLsizei>(size), pixels);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, textureFormat(texture.channels), width, height, 0, textureFormat(texture.channels), GL_UNSIGNED_BYTE, pixels);
+}
+
+unsigned int TextureStreamer::add(TextureImage& image)
+{
+    // an image that couldn't be streamed was decoded whole
+    if (image.mipPath.empty())
+        return uploadTexture(image);
+
+    PROFILE_SCOPE("TextureStreamer::add");
+    StreamedTexture texture;
+    glGenTextures(1, &texture.id);
+    texture.mipPath = image.mipPath;
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.channels = image.nrComponents;
+    texture.levels = static_cast<int>(image.levelOffsets.size()) - 1;
+    texture.tail = image.firstLevel;
+    texture.base = image.firstLevel;
+    texture.offsets = image.levelOffsets;
+    texture.wantedLevel = texture.tail;
+    texture.compressedFormat = image.compressedFormat;
+
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = texture.tail; level < texture.levels; level++)
+    {
+        const unsigned char* pixels = image.levels.data() + (texture.offsets[level] - texture.offsets[texture.tail]);
+        uploadLevel(texture, level, pixels, static_cast<size_t>(texture.offsets[level + 1] - texture.offsets[level]));
+        _residentBytes += levelBytes(texture, level);
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, levelBytes(texture, level));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // the levels above the base are left undefined until they are streamed in
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    image.levels.clear();
+    image.levels.shrink_to_fit();
+    _byName[texture.id] = static_cast<unsigned int>(_textures.size());
+    _textures.push_back(std::move(texture));
+    return _textures.back().id;
+}
+
+void TextureStreamer::want(unsigned int name, float pixels)
+{
+    auto found = _byName.find(name);
+    if (found == _byName.end())
+        return;
+    StreamedTexture& texture = _textures[found->second];
+    // across the middle of a body the texture's width covers the circumference, pi times the
+    // diameter, so a level needs pi texels across for every pixel of the diameter to give each pixel one
+    float texels = 3.14159265f * pixels;
+    int level = 0;
+    while (level < texture.tail && mipLevelSize(texture.width, level + 1) >= texels)
+        level++;
+    if (texture.wantedFrame != gpuMemory().frame() || level < texture.wantedLevel)
+        texture.wantedLevel = level;
+    texture.wantedFrame = gpuMemory().frame();
+}
+
+int TextureStreamer::target(const StreamedTexture& texture) const
+{
+    return gpuMemory().frame() - texture.wantedFrame < STREAMING_WANT_FRAMES ? texture.wantedLevel : texture.tail;
+}
+
+int TextureStreamer::victim() const
+{
+    // the largest level of the least recently wanted texture that has more than it needs
+    int victim = -1;
+    for (int i = 0; i < static_cast<int>(_textures.size()); i++)
+    {
+        const StreamedTexture& texture = _textures[i];
+        if (texture.loading || texture.base >= target(texture))
+            continue;
+        if (victim < 0 || texture.wantedFrame < _textures[victim].wantedFrame ||
+            (texture.wantedFrame == _textures[victim].wantedFrame && levelBytes(texture, texture.base) > levelBytes(_textures[victim], _textures[victim].base)))
+            victim = i;
+    }
+    return victim;
+}
+
+void TextureStreamer::dropLevel(StreamedTexture& texture)
+{
+    int level = texture.base;
+    texture.base++;
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base);
+    // an empty image gives the level's memory back
+    glTexImage2D(GL_TEXTURE_2D, level, textureFormat(texture.channels), 0, 0, 0, textureFormat(texture.channels), GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    _residentBytes -= levelBytes(texture, level);
+    gpuMemory().release(GPU_MEMORY_TEXTURES, levelBytes(texture, level));
+}
+
+bool TextureStreamer::makeRoom(size_t bytes)
+{
+    while (_residentBytes + _requestedBytes + bytes > _memoryBudget)
+    {
+        int texture = victim();
+        if (texture < 0)
+            return false;
+        dropLevel(_textures[texture]);
+    }
+    return true;
+}
+
+bool TextureStreamer::oldest(unsigned int& frame) const
+{
+    int texture = victim();
+    if (texture < 0)
+        return false;
+    frame = _textures[texture].wantedFrame;
+    return true;
+}
+
+void TextureStreamer::evictOldest()
+{
+    int texture = victim();
+    if (texture >= 0)
+        dropLevel(_textures[texture]);
+}
+
+void TextureStreamer::request(unsigned int index, int level)
+{
+    StreamedTexture& texture = _textures[index];
+    texture.loading = true;
+    _inFlight++;
+    _requestedBytes += levelBytes(texture, level);
+    std::string path = texture.mipPath;
+    uint64_t offset = texture.offsets[level];
+    size_t size = static_cast<size_t>(texture.offsets[level + 1] - offset);
+    auto load = [this, index, level, path, offset, size]() {
+        LoadedLevel loaded;
+        loaded.texture = index;
+        loaded.level = level;
+        loaded.pixels.resize(size);
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(static_cast<std::streamoff>(offset));
+        if (!file.read(reinterpret_cast<char*>(loaded.pixels.data()), size))
+        {
+            std::cout << "ERROR::STREAMING::LEVEL_NOT_READ: " << path << " level " << level << std::endl;
+            loaded.pixels.clear();
+        }
+        std::lock_guard<std::mutex> lock(_loadedLock);
+        _loaded.push_back(std::move(loaded));
+    };
+    if (JobHandle job = jobSystem().runOrInline(load))
+        _jobs.push_back(job);
+}
+
+void TextureStreamer::upload()
+{
+    std::vector<LoadedLevel> loaded;
+    {
+        std::lock_guard<std::mutex> lock(_loadedLock);
+        size_t count = std::min(_loaded.size(), MAX_UPLOADS);
+        loaded.assign(std::make_move_iterator(_loaded.begin()), std::make_move_iterator(_loaded.begin() + count));
+        _loaded.erase(_loaded.begin(), _loaded.begin() + count);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto& level : loaded)
+    {
+        StreamedTexture& texture = _textures[level.texture];
+        texture.loading = false;
+        _inFlight--;
+        size_t bytes = levelBytes(texture, level.level);
+        _requestedBytes -= bytes;
+        // a failed read is retried when the level is wanted again
+        if (level.pixels.empty())
+            continue;
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        uploadLevel(texture, level.level, level.pixels.data(), level.pixels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level.level);
+        texture.base = level.level;
+        _residentBytes += bytes;
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, bytes);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::update()
+{
+    PROFILE_SCOPE("TextureStreamer::update");
+    upload();
+    _jobs.erase(std::remove_if(_jobs.begin(), _jobs.end(), [](const JobHandle& job) { return job->finished.load(); }), _jobs.end());
+
+    // the textures that lack the most levels first, one level each at a time
+    std::vector<std::pair<int, unsigned int>> missing;
+    for (unsigned int i = 0; i < _textures.size(); i++)
+    {
+        const StreamedTexture& texture = _textures[i];
+        if (!texture.loading && target(texture) < texture.base)
+            missing.push_back(std::make_pair(texture.base - target(texture), i));
+    }
+    std::sort(missing.begin(), missing.end(), [](const std::pair<int, unsigned int>& a, const std::pair<int, unsigned int>& b) { return a.first > b.first; });
+    unsigned int maxInFlight = jobSystem().threadCount() > 1 ? MAX_IN_FLIGHT : 1;
+    for (auto& texture : missing)
+    {
+        if (_inFlight >= maxInFlight)
+            break;
+        int level = _textures[texture.second].base - 1;
+        // a level that doesn't fit may still leave room for a smaller one of another texture
+        size_t bytes = levelBytes(_textures[texture.second], level);
+        if (makeRoom(bytes) && gpuMemory().makeRoom(bytes))
+            request(texture.second, level);
+    }
+    // a texture that stopped being drawn keeps its levels until the room is needed
+    makeRoom(0);
+}
@@ -0,0 +1,105 @@
+#include "stress.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+static const char* SUN_MODEL = "./assets/objects/sun/scene.gltf";
+static const char* PLANET_MODEL = "./assets/objects/earth/Earth.obj";
+static const char* MOON_MODEL = "./assets/objects/moon/Moon.obj";
+
+// distance of the first planet from the sun and between neighbouring planets. Large counts squeeze
+// the planets closer together so the whole system stays within the far plane.
+static const float FIRST_ORBIT = 47.0f;
+static const float ORBIT_SPACING = 12.0f;
+static const float SYSTEM_RADIUS = 400.0f;
+
+// the orbital period grows with the radius like Kepler's third law, the earth's orbit keeps its period of 20
+static float orbitPeriod(float radius)
+{
+    return 20.0f * std::pow(radius / FIRST_ORBIT, 1.5f);
+}
+
+static unsigned int addModel(SceneDescription& scene, const std::string& name, const char* path, bool unique = false)
+{
+    SceneModel model;
+    model.name = name;
+    model.path = path;
+    model.unique = unique;
+    scene.models.push_back(model);
+    return static_cast<unsigned int>(scene.models.size() - 1);
+}
+
+void generateStressScene(const StressSettings& settings, unsigned int seed, SceneDescription& scene)
+{
+    DeterministicRandom random(seed);
+    scene = SceneDescription();
+    scene.starCount = settings.stars;
+    scene.light = glm::vec3(0.0f);
+    scene.shaders.push_back({ "luminous", "./assets/shaders/vertex_luminous.glsl", "./assets/shaders/fragment_luminous.glsl" });
+    scene.shaders.push_back({ "nonluminous", "./assets/shaders/vertex_nonluminous.glsl", "./assets/shaders/fragment_nonluminous.glsl" });
+
+    unsigned int sunModel = addModel(scene, "sun", SUN_MODEL);
+    // the shared models are only added when something uses them, otherwise they would be loaded for nothing
+    bool sharedPlanets = !settings.uniqueModels && settings.planets > 0;
+    bool sharedMoons = (!settings.uniqueModels && settings.planets > 0 && settings.moons > 0) || settings.asteroids > 0;
+    unsigned int planetModel = sharedPlanets ? addModel(scene, "planet", PLANET_MODEL) : 0;
+    unsigned int moonModel = sharedMoons ? addModel(scene, "moon", MOON_MODEL) : 0;
+    float spacing = settings.planets > 0 ? std::min(ORBIT_SPACING, SYSTEM_RADIUS / settings.planets) : ORBIT_SPACING;
+
+    size_t bodyCount = 1 + settings.planets * (1 + static_cast<size_t>(settings.moons)) + settings.asteroids;
+    scene.bodies.reserve(bodyCount);
+
+    SceneBody sun;
+    sun.name = "sun";
+    sun.model = sunModel;
+    sun.shader = 0;
+    sun.scale = glm::vec3(30.0f);
+    sun.spin = 100.0f;
+    scene.bodies.push_back(sun);
+
+    for (unsigned int p = 0; p < settings.planets; p++)
+    {
+        SceneBody planet;
+        planet.name = "planet" + std::to_string(p);
+        planet.model = settings.uniqueModels ? addModel(scene, planet.name, PLANET_MODEL, true) : planetModel;
+        planet.shader = 1;
+        planet.scale = glm::vec3(random.uniform(0.3f, 0.8f));
+        float radius = FIRST_ORBIT + p * spacing;
+        planet.orbits.push_back({ radius, orbitPeriod(radius), random.uniform(0.0f, 6.2831853f) });
+        planet.spin = random.uniform(0.5f, 2.0f);
+        int parent = static_cast<int>(scene.bodies.size());
+        scene.bodies.push_back(planet);
+
+        for (unsigned int m = 0; m < settings.moons; m++)
+        {
+            SceneBody moon;
+            moon.name = planet.name + "moon" + std::to_string(m);
+            moon.model = settings.uniqueModels ? addModel(scene, moon.name, MOON_MODEL, true) : moonModel;
+            moon.shader = 1;
+            moon.parent = parent;
+            moon.scale = glm::vec3(random.uniform(0.05f, 0.15f));
+            moon.orbits.push_back({ 2.0f + m * 1.0f + random.uniform(0.0f, 0.5f), random.uniform(2.0f, 8.0f), random.uniform(0.0f, 6.2831853f) });
+            moon.spin = random.uniform(2.0f, 6.0f);
+            scene.bodies.push_back(moon);
+        }
+    }
+
+    // the belt sits outside the last planet
+    float beltInner = FIRST_ORBIT + settings.planets * spacing + 10.0f;
+    float beltOuter = beltInner + 30.0f;
+    scene.starRadius = std::max(500.0f, 2.0f * beltOuter);
+    for (unsigned int a = 0; a < settings.asteroids; a++)
+    {
+        SceneBody asteroid;
+        asteroid.model = moonModel;
+        asteroid.shader = 1;
+        asteroid.scale = glm::vec3(random.uniform(0.01f, 0.04f));
+        float radius = random.uniform(beltInner, beltOuter);
+        asteroid.orbits.push_back({ radius, orbitPeriod(radius), random.uniform(0.0f, 6.2831853f) });
+        asteroid.spin = random.uniform(1.0f, 10.0f);
+        scene.bodies.push_back(asteroid);
+    }
+}
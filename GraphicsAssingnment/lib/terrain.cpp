@@ -0,0 +1,639 @@
+#include "terrain.h"
+#include "noise.h"
+#include "skybox.h"
+#include "stats.h"
+#include "profiler.h"
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// the pixels a quad may cover on screen before its chunk splits
+static const float QUAD_PIXELS = 12.0f;
+// children are requested a little before they are needed, so they are usually there in time
+static const float PREFETCH = 1.5f;
+// the vertices of a chunk morph into the coarser level over the last part of the distance it is drawn at
+static const float MORPH_START = 0.8f;
+// chunk jobs running at once and chunks uploaded per frame, so streaming never stalls a frame for long
+static const unsigned int MAX_IN_FLIGHT = 8;
+static const unsigned int MAX_UPLOADS = 8;
+// face size of the cubemap the colour cross is resampled into
+static const int COLOR_FACE_SIZE = 512;
+// fractal noise below the resolution of the height map, relative to the map's range
+static const float DETAIL_AMPLITUDE = 0.02f;
+
+static const int GRID = TERRAIN_CHUNK_QUADS + 1;
+static const double PI = 3.14159265358979323846;
+
+// A face of the cube and of the cross its textures are laid out in. Right and up are the directions of
+// the face's x and y (up is the image's -y), the faces around the equator go east from longitude 0.
+struct CubeFace {
+    glm::vec3 normal;
+    glm::vec3 right;
+    glm::vec3 up;
+    int column;
+    int row;
+};
+
+static const CubeFace FACES[6] = {
+    { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1, 1 },
+    { glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 2, 1 },
+    { glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 3, 1 },
+    { glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0, 1 },
+    { glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, 0.0f), 1, 0 },
+    { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f), 1, 2 }
+};
+
+// the face a direction points at, ties always go the same way so a direction on an edge has one face
+static int faceOf(const glm::vec3& direction)
+{
+    glm::vec3 a = glm::abs(direction);
+    if (a.x >= a.y && a.x >= a.z)
+        return direction.x > 0.0f ? 0 : 2;
+    if (a.y >= a.z)
+        return direction.y > 0.0f ? 4 : 5;
+    return direction.z > 0.0f ? 3 : 1;
+}
+
+// Where a direction lands in a cross of width x height pixels, as the top left pixel of its bilinear
+// footprint and the weights. The footprint is clamped to the pixels of the face, the cross has filler
+// around the faces.
+struct CrossSample {
+    int x0, y0, x1, y1;
+    float fx, fy;
+};
+
+static CrossSample crossSample(const glm::vec3& direction, int width, int height)
+{
+    const CubeFace& face = FACES[faceOf(direction)];
+    float major = glm::dot(direction, face.normal);
+    float a = glm::dot(direction, face.right) / major;
+    float b = glm::dot(direction, face.up) / major;
+    float faceWidth = width / 4.0f;
+    float faceHeight = height / 3.0f;
+    float left = face.column * faceWidth;
+    float top = face.row * faceHeight;
+    float x = glm::clamp(left + 0.5f * (a + 1.0f) * faceWidth, left + 0.5f, left + faceWidth - 0.5f) - 0.5f;
+    float y = glm::clamp(top + 0.5f * (1.0f - b) * faceHeight, top + 0.5f, top + faceHeight - 0.5f) - 0.5f;
+    CrossSample sample;
+    sample.x0 = static_cast<int>(x);
+    sample.y0 = static_cast<int>(y);
+    sample.fx = x - sample.x0;
+    sample.fy = y - sample.y0;
+    sample.x1 = std::min(sample.x0 + 1, width - 1);
+    sample.y1 = std::min(sample.y0 + 1, height - 1);
+    return sample;
+}
+
+bool CubeHeightMap::load(const std::string& path)
+{
+    PROFILE_SCOPE("CubeHeightMap::load");
+    int components;
+    stbi_us* data = stbi_load_16(path.c_str(), &_width, &_height, &components, 1);
+    if (data == nullptr)
+    {
+        std::cout << "ERROR::TERRAIN::HEIGHT_MAP_NOT_LOADED: " << path << std::endl;
+        return false;
+    }
+    _heights.resize(static_cast<size_t>(_width) * _height);
+    for (size_t i = 0; i < _heights.size(); i++)
+        _heights[i] = data[i] / 65535.0f;
+    stbi_image_free(data);
+
+    // the lowest point of the faces, the filler around them doesn't count
+    _lowest = 1.0f;
+    for (auto& face : FACES)
+    {
+        int x0 = static_cast<int>(std::ceil(face.column * _width / 4.0f));
+        int x1 = static_cast<int>((face.column + 1) * _width / 4.0f);
+        int y0 = static_cast<int>(std::ceil(face.row * _height / 3.0f));
+        int y1 = static_cast<int>((face.row + 1) * _height / 3.0f);
+        for (int y = y0; y < y1; y++)
+        {
+            for (int x = x0; x < x1; x++)
+                _lowest = std::min(_lowest, _heights[static_cast<size_t>(y) * _width + x]);
+        }
+    }
+    return true;
+}
+
+float CubeHeightMap::sample(const glm::vec3& direction) const
+{
+    CrossSample s = crossSample(direction, _width, _height);
+    const float* row0 = &_heights[static_cast<size_t>(s.y0) * _width];
+    const float* row1 = &_heights[static_cast<size_t>(s.y1) * _width];
+    float top = row0[s.x0] + (row0[s.x1] - row0[s.x0]) * s.fx;
+    float bottom = row1[s.x0] + (row1[s.x1] - row1[s.x0]) * s.fx;
+    return top + (bottom - top) * s.fy;
+}
+
+// resamples a colour cross into the faces of a GL cubemap, so the shader can look it up by direction
+// and the filtering crosses the cube edges
+static bool bakeColorCross(const std::string& path, CubemapImage& image)
+{
+    PROFILE_SCOPE("bakeColorCross");
+    int width, height, components;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 3);
+    if (data == nullptr)
+    {
+        std::cout << "ERROR::TERRAIN::COLOR_MAP_NOT_LOADED: " << path << std::endl;
+        return false;
+    }
+    image.size = COLOR_FACE_SIZE;
+    jobSystem().parallelFor(0, 6, 1, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; face++) {
+            std::vector<unsigned char>& pixels = image.faces[face];
+            pixels.resize(static_cast<size_t>(COLOR_FACE_SIZE) * COLOR_FACE_SIZE * 3);
+            for (int t = 0; t < COLOR_FACE_SIZE; t++) {
+                for (int s = 0; s < COLOR_FACE_SIZE; s++) {
+                    // the direction GL samples this texel at, see cubemapFace() in skybox.cpp
+                    float sc = 2.0f * (s + 0.5f) / COLOR_FACE_SIZE - 1.0f;
+                    float tc = 2.0f * (t + 0.5f) / COLOR_FACE_SIZE - 1.0f;
+                    glm::vec3 direction;
+                    switch (face) {
+                    case 0: direction = glm::vec3(1.0f, -tc, -sc); break;
+                    case 1: direction = glm::vec3(-1.0f, -tc, sc); break;
+                    case 2: direction = glm::vec3(sc, 1.0f, tc); break;
+                    case 3: direction = glm::vec3(sc, -1.0f, -tc); break;
+                    case 4: direction = glm::vec3(sc, -tc, 1.0f); break;
+                    default: direction = glm::vec3(-sc, -tc, -1.0f); break;
+                    }
+                    CrossSample sample = crossSample(direction, width, height);
+                    unsigned char* pixel = &pixels[(static_cast<size_t>(t) * COLOR_FACE_SIZE + s) * 3];
+                    for (int c = 0; c < 3; c++) {
+                        float c00 = data[(static_cast<size_t>(sample.y0) * width + sample.x0) * 3 + c];
+                        float c10 = data[(static_cast<size_t>(sample.y0) * width + sample.x1) * 3 + c];
+                        float c01 = data[(static_cast<size_t>(sample.y1) * width + sample.x0) * 3 + c];
+                        float c11 = data[(static_cast<size_t>(sample.y1) * width + sample.x1) * 3 + c];
+                        float top = c00 + (c10 - c00) * sample.fx;
+                        float bottom = c01 + (c11 - c01) * sample.fx;
+                        pixel[c] = static_cast<unsigned char>(top + (bottom - top) * sample.fy + 0.5f);
+                    }
+                }
+            }
+        }
+    });
+    stbi_image_free(data);
+    return true;
+}
+
+// Chunks are keyed by their face, level and position in the face's grid of 2^level x 2^level chunks
+static uint64_t chunkKey(int face, int level, uint32_t x, uint32_t y)
+{
+    return static_cast<uint64_t>(face) << 61 | static_cast<uint64_t>(level) << 56 | static_cast<uint64_t>(x) << 28 | y;
+}
+
+static void decodeKey(uint64_t key, int& face, int& level, uint32_t& x, uint32_t& y)
+{
+    face = static_cast<int>(key >> 61);
+    level = static_cast<int>((key >> 56) & 31);
+    x = static_cast<uint32_t>((key >> 28) & 0xFFFFFFF);
+    y = static_cast<uint32_t>(key & 0xFFFFFFF);
+}
+
+// Maps a face coordinate in [-1, 1] onto the cube so the grid is about as dense at the corners of a face
+// as in its middle. It is odd to the last bit, so two faces that meet compute the same points on their edge.
+static double warp(double s)
+{
+    double t = std::tan(std::fabs(s) * (PI / 4.0));
+    return s < 0.0 ? -t : t;
+}
+
+// the point of the unit cube at face coordinates (s, t), exact where faces share an edge
+static glm::dvec3 cubePoint(const CubeFace& face, double s, double t)
+{
+    return glm::dvec3(face.normal) + warp(s) * glm::dvec3(face.right) + warp(t) * glm::dvec3(face.up);
+}
+
+// the unit sphere's bounds of a chunk: its middle, and the angle from there that takes in its corners
+static void chunkBounds(int face, int level, uint32_t x, uint32_t y, glm::dvec3& middle, double& angle)
+{
+    double size = 2.0 / (1u << level);
+    double s0 = -1.0 + x * size;
+    double t0 = -1.0 + y * size;
+    middle = glm::normalize(cubePoint(FACES[face], s0 + 0.5 * size, t0 + 0.5 * size));
+    double smallest = 1.0;
+    for (int corner = 0; corner < 4; corner++)
+    {
+        glm::dvec3 point = glm::normalize(cubePoint(FACES[face], s0 + (corner & 1) * size, t0 + (corner >> 1) * size));
+        smallest = std::min(smallest, glm::dot(point, middle));
+    }
+    angle = std::acos(glm::clamp(smallest, -1.0, 1.0));
+}
+
+PlanetTerrain::PlanetTerrain(const std::string& heightPath, const std::string& colorPath, float relief, size_t memoryBudget)
+    : _relief(relief),
+      _memoryBudget(memoryBudget),
+      _shader("./assets/shaders/vertex_terrain.glsl", "./assets/shaders/fragment_terrain.glsl")
+{
+    CubemapImage color;
+    if (!_heights.load(heightPath) || !bakeColorCross(colorPath, color))
+    {
+        _heights = CubeHeightMap();
+        return;
+    }
+
+    glGenTextures(1, &_colorTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _colorTexture);
+    for (int face = 0; face < 6; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, color.size, color.size, 0, GL_RGB, GL_UNSIGNED_BYTE, color.faces[face].data());
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    _staticBytes = 6 * textureBytes(color.size, color.size, 3, true);
+
+    // every chunk has the same grid, they share one index buffer: two triangles a quad, all cut along the
+    // same diagonal as the quads of the level above, then the skirts along the four edges
+    std::vector<unsigned short> indices;
+    auto vertex = [](int i, int j) { return static_cast<unsigned short>(j * GRID + i); };
+    for (int j = 0; j < TERRAIN_CHUNK_QUADS; j++)
+    {
+        for (int i = 0; i < TERRAIN_CHUNK_QUADS; i++)
+        {
+            unsigned short a = vertex(i, j), b = vertex(i + 1, j), c = vertex(i + 1, j + 1), d = vertex(i, j + 1);
+            indices.insert(indices.end(), { a, b, c, a, c, d });
+        }
+    }
+    for (int edge = 0; edge < 4; edge++)
+    {
+        unsigned short skirt = static_cast<unsigned short>(GRID * GRID + edge * GRID);
+        for (int k = 0; k < TERRAIN_CHUNK_QUADS; k++)
+        {
+            // bottom, top, left and right edge, in the order generate() hangs the skirts
+            unsigned short a = edge == 0 ? vertex(k, 0) : edge == 1 ? vertex(k, TERRAIN_CHUNK_QUADS) : edge == 2 ? vertex(0, k) : vertex(TERRAIN_CHUNK_QUADS, k);
+            unsigned short b = edge < 2 ? a + 1 : a + GRID;
+            unsigned short c = static_cast<unsigned short>(skirt + k + 1), d = static_cast<unsigned short>(skirt + k);
+            indices.insert(indices.end(), { a, b, c, a, c, d });
+        }
+    }
+    _indexCount = static_cast<unsigned int>(indices.size());
+    glGenBuffers(1, &_EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    _staticBytes += indices.size() * sizeof(unsigned short);
+    gpuMemory().allocate(GPU_MEMORY_TERRAIN, _staticBytes);
+    gpuMemory().addCache(this);
+
+    // the six faces are always resident, there is always something to draw
+    for (int face = 0; face < 6; face++)
+    {
+        ChunkData data;
+        generate(chunkKey(face, 0, 0, 0), data);
+        _generated.push_back(std::move(data));
+    }
+    upload(6);
+}
+
+PlanetTerrain::~PlanetTerrain()
+{
+    // the jobs write into this object
+    for (auto& request : _requested)
+    {
+        if (request.second)
+            jobSystem().wait(request.second);
+    }
+    for (auto& chunk : _chunks)
+    {
+        glDeleteVertexArrays(1, &chunk.second.VAO);
+        glDeleteBuffers(1, &chunk.second.VBO);
+    }
+    glDeleteBuffers(1, &_EBO);
+    glDeleteTextures(1, &_colorTexture);
+    gpuMemory().removeCache(this);
+    gpuMemory().release(GPU_MEMORY_TERRAIN, _staticBytes + _residentBytes);
+}
+
+void PlanetTerrain::generate(uint64_t key, ChunkData& data) const
+{
+    PROFILE_SCOPE("PlanetTerrain::generate");
+    int face, level;
+    uint32_t x, y;
+    decodeKey(key, face, level, x, y);
+    const int N = TERRAIN_CHUNK_QUADS;
+    // the grid with a ring of samples around it for the normals
+    const int RING = GRID + 2;
+    double size = 2.0 / (1u << level);
+    double step = size / N;
+    double s0 = -1.0 + x * size;
+    double t0 = -1.0 + y * size;
+
+    std::vector<glm::dvec3> directions(static_cast<size_t>(RING) * RING);
+    std::vector<float> px(directions.size()), py(directions.size()), pz(directions.size()), detail(directions.size());
+    for (int j = 0; j < RING; j++)
+    {
+        for (int i = 0; i < RING; i++)
+        {
+            // the face coordinates are multiples of a power of two, exact on either side of an edge
+            size_t index = static_cast<size_t>(j) * RING + i;
+            directions[index] = glm::normalize(cubePoint(FACES[face], s0 + (i - 1) * step, t0 + (j - 1) * step));
+            px[index] = static_cast<float>(directions[index].x);
+            py[index] = static_cast<float>(directions[index].y);
+            pz[index] = static_cast<float>(directions[index].z);
+        }
+    }
+    // the map runs out of texels long before the quadtree runs out of levels, noise carries on below it
+    NoiseSettings settings;
+    settings.seed = 7;
+    settings.frequency = 160.0f;
+    settings.octaves = 7;
+    evaluateNoise(settings, px.data(), py.data(), pz.data(), detail.data(), detail.size());
+
+    float lowest = _heights.lowest();
+    std::vector<glm::dvec3> positions(directions.size());
+    for (size_t i = 0; i < directions.size(); i++)
+    {
+        float height = _heights.sample(glm::vec3(px[i], py[i], pz[i]));
+        // no detail on the lowest ground, which is the sea on the earth
+        height += DETAIL_AMPLITUDE * detail[i] * glm::smoothstep(lowest, lowest + 0.05f, height);
+        positions[i] = directions[i] * (1.0 + _relief * static_cast<double>(height - lowest));
+    }
+    auto position = [&](int i, int j) { return positions[static_cast<size_t>(j + 1) * RING + i + 1]; };
+    std::vector<glm::vec3> normals(static_cast<size_t>(GRID) * GRID);
+    for (int j = 0; j < GRID; j++)
+    {
+        for (int i = 0; i < GRID; i++)
+            normals[static_cast<size_t>(j) * GRID + i] = glm::vec3(glm::normalize(glm::cross(position(i + 1, j) - position(i - 1, j), position(i, j + 1) - position(i, j - 1))));
+    }
+    auto normal = [&](int i, int j) { return normals[static_cast<size_t>(j) * GRID + i]; };
+
+    glm::dvec3 center = glm::normalize(cubePoint(FACES[face], s0 + 0.5 * size, t0 + 0.5 * size));
+    data.key = key;
+    data.center = glm::vec3(center);
+    data.vertices.resize(GRID * GRID + 4 * GRID);
+    for (int j = 0; j < GRID; j++)
+    {
+        for (int i = 0; i < GRID; i++)
+        {
+            // the vertices between those of the level above morph onto its triangles: the middle of their
+            // edge, or of the quad's diagonal
+            glm::dvec3 target = position(i, j);
+            glm::vec3 targetNormal = normal(i, j);
+            int di = i & 1, dj = j & 1;
+            if (di || dj)
+            {
+                target = 0.5 * (position(i - di, j - dj) + position(i + di, j + dj));
+                targetNormal = glm::normalize(normal(i - di, j - dj) + normal(i + di, j + dj));
+            }
+            ChunkVertex& vertex = data.vertices[j * GRID + i];
+            vertex.position = glm::vec3(position(i, j) - center);
+            vertex.morph = glm::vec3(target - position(i, j));
+            vertex.normal = normal(i, j);
+            vertex.morphNormal = targetNormal;
+        }
+    }
+    // the skirts hang a couple of quads deep, enough to cover the step between two levels
+    double skirt = 2.0 * step * (PI / 4.0) + 0.02 * _relief;
+    for (int edge = 0; edge < 4; edge++)
+    {
+        for (int k = 0; k < GRID; k++)
+        {
+            int i = edge == 0 || edge == 1 ? k : edge == 2 ? 0 : N;
+            int j = edge == 2 || edge == 3 ? k : edge == 0 ? 0 : N;
+            ChunkVertex vertex = data.vertices[j * GRID + i];
+            glm::dvec3 below = position(i, j) - directions[static_cast<size_t>(j + 1) * RING + i + 1] * skirt;
+            vertex.position = glm::vec3(below - center);
+            data.vertices[GRID * GRID + edge * GRID + k] = vertex;
+        }
+    }
+}
+
+void PlanetTerrain::request(uint64_t key)
+{
+    auto generate = [this, key]() {
+        ChunkData data;
+        this->generate(key, data);
+        std::lock_guard<std::mutex> lock(_generatedLock);
+        _generated.push_back(std::move(data));
+    };
+    // an inline chunk keeps a null handle until upload() takes it
+    _requested[key] = jobSystem().runOrInline(generate);
+}
+
+void PlanetTerrain::upload(unsigned int maxUploads)
+{
+    std::vector<ChunkData> generated;
+    {
+        std::lock_guard<std::mutex> lock(_generatedLock);
+        size_t count = std::min<size_t>(_generated.size(), maxUploads);
+        generated.assign(std::make_move_iterator(_generated.begin()), std::make_move_iterator(_generated.begin() + count));
+        _generated.erase(_generated.begin(), _generated.begin() + count);
+    }
+    for (auto& data : generated)
+    {
+        _requested.erase(data.key);
+        Chunk& chunk = _chunks[data.key];
+        chunk.center = data.center;
+        glGenVertexArrays(1, &chunk.VAO);
+        glGenBuffers(1, &chunk.VBO);
+        glBindVertexArray(chunk.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+        glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(ChunkVertex), data.vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+        for (int attribute = 0; attribute < 4; attribute++)
+        {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribPointer(attribute, 3, GL_FLOAT, GL_FALSE, sizeof(ChunkVertex), (void*)(attribute * sizeof(glm::vec3)));
+        }
+        glBindVertexArray(0);
+        chunk.bytes = sizeof(Chunk) + data.vertices.size() * sizeof(ChunkVertex);
+        chunk.lastFrame = gpuMemory().frame();
+        _recent.push_front(data.key);
+        chunk.recent = _recent.begin();
+        _residentBytes += chunk.bytes;
+        gpuMemory().allocate(GPU_MEMORY_TERRAIN, chunk.bytes);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PlanetTerrain::evict()
+{
+    while (_residentBytes > _memoryBudget)
+    {
+        // everything left is drawn this frame, the budget is too small for the view
+        unsigned int frame;
+        if (!oldest(frame) || frame == gpuMemory().frame())
+            break;
+        evictOldest();
+    }
+}
+
+std::list<uint64_t>::const_reverse_iterator PlanetTerrain::leastRecentlyDrawn() const
+{
+    auto chunk = _recent.crbegin();
+    while (chunk != _recent.crend() && ((*chunk >> 56) & 31) == 0)
+        ++chunk;
+    return chunk;
+}
+
+bool PlanetTerrain::oldest(unsigned int& frame) const
+{
+    auto key = leastRecentlyDrawn();
+    if (key == _recent.crend())
+        return false;
+    frame = _chunks.find(*key)->second.lastFrame;
+    return true;
+}
+
+void PlanetTerrain::evictOldest()
+{
+    auto key = leastRecentlyDrawn();
+    if (key == _recent.crend())
+        return;
+    auto found = _chunks.find(*key);
+    Chunk& chunk = found->second;
+    glDeleteVertexArrays(1, &chunk.VAO);
+    glDeleteBuffers(1, &chunk.VBO);
+    _residentBytes -= chunk.bytes;
+    gpuMemory().release(GPU_MEMORY_TERRAIN, chunk.bytes);
+    _recent.erase(chunk.recent);
+    _chunks.erase(found);
+}
+
+float PlanetTerrain::splitDistance(int level) const
+{
+    // a quad of the level spans about a quarter turn over the quads of the face's edge
+    float quad = _radius * static_cast<float>(PI / 2.0) / (static_cast<float>(1u << level) * TERRAIN_CHUNK_QUADS);
+    return _splitScale * quad;
+}
+
+void PlanetTerrain::select(uint64_t key, const glm::dvec3& camera, std::vector<std::pair<float, uint64_t>>& wanted)
+{
+    int face, level;
+    uint32_t x, y;
+    decodeKey(key, face, level, x, y);
+    Chunk& chunk = _chunks.find(key)->second;
+
+    // a sphere around the chunk from the lowest ground to the highest peak, on the unit planet. The
+    // farthest points from a centre on the chunk's axis are on its rim, at the bottom or the top.
+    glm::dvec3 middle;
+    double angle;
+    chunkBounds(face, level, x, y, middle, angle);
+    double bottom = 1.0 - _relief * DETAIL_AMPLITUDE;
+    double top = 1.0 + _relief * (1.0 + DETAIL_AMPLITUDE);
+    double axial = 0.5 * (bottom * std::cos(angle) + top);
+    glm::dvec3 boundCenter = middle * axial;
+    double boundRadius = std::max(glm::length(glm::dvec2(bottom * std::cos(angle) - axial, bottom * std::sin(angle))),
+        glm::length(glm::dvec2(top * std::cos(angle) - axial, top * std::sin(angle))));
+
+    // behind the horizon: the chunk is further round the planet from the camera than the highest peak
+    // that can still be seen over the lowest ground
+    double distance = glm::length(camera);
+    if (distance > top)
+    {
+        double horizon = std::acos(bottom / distance) + std::acos(bottom / top);
+        double around = std::acos(glm::clamp(glm::dot(middle, camera / distance), -1.0, 1.0));
+        if (around - angle > horizon)
+            return;
+    }
+    glm::vec3 worldCenter = glm::vec3(glm::dvec3(_model * glm::dvec4(boundCenter * static_cast<double>(_radius), 1.0)));
+    if (!_frustum.intersectsSphere(worldCenter, static_cast<float>(boundRadius) * _radius))
+        return;
+
+    chunk.lastFrame = gpuMemory().frame();
+    _recent.splice(_recent.begin(), _recent, chunk.recent);
+
+    float away = static_cast<float>(std::max(0.0, glm::length(camera - boundCenter) - boundRadius)) * _radius;
+    float split = splitDistance(level);
+    if (level < TERRAIN_MAX_LEVEL && away < split * PREFETCH)
+    {
+        uint64_t children[4];
+        bool resident = true;
+        for (int child = 0; child < 4; child++)
+        {
+            children[child] = chunkKey(face, level + 1, x * 2 + (child & 1), y * 2 + (child >> 1));
+            if (_chunks.find(children[child]) == _chunks.end())
+            {
+                resident = false;
+                wanted.push_back(std::make_pair(away, children[child]));
+            }
+        }
+        if (away < split && resident)
+        {
+            for (int child = 0; child < 4; child++)
+                select(children[child], camera, wanted);
+            return;
+        }
+    }
+    glm::dvec3 origin = glm::dvec3(_model * glm::dvec4(glm::dvec3(chunk.center) * static_cast<double>(_radius), 1.0)) - _cameraPosition;
+    _drawList.push_back({ &chunk, level, glm::vec3(origin) });
+}
+
+void PlanetTerrain::update(const glm::mat4& model, float radius, const glm::mat4& projection, const glm::mat4& view,
+    const glm::vec3& cameraPosition, float viewportHeight)
+{
+    PROFILE_SCOPE("PlanetTerrain::update");
+    _drawList.clear();
+    if (!valid())
+        return;
+    upload(MAX_UPLOADS);
+
+    _model = glm::dmat4(model);
+    _radius = radius;
+    _cameraPosition = glm::dvec3(cameraPosition);
+    _frustum = Frustum::fromMatrix(projection * view);
+    // projection[1][1] is 1 / tan(fov / 2), so this many quads of size 1 fit in the viewport's height at distance 1
+    _splitScale = projection[1][1] * viewportHeight * 0.5f / QUAD_PIXELS;
+
+    glm::dvec3 camera = glm::dvec3(glm::inverse(_model) * glm::dvec4(_cameraPosition, 1.0)) / static_cast<double>(radius);
+    std::vector<std::pair<float, uint64_t>> wanted;
+    for (int face = 0; face < 6; face++)
+    {
+        uint64_t root = chunkKey(face, 0, 0, 0);
+        Chunk& chunk = _chunks.find(root)->second;
+        chunk.lastFrame = gpuMemory().frame();
+        _recent.splice(_recent.begin(), _recent, chunk.recent);
+        select(root, camera, wanted);
+    }
+
+    // the missing chunks, nearest first. A full cache only takes new chunks once it has let go of some.
+    std::sort(wanted.begin(), wanted.end(), [](const std::pair<float, uint64_t>& a, const std::pair<float, uint64_t>& b) { return a.first < b.first; });
+    size_t maxInFlight = jobSystem().threadCount() > 1 ? MAX_IN_FLIGHT : 2;
+    // every chunk has the same size
+    size_t chunkBytes = _chunks.begin()->second.bytes;
+    for (auto& entry : wanted)
+    {
+        if (_requested.size() >= maxInFlight || _residentBytes >= _memoryBudget || !gpuMemory().makeRoom(chunkBytes))
+            break;
+        if (_requested.find(entry.second) == _requested.end())
+            request(entry.second);
+    }
+    evict();
+}
+
+void PlanetTerrain::draw(const std::function<void(Shader&)>& prepare)
+{
+    if (_drawList.empty())
+        return;
+    _shader.use();
+    prepare(_shader);
+    _shader.setMat3("orientation", glm::mat3(glm::mat4(_model)) * _radius);
+    _shader.setInt("colorMap", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _colorTexture);
+    for (auto& item : _drawList)
+    {
+        // a chunk turns into the level above it by the distance that level would have been drawn at
+        float end = item.level > 0 ? splitDistance(item.level - 1) : 1e30f;
+        _shader.setVec3("origin", item.origin);
+        _shader.setVec3("center", item.chunk->center);
+        _shader.setVec2("morphRange", end * MORPH_START, end);
+        glBindVertexArray(item.chunk->VAO);
+        glDrawElements(GL_TRIANGLES, _indexCount, GL_UNSIGNED_SHORT, 0);
+        renderStats().addDraw(_indexCount / 3);
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+float PlanetTerrain::altitude(const glm::vec3& cameraPosition) const
+{
+    double distance = glm::length(glm::dvec3(cameraPosition) - glm::dvec3(_model[3]));
+    return static_cast<float>(distance - _radius * (1.0 + _relief * (1.0 + DETAIL_AMPLITUDE)));
+}
@@ -1,4 +1,9 @@
 #include "texture.h"
+#include "profiler.h"
+#include "gpumemory.h"
+#include "compression.h"
+
+#include <algorithm>
 
 
 unsigned int loadTexture(char const* path)
@@ -21,6 +26,7 @@ unsigned int loadTexture(char const* path)
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, textureBytes(width, height, nrComponents, true));
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -36,4 +42,137 @@ unsigned int loadTexture(char const* path)
     }
 
     return textureID;
-}
\ No newline at end of file
+}
+
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+{
+    std::string filename = std::string(path);
+    filename = directory + '/' + filename;
+
+    TextureImage image = decodeTexture(filename);
+    return uploadTexture(image);
+}
+
+TextureImage decodeTexture(const std::string& filename, bool compress)
+{
+    PROFILE_SCOPE("decodeTexture");
+    TextureImage image;
+    image.path = filename;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    if (compress && image.data)
+    {
+        // the whole chain is encoded here on the loading thread, the upload only copies the blocks
+        std::vector<std::vector<unsigned char>> chain = buildMipChain(image.data, image.width, image.height, image.nrComponents);
+        stbi_image_free(image.data);
+        image.data = nullptr;
+        image.compressedFormat = compressedFormat(image.nrComponents);
+        image.levelOffsets.assign(1, 0);
+        for (int level = 0; level < static_cast<int>(chain.size()); level++)
+            image.levelOffsets.push_back(image.levelOffsets.back() + compressedSize(mipLevelSize(image.width, level), mipLevelSize(image.height, level), image.nrComponents));
+        image.levels.resize(image.levelOffsets.back());
+        for (int level = 0; level < static_cast<int>(chain.size()); level++)
+            compressImage(chain[level].data(), mipLevelSize(image.width, level), mipLevelSize(image.height, level), image.nrComponents, image.levels.data() + image.levelOffsets[level]);
+    }
+    return image;
+}
+
+unsigned int uploadTexture(TextureImage& image)
+{
+    PROFILE_SCOPE("uploadTexture");
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (image.data)
+    {
+        std::cout << image.path.c_str() << " NrComponents: " << image.nrComponents << std::endl;
+        GLenum format = textureFormat(image.nrComponents);
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, textureBytes(image.width, image.height, image.nrComponents, true));
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(image.data);
+        image.data = nullptr;
+    }
+    else if (image.compressedFormat != 0 && !image.levels.empty())
+    {
+        std::cout << image.path.c_str() << " NrComponents: " << image.nrComponents << " (compressed)" << std::endl;
+        int levels = static_cast<int>(image.levelOffsets.size()) - 1;
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        for (int level = 0; level < levels; level++)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, image.compressedFormat, mipLevelSize(image.width, level), mipLevelSize(image.height, level), 0,
+                static_cast<GLsizei>(image.levelOffsets[level + 1] - image.levelOffsets[level]), image.levels.data() + image.levelOffsets[level]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        gpuMemory().allocate(GPU_MEMORY_TEXTURES, image.levels.size());
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        image.levels.clear();
+        image.levels.shrink_to_fit();
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+    }
+
+    return textureID;
+}
+
+GLenum textureFormat(int nrComponents)
+{
+    if (nrComponents == 2)
+        return GL_RG;
+    else if (nrComponents == 3)
+        return GL_RGB;
+    else if (nrComponents == 4)
+        return GL_RGBA;
+    return GL_RED;
+}
+
+int mipLevelSize(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+std::vector<std::vector<unsigned char>> buildMipChain(const unsigned char* pixels, int width, int height, int channels)
+{
+    int count = 1;
+    while (mipLevelSize(width, count - 1) > 1 || mipLevelSize(height, count - 1) > 1)
+        count++;
+    // every level is box filtered from the one before, the last row and column repeat on odd sizes
+    std::vector<std::vector<unsigned char>> levels(count);
+    levels[0].assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+    for (int level = 1; level < count; level++)
+    {
+        int sourceWidth = mipLevelSize(width, level - 1), sourceHeight = mipLevelSize(height, level - 1);
+        int levelWidth = mipLevelSize(width, level), levelHeight = mipLevelSize(height, level);
+        const std::vector<unsigned char>& source = levels[level - 1];
+        std::vector<unsigned char>& target = levels[level];
+        target.resize(static_cast<size_t>(levelWidth) * levelHeight * channels);
+        for (int y = 0; y < levelHeight; y++)
+        {
+            int y0 = std::min(2 * y, sourceHeight - 1), y1 = std::min(2 * y + 1, sourceHeight - 1);
+            for (int x = 0; x < levelWidth; x++)
+            {
+                int x0 = std::min(2 * x, sourceWidth - 1), x1 = std::min(2 * x + 1, sourceWidth - 1);
+                for (int c = 0; c < channels; c++)
+                {
+                    int sum = source[(static_cast<size_t>(y0) * sourceWidth + x0) * channels + c] + source[(static_cast<size_t>(y0) * sourceWidth + x1) * channels + c] +
+                              source[(static_cast<size_t>(y1) * sourceWidth + x0) * channels + c] + source[(static_cast<size_t>(y1) * sourceWidth + x1) * channels + c];
+                    target[(static_cast<size_t>(y) * levelWidth + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+    return levels;
+}
@@ -0,0 +1,368 @@
+#include "universe.h"
+#include "noise.h"
+#include "culling.h"
+#include "stats.h"
+#include "profiler.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// sectors this many sectors away from the camera's (along any axis) are generated, about the far plane
+static const int LOAD_RADIUS = 2;
+// sector jobs running at once, and sectors uploaded per frame so streaming never stalls a frame for long
+static const unsigned int MAX_IN_FLIGHT = 4;
+static const unsigned int MAX_UPLOADS = 2;
+// the scene itself sits at the origin, no system is placed this close to it
+static const float CLEAR_RADIUS = 1000.0f;
+static const unsigned int MAX_SYSTEMS = 4;
+static const unsigned int MAX_PLANETS = 8;
+static const int PLANET_TEXTURE_WIDTH = 128;
+static const int STAR_TEXTURE_WIDTH = 64;
+
+static const float PI = 3.14159265358979323846f;
+
+// mixes the bits of a 64 bit value (splitmix64's finalizer), neighbouring sectors get unrelated seeds
+static uint64_t mixBits(uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return value;
+}
+
+static uint64_t sectorSeed(unsigned int seed, const SectorCoord& coord)
+{
+    uint64_t value = mixBits(seed);
+    value = mixBits(value ^ static_cast<uint32_t>(coord.x));
+    value = mixBits(value ^ static_cast<uint32_t>(coord.y));
+    value = mixBits(value ^ static_cast<uint32_t>(coord.z));
+    return value;
+}
+
+size_t SectorCoordHash::operator()(const SectorCoord& coord) const
+{
+    return static_cast<size_t>(sectorSeed(0, coord));
+}
+
+SectorCoord sectorOf(const glm::vec3& position)
+{
+    glm::vec3 cell = glm::floor(position / SECTOR_SIZE);
+    return { static_cast<int>(cell.x), static_cast<int>(cell.y), static_cast<int>(cell.z) };
+}
+
+// an equirectangular texture: a star's granulation, a planet's bands (gas giants) or continents
+static void paintBody(SectorBody& body, DeterministicRandom& random, const glm::vec3& starColor, bool gasGiant)
+{
+    body.textureWidth = body.luminous ? STAR_TEXTURE_WIDTH : PLANET_TEXTURE_WIDTH;
+    body.textureHeight = body.textureWidth / 2;
+    PlanetStyle style = randomPlanetStyle(random.next(), gasGiant);
+    if (body.luminous)
+    {
+        // no mountains or ice, the noise only darkens the star a little
+        style.seaLevel = 0.0f;
+        style.mountains.octaves = 0;
+        style.iceLatitude = 1.0f;
+        style.deepColor = starColor * 0.75f;
+        style.shallowColor = starColor * 0.9f;
+        style.lowColor = starColor * 0.9f;
+        style.highColor = starColor;
+        style.snowColor = starColor;
+    }
+    PlanetMaps maps;
+    generatePlanetMaps(style, body.textureWidth, body.textureHeight, maps);
+    body.pixels = std::move(maps.albedo);
+}
+
+// a rough black body colour, red dwarfs to blue giants
+static glm::vec3 starColor(float temperature)
+{
+    float t = glm::clamp((temperature - 3000.0f) / 7000.0f, 0.0f, 1.0f);
+    return t < 0.5f ? glm::mix(glm::vec3(1.0f, 0.55f, 0.3f), glm::vec3(1.0f, 0.95f, 0.85f), t * 2.0f)
+                    : glm::mix(glm::vec3(1.0f, 0.95f, 0.85f), glm::vec3(0.7f, 0.8f, 1.0f), t * 2.0f - 1.0f);
+}
+
+void generateSector(unsigned int seed, const SectorCoord& coord, SectorData& sector)
+{
+    DeterministicRandom random(sectorSeed(seed, coord));
+    sector = SectorData();
+    sector.coord = coord;
+    glm::vec3 origin = glm::vec3(coord.x, coord.y, coord.z) * SECTOR_SIZE;
+
+    unsigned int systems = random.next() % (MAX_SYSTEMS + 1);
+    for (unsigned int s = 0; s < systems; s++)
+    {
+        SectorSystem system;
+        // a margin keeps the orbits of neighbouring sectors apart
+        system.center = origin + glm::vec3(random.uniform(0.2f, 0.8f), random.uniform(0.2f, 0.8f), random.uniform(0.2f, 0.8f)) * SECTOR_SIZE;
+        if (glm::length(system.center) < CLEAR_RADIUS)
+            continue;
+        system.firstBody = static_cast<unsigned int>(sector.bodies.size());
+
+        SectorBody star = SectorBody();
+        star.luminous = true;
+        star.radius = random.uniform(8.0f, 40.0f);
+        star.spin = random.uniform(50.0f, 150.0f);
+        paintBody(star, random, starColor(random.uniform(3000.0f, 10000.0f)), false);
+        sector.bodies.push_back(std::move(star));
+        system.radius = sector.bodies.back().radius;
+
+        unsigned int planets = random.next() % (MAX_PLANETS + 1);
+        float orbit = sector.bodies.back().radius * 2.0f + 20.0f;
+        for (unsigned int p = 0; p < planets; p++)
+        {
+            SectorBody planet = SectorBody();
+            planet.luminous = false;
+            planet.radius = random.uniform(0.5f, 6.0f);
+            orbit += random.uniform(15.0f, 60.0f) + planet.radius;
+            planet.orbitRadius = orbit;
+            // Kepler's third law, like the stress scene
+            planet.period = 20.0f * std::pow(orbit / 47.0f, 1.5f);
+            planet.phase = random.uniform(0.0f, 2.0f * PI);
+            planet.spin = random.uniform(0.5f, 4.0f);
+            // the big ones are gas giants
+            paintBody(planet, random, glm::vec3(0.0f), planet.radius > 3.0f);
+            system.radius = orbit + planet.radius;
+            sector.bodies.push_back(std::move(planet));
+        }
+        system.bodyCount = static_cast<unsigned int>(sector.bodies.size()) - system.firstBody;
+        sector.systems.push_back(system);
+    }
+}
+
+// a UV sphere of radius 1, the texture wraps around it once
+static std::unique_ptr<Mesh> makeSphere(unsigned int slices, unsigned int stacks)
+{
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (unsigned int stack = 0; stack <= stacks; stack++)
+    {
+        float theta = PI * stack / stacks;
+        for (unsigned int slice = 0; slice <= slices; slice++)
+        {
+            float phi = 2.0f * PI * slice / slices;
+            Vertex vertex = Vertex();
+            vertex.Position = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), -std::sin(theta) * std::sin(phi));
+            vertex.Normal = vertex.Position;
+            vertex.TexCoords = glm::vec2(static_cast<float>(slice) / slices, static_cast<float>(stack) / stacks);
+            vertices.push_back(vertex);
+        }
+    }
+    for (unsigned int stack = 0; stack < stacks; stack++)
+    {
+        for (unsigned int slice = 0; slice < slices; slice++)
+        {
+            unsigned int a = stack * (slices + 1) + slice;
+            unsigned int b = a + slices + 1;
+            indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+    return std::unique_ptr<Mesh>(new Mesh(vertices, indices, std::vector<Texture>()));
+}
+
+Universe::Universe(unsigned int seed, size_t memoryBudget)
+    : _seed(seed),
+      _memoryBudget(memoryBudget),
+      _starShader("./assets/shaders/vertex_nonluminous.glsl", "./assets/shaders/fragment_luminous.glsl"),
+      _planetShader("./assets/shaders/vertex_nonluminous.glsl", "./assets/shaders/fragment_nonluminous.glsl"),
+      _sphere(makeSphere(32, 16))
+{
+    gpuMemory().addCache(this);
+}
+
+Universe::~Universe()
+{
+    // the jobs write into this object
+    for (auto& request : _requested)
+    {
+        if (request.second)
+            jobSystem().wait(request.second);
+    }
+    for (auto& sector : _sectors)
+    {
+        glDeleteTextures(static_cast<GLsizei>(sector.second.textures.size()), sector.second.textures.data());
+        gpuMemory().release(GPU_MEMORY_UNIVERSE, sector.second.textureBytes);
+    }
+    gpuMemory().removeCache(this);
+}
+
+void Universe::request(const SectorCoord& coord)
+{
+    unsigned int seed = _seed;
+    auto generate = [this, seed, coord]() {
+        SectorData sector;
+        generateSector(seed, coord, sector);
+        std::lock_guard<std::mutex> lock(_generatedLock);
+        _generated.push_back(std::move(sector));
+    };
+    // an inline sector keeps a null handle until upload() takes it
+    _requested[coord] = jobSystem().runOrInline(generate);
+}
+
+void Universe::upload()
+{
+    std::vector<SectorData> generated;
+    {
+        std::lock_guard<std::mutex> lock(_generatedLock);
+        size_t count = std::min<size_t>(_generated.size(), MAX_UPLOADS);
+        generated.assign(std::make_move_iterator(_generated.begin()), std::make_move_iterator(_generated.begin() + count));
+        _generated.erase(_generated.begin(), _generated.begin() + count);
+    }
+    for (auto& data : generated)
+    {
+        _requested.erase(data.coord);
+        Sector& sector = _sectors[data.coord];
+        sector.textures.resize(data.bodies.size());
+        glGenTextures(static_cast<GLsizei>(sector.textures.size()), sector.textures.data());
+        sector.bytes = sizeof(Sector) + data.systems.size() * sizeof(SectorSystem) + data.bodies.size() * sizeof(SectorBody);
+        for (size_t i = 0; i < data.bodies.size(); i++)
+        {
+            SectorBody& body = data.bodies[i];
+            glBindTexture(GL_TEXTURE_2D, sector.textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, body.textureWidth, body.textureHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, body.pixels.data());
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            sector.textureBytes += textureBytes(body.textureWidth, body.textureHeight, 4, true);
+            std::vector<unsigned char>().swap(body.pixels);
+        }
+        sector.bytes += sector.textureBytes;
+        sector.data = std::move(data);
+        sector.lastFrame = gpuMemory().frame();
+        _recent.push_front(sector.data.coord);
+        sector.recent = _recent.begin();
+        _residentBytes += sector.bytes;
+        gpuMemory().allocate(GPU_MEMORY_UNIVERSE, sector.textureBytes);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Universe::evict()
+{
+    while (_residentBytes > _memoryBudget && !_recent.empty())
+    {
+        // everything left is in range, the budget is too small for the load radius
+        if (_sectors.find(_recent.back())->second.lastFrame == gpuMemory().frame())
+            break;
+        evictOldest();
+    }
+}
+
+bool Universe::oldest(unsigned int& frame) const
+{
+    if (_recent.empty())
+        return false;
+    frame = _sectors.find(_recent.back())->second.lastFrame;
+    return true;
+}
+
+void Universe::evictOldest()
+{
+    auto found = _sectors.find(_recent.back());
+    Sector& sector = found->second;
+    glDeleteTextures(static_cast<GLsizei>(sector.textures.size()), sector.textures.data());
+    _residentBytes -= sector.bytes;
+    gpuMemory().release(GPU_MEMORY_UNIVERSE, sector.textureBytes);
+    _recent.pop_back();
+    _sectors.erase(found);
+}
+
+void Universe::update(const glm::vec3& cameraPosition)
+{
+    PROFILE_SCOPE("Universe::update");
+    upload();
+
+    // the sectors in range, nearest first
+    SectorCoord center = sectorOf(cameraPosition);
+    std::vector<std::pair<float, SectorCoord>> wanted;
+    for (int z = -LOAD_RADIUS; z <= LOAD_RADIUS; z++)
+    {
+        for (int y = -LOAD_RADIUS; y <= LOAD_RADIUS; y++)
+        {
+            for (int x = -LOAD_RADIUS; x <= LOAD_RADIUS; x++)
+            {
+                SectorCoord coord = { center.x + x, center.y + y, center.z + z };
+                glm::vec3 middle = (glm::vec3(coord.x, coord.y, coord.z) + 0.5f) * SECTOR_SIZE;
+                wanted.push_back(std::make_pair(glm::length(middle - cameraPosition), coord));
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(), [](const std::pair<float, SectorCoord>& a, const std::pair<float, SectorCoord>& b) { return a.first < b.first; });
+    // generating on the main thread is limited to one sector a frame
+    size_t maxInFlight = jobSystem().threadCount() > 1 ? MAX_IN_FLIGHT : 1;
+
+    for (auto& entry : wanted)
+    {
+        auto found = _sectors.find(entry.second);
+        if (found != _sectors.end())
+        {
+            found->second.lastFrame = gpuMemory().frame();
+            _recent.splice(_recent.begin(), _recent, found->second.recent);
+        }
+    }
+    // a full cache only takes new sectors once the camera has left some of the old ones. The sectors in
+    // range are marked first so making room in video memory doesn't take them.
+    for (auto& entry : wanted)
+    {
+        if (_requested.size() < maxInFlight && _sectors.find(entry.second) == _sectors.end() && _requested.find(entry.second) == _requested.end() &&
+            _residentBytes < _memoryBudget && gpuMemory().makeRoom(0))
+        {
+            request(entry.second);
+        }
+    }
+    evict();
+}
+
+void Universe::draw(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, float time)
+{
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    glActiveTexture(GL_TEXTURE0);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        // the stars first, then the planets lit by their star
+        Shader& shader = pass == 0 ? _starShader : _planetShader;
+        shader.use();
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        shader.setVec3("viewPos", cameraPosition);
+        shader.setVec3("light.ambient", 0.1f, 0.1f, 0.1f);
+        shader.setVec3("light.diffuse", 1.0f, 1.0f, 1.0f);
+        shader.setInt("texture_diffuse1", 0);
+        for (auto& entry : _sectors)
+        {
+            const Sector& sector = entry.second;
+            for (auto& system : sector.data.systems)
+            {
+                if (!frustum.intersectsSphere(system.center, system.radius))
+                    continue;
+                shader.setVec3("light.position", system.center);
+                unsigned int first = pass == 0 ? system.firstBody : system.firstBody + 1;
+                unsigned int last = pass == 0 ? system.firstBody + 1 : system.firstBody + system.bodyCount;
+                for (unsigned int i = first; i < last; i++)
+                {
+                    const SectorBody& body = sector.data.bodies[i];
+                    glm::vec3 position = system.center;
+                    if (body.orbitRadius > 0.0f)
+                    {
+                        float angle = time / body.period + body.phase;
+                        position += body.orbitRadius * glm::vec3(std::cos(angle), 0.0f, -std::sin(angle));
+                    }
+                    if (!frustum.intersectsSphere(position, body.radius))
+                        continue;
+                    glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+                    model = glm::rotate(model, time / body.spin, glm::vec3(0.0f, 1.0f, 0.0f));
+                    model = glm::scale(model, glm::vec3(body.radius));
+                    shader.setMat4("model", model);
+                    glBindTexture(GL_TEXTURE_2D, sector.textures[i]);
+                    _sphere->Draw(shader);
+                }
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -1,4 +1,31 @@
 #include "window.h"
+#include "gpumemory.h"
+
+#include <chrono>
+#include <vector>
+
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef USE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+static WindowBackend activeBackend = BACKEND_WINDOW;
+static OffscreenTarget target;
+static GLFWwindow* hiddenWindow = NULL;
+static std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+#ifdef USE_EGL
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+static EGLSurface eglSurface = EGL_NO_SURFACE;
+#endif
+#ifdef USE_OSMESA
+static OSMesaContext osmesaContext = NULL;
+static std::vector<unsigned char> osmesaBuffer;
+#endif
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
@@ -32,5 +59,249 @@ GLFWwindow* windowInitializations(int width, int height, const char* title) {
 	// Run our resize function whenever the window is resized
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
+	activeBackend = BACKEND_WINDOW;
+	startTime = std::chrono::steady_clock::now();
 	return window;
-}
\ No newline at end of file
+}
+
+#ifdef USE_EGL
+static bool eglInitializations() {
+	// prefer the surfaceless platform, it works without X11/Wayland and without a GPU (llvmpipe)
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL)
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		std::cout << "Failed to initialize EGL" << std::endl;
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	eglContext = eglCreateContext(eglDisplay, configCount > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT) {
+		std::cout << "Failed to create EGL context" << std::endl;
+		return false;
+	}
+
+	// surfaceless first, a 1x1 pbuffer for implementations without EGL_KHR_surfaceless_context
+	if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttributes);
+		if (eglSurface == EGL_NO_SURFACE || !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+			std::cout << "Failed to make the EGL context current" << std::endl;
+			return false;
+		}
+	}
+
+	return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+}
+#endif
+
+#ifdef USE_OSMESA
+static bool osmesaInitializations(int width, int height) {
+	const int attributes[] = {
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, 3,
+		OSMESA_CONTEXT_MINOR_VERSION, 3,
+		0
+	};
+	osmesaContext = OSMesaCreateContextAttribs(attributes, NULL);
+	if (osmesaContext == NULL) {
+		std::cout << "Failed to create OSMesa context" << std::endl;
+		return false;
+	}
+	// OSMesa wants a client-side colour buffer even though we render into our own FBO
+	osmesaBuffer.resize((size_t)width * height * 4);
+	if (!OSMesaMakeCurrent(osmesaContext, osmesaBuffer.data(), GL_UNSIGNED_BYTE, width, height)) {
+		std::cout << "Failed to make the OSMesa context current" << std::endl;
+		return false;
+	}
+
+	return gladLoadGLLoader((GLADloadproc)OSMesaGetProcAddress) != 0;
+}
+#endif
+
+static bool hiddenInitializations(int width, int height) {
+	if (!glfwInit())
+		return false;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	hiddenWindow = glfwCreateWindow(width, height, "", NULL, NULL);
+	if (hiddenWindow == NULL) {
+		std::cout << "Failed to create hidden GLFW window" << std::endl;
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(hiddenWindow);
+	return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+}
+
+bool headlessInitializations(int width, int height, WindowBackend backend) {
+	bool created = false;
+	switch (backend) {
+	case BACKEND_EGL:
+#ifdef USE_EGL
+		created = eglInitializations();
+#else
+		std::cout << "EGL support was not compiled in (define USE_EGL)" << std::endl;
+#endif
+		break;
+	case BACKEND_OSMESA:
+#ifdef USE_OSMESA
+		created = osmesaInitializations(width, height);
+#else
+		std::cout << "OSMesa support was not compiled in (define USE_OSMESA)" << std::endl;
+#endif
+		break;
+	default:
+		created = hiddenInitializations(width, height);
+		backend = BACKEND_HIDDEN;
+		break;
+	}
+	if (!created) {
+		std::cout << "Failed to create a headless OpenGL context" << std::endl;
+		return false;
+	}
+	activeBackend = backend;
+
+	// everything is drawn into this FBO, the rest of the program doesn't know there is no window
+	target.width = width;
+	target.height = height;
+	glGenFramebuffers(1, &target.FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+
+	glGenRenderbuffers(1, &target.colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorBuffer);
+
+	glGenRenderbuffers(1, &target.depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Offscreen framebuffer is not complete" << std::endl;
+		return false;
+	}
+	// four bytes of colour and four of depth and stencil a pixel
+	gpuMemory().allocate(GPU_MEMORY_RENDER_TARGETS, static_cast<size_t>(width) * height * 8);
+	glViewport(0, 0, width, height);
+
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	std::cout << "Headless renderer: " << (renderer ? renderer : "unknown") << std::endl;
+
+	startTime = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool parseWindowBackend(const char* name, WindowBackend& backend) {
+	std::string value(name);
+	if (value == "window")
+		backend = BACKEND_WINDOW;
+	else if (value == "hidden")
+		backend = BACKEND_HIDDEN;
+	else if (value == "egl")
+		backend = BACKEND_EGL;
+	else if (value == "osmesa")
+		backend = BACKEND_OSMESA;
+	else
+		return false;
+	return true;
+}
+
+WindowBackend defaultHeadlessBackend() {
+#if defined(USE_EGL)
+	return BACKEND_EGL;
+#elif defined(USE_OSMESA)
+	return BACKEND_OSMESA;
+#else
+	return BACKEND_HIDDEN;
+#endif
+}
+
+GLADloadproc procAddressLoader() {
+#ifdef USE_EGL
+	if (activeBackend == BACKEND_EGL)
+		return (GLADloadproc)eglGetProcAddress;
+#endif
+#ifdef USE_OSMESA
+	if (activeBackend == BACKEND_OSMESA)
+		return (GLADloadproc)OSMesaGetProcAddress;
+#endif
+	return (GLADloadproc)glfwGetProcAddress;
+}
+
+bool isHeadless() {
+	return activeBackend != BACKEND_WINDOW;
+}
+
+const OffscreenTarget& offscreenTarget() {
+	return target;
+}
+
+void bindRenderTarget() {
+	glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+}
+
+void presentFrame(GLFWwindow* window) {
+	if (window != NULL && !isHeadless()) {
+		glfwSwapBuffers(window);
+		return;
+	}
+	// there is nothing to swap, but the driver must not queue up an unbounded number of frames
+	glFlush();
+}
+
+double getTime() {
+	if (activeBackend == BACKEND_WINDOW)
+		return glfwGetTime();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void windowTerminate() {
+	switch (activeBackend) {
+#ifdef USE_EGL
+	case BACKEND_EGL:
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (eglSurface != EGL_NO_SURFACE)
+			eglDestroySurface(eglDisplay, eglSurface);
+		eglDestroyContext(eglDisplay, eglContext);
+		eglTerminate(eglDisplay);
+		break;
+#endif
+#ifdef USE_OSMESA
+	case BACKEND_OSMESA:
+		OSMesaDestroyContext(osmesaContext);
+		break;
+#endif
+	default:
+		// the visible and the hidden window are both owned by GLFW
+		glfwTerminate();
+		break;
+	}
+}
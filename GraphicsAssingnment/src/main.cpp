@@ -16,6 +16,8 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <memory>
+#include <algorithm>
 
 #include "shader.h"
 #include "stb/stb_image.h"
@@ -23,10 +25,55 @@
 #include "texture.h"
 #include "camera.h"
 #include "model.h"
+#include "resources.h"
+#include "transformation.h"
+#include "scene.h"
+#include "stress.h"
+#include "jobs.h"
+#include "culling.h"
+#include "options.h"
+#include "capture.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "stats.h"
+#include "instancing.h"
+#include "indirect.h"
+#include "occlusion.h"
+#include "bvh.h"
+#include "skybox.h"
+#include "catalog.h"
+#include "pointcloud.h"
+#include "universe.h"
+#include "terrain.h"
+#include "impostor.h"
+#include "streaming.h"
+#include "gpumemory.h"
+#include "compression.h"
+#include "material.h"
 
 
 #define SIMULATION_SPEED 4.0f
-#define NUMBER_OF_STARS 1000
+// the largest bodies are rasterized into the occlusion buffer every frame
+#define MAX_OCCLUDERS 16
+// the bodies' BVH is rebuilt once refitting has made it this much more expensive to traverse
+#define BVH_REBUILD_COST 1.5f
+// the galaxy nodes kept in video memory, the least recently drawn go first
+#define POINT_CLOUD_MEMORY (256u << 20)
+// the generated sectors kept around the camera, the least recently visited go first
+#define UNIVERSE_MEMORY (64u << 20)
+// the terrain chunks kept in video memory for each planet drawn as terrain
+#define TERRAIN_MEMORY (32u << 20)
+// the depth range the scene is drawn in, far / near is all a 24 bit depth buffer resolves
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 10000.0f
+// the ground in front of the near plane is drawn a little past it, so the two depth ranges meet without a crack
+#define NEAR_OVERLAP 1.01f
+// texels across a face of the cubemaps the impostors are coloured from
+#define IMPOSTOR_FACE_SIZE 256
+// the mip levels of the model textures kept in video memory, the least recently wanted go first
+#define TEXTURE_MEMORY (256u << 20)
+// the GPU-driven path works out the on-screen sizes that drive texture streaming every few frames only
+#define STREAMING_FEEDBACK_INTERVAL 4
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
@@ -53,37 +100,76 @@ enum PlanetType{
     EARTH=0, MOON, SUN
 };
 
-// A class that will allow us to create a template for the transformations of each planet
-class Transformation {
-    float _radius;
-    float _period;
-
-    public:
-    Transformation(float radius, float period) {
-        _radius = radius;
-        _period = period;
-    }
-    glm::mat4 use(glm::mat4 model, float time) {
-        model = glm::rotate(model, time / _period, glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::translate(model, glm::vec3(_radius, 0.0f, 0.0f));
-        return model;
-    }
+enum ObjectFlags {
+    OBJECT_HIDDEN = 1 << 0,    // simulated but never drawn
+    OBJECT_TERRAIN = 1 << 1    // drawn as terrain instead of its model
 };
 
+// One celestial body. The model and the shader are shared and only referenced, the motions are a
+// range of one array shared by all objects, which keeps an object down to a few dozen bytes.
 struct Object {
-    Model model;
+    ModelHandle model;
+    unsigned short shader;      // index into the scene's shaders
+    unsigned short flags;
     glm::vec3 scale;
-    std::vector<std::shared_ptr<Transformation>> transformations;
-    Shader shader;
-    glm::mat4 framePosition;
+    unsigned int firstMotion;   // the object's transformations, applied in order
+    unsigned int motionCount;
+};
+
+// Consecutive draws of the sorted draw list that share shader and model, drawn as instances of one call
+struct DrawBatch {
+    unsigned short shader;
+    ModelHandle model;
+    unsigned int firstInstance;     // into the frame's instance matrices
+    unsigned int count;
 };
 
-int main()
+int main(int argc, char** argv)
 {
-    GLFWwindow* window = windowInitializations(SCR_WIDTH, SCR_HEIGHT, "Graphics Assignment");
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return -1;
+
+    // the main thread has to be the first one to touch the job system so it becomes worker 0
+    jobSystem();
+
+    // converting a star catalog is a tool run, nothing is rendered
+    if (!options.importCatalogPath.empty()) {
+        const std::string& csv = options.importCatalogPath;
+        size_t extension = csv.find_last_of('.');
+        size_t directory = csv.find_last_of("/\\");
+        if (extension == std::string::npos || (directory != std::string::npos && extension < directory))
+            extension = csv.size();
+        return importStarCatalog(csv, csv.substr(0, extension) + ".stars") ? 0 : -1;
+    }
 
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // the bodies, their models, motions and shaders come from the scene file
+    SceneDescription scene;
+    if (options.stress)
+        generateStressScene(options.stressSettings, options.seed, scene);
+    else if (!loadScene(options.scenePath, scene))
+        return -1;
+    if (!options.saveScenePath.empty())
+        saveScene(options.saveScenePath, scene);
+
+    // without a window everything is rendered into an offscreen framebuffer, the rest of the program is the same
+    GLFWwindow* window = NULL;
+    if (options.backend == BACKEND_WINDOW) {
+        window = windowInitializations(SCR_WIDTH, SCR_HEIGHT, "Graphics Assignment");
+        if (window == NULL)
+            return -1;
+
+        // a benchmark takes no input, the mouse would turn the camera differently every run
+        if (!options.benchmark) {
+            glfwSetCursorPosCallback(window, mouse_callback);
+            glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        }
+    }
+    else if (!headlessInitializations(SCR_WIDTH, SCR_HEIGHT, options.backend)) {
+        return -1;
+    }
+    PROFILE_INIT_GPU();
+    gpuMemory().setBudget(static_cast<size_t>(options.gpuMemory) << 20);
 
     // configure global opengl state
     // -----------------------------
@@ -91,8 +177,9 @@ int main()
 
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader nonLuminousShader("./assets/shaders/vertex_nonluminous.glsl", "./assets/shaders/fragment_nonluminous.glsl");
-    Shader sunShader("./assets/shaders/vertex_luminous.glsl", "./assets/shaders/fragment_luminous.glsl");
+    std::vector<Shader> shaders;
+    for (auto& shader : scene.shaders)
+        shaders.push_back(Shader(shader.vertex.c_str(), shader.fragment.c_str()));
     Shader starShader("./assets/shaders/vertex_backdrop.glsl", "./assets/shaders/fragment_backdrop.glsl");
 
     // Little cube for a star
@@ -141,9 +228,46 @@ int main()
         -0.5f,  0.5f, -0.5f, 
     };
 
+    // glm's random functions draw from std::rand, seeding it makes the star field reproducible
+    if (options.benchmark)
+        std::srand(options.seed);
+
+    // a star catalog replaces the random stars, it is mapped and uploaded as it is
+    StarCatalog catalog;
+    std::unique_ptr<StarCatalogRenderer> catalogStars;
+    if (!scene.starCatalog.empty() && catalog.open(scene.starCatalog)) {
+        catalogStars.reset(new StarCatalogRenderer());
+        catalogStars->upload(catalog);
+    }
+    float magnitudeLimit = options.magnitudeLimit;
+
+    // the galaxy around the scene, streamed from disk a node at a time
+    std::unique_ptr<PointCloud> galaxy;
+    if (!options.galaxyPath.empty()) {
+        GalaxySettings galaxySettings;
+        galaxySettings.stars = options.galaxyStars;
+        galaxySettings.seed = options.seed;
+        if (options.galaxyStars > 0 && !buildGalaxy(galaxySettings, options.galaxyPath))
+            return -1;
+        galaxy.reset(new PointCloud());
+        if (!galaxy->open(options.galaxyPath, POINT_CLOUD_MEMORY))
+            return -1;
+        if (options.galaxyRaster == POINT_RASTER_COMPUTE)
+            loadGL43(procAddressLoader());
+        galaxy->setRasterMode(options.galaxyRaster);
+    }
+
+    // the procedural universe around the scene, the sectors are generated as the camera comes close
+    std::unique_ptr<Universe> universe;
+    if (options.universe) {
+        universe.reset(new Universe(options.seed, UNIVERSE_MEMORY));
+        // a sector takes 40 seconds to cross at the normal speed
+        camera.MovementSpeed = 10.0f * SPEED;
+    }
+
     std::vector<glm::vec3> starPositions;
-    for (int i = 0; i < 1000; ++i) {
-        glm::vec3 randomPosition = glm::sphericalRand(500.0f);  // Adjust the radius as needed
+    for (unsigned int i = 0; catalog.size() == 0 && i < scene.starCount; ++i) {
+        glm::vec3 randomPosition = glm::sphericalRand(scene.starRadius);
         starPositions.push_back(randomPosition);
     }
 
@@ -157,150 +281,598 @@ int main()
     glBindVertexArray(starVAO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
+
+    // the stars don't move and are far away, baked into a cubemap they cost one fullscreen pass however many there are
+    std::unique_ptr<Skybox> skybox;
+    if (options.skyboxSize > 0) {
+        skybox.reset(new Skybox());
+        skybox->upload(bakeStarfield(starPositions, 0.5f, options.skyboxSize, glm::vec3(0.05f)));
+    }
     
+    // bodies with height maps are drawn as quadtree terrain, their models still occlude and get picked
+    struct TerrainBody {
+        unsigned int object;
+        std::unique_ptr<PlanetTerrain> terrain;
+    };
+    std::vector<TerrainBody> terrains;
+    std::vector<bool> drawnAsTerrain(scene.bodies.size(), false);
+    for (unsigned int i = 0; options.terrain && i < scene.bodies.size(); i++) {
+        const SceneBody& body = scene.bodies[i];
+        if (body.terrainHeight.empty() || body.hidden)
+            continue;
+        std::unique_ptr<PlanetTerrain> terrain(new PlanetTerrain(body.terrainHeight, body.terrainColor, body.terrainRelief, TERRAIN_MEMORY));
+        if (!terrain->valid())
+            continue;
+        drawnAsTerrain[i] = true;
+        terrains.push_back({ i, std::move(terrain) });
+    }
+
     // load models
     // -----------
-    std::string sunPath = "./assets/objects/sun/scene.gltf";
-    std::string moonPath = "./assets/objects/moon/Moon.obj";
-    std::string earthPath = "./assets/objects/earth/Earth.obj";
-
-    Model sunModel(sunPath);
-    Model moonModel(moonPath);
-    Model earthModel(earthPath);
-
-    // Test
-    float earthOrbitRadius = 5.0f;  // adjust based on your scene setup
-    float earthOrbitalPeriod = 10.0f;
-
-    // Positions 
-    glm::vec3 sunPosition = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 moonPosition = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 earthPosition = glm::vec3(0.0f, 0.0f, 0.0f);
-
-    // Create the transformations
-    // Rotation we the period of 100, which is really slow 
-    std::shared_ptr<Transformation> sunSpin = std::make_shared<Transformation>(0.0f, 100.0f);
-    // Rotation around the sun
-    std::shared_ptr<Transformation> earthSunRotation = std::make_shared<Transformation>(47.0f, 20.0f);
-    std::shared_ptr<Transformation> earthSpin = std::make_shared<Transformation>(0.0f, 1.0f);
-    // Rotation around the sun
-    std::shared_ptr<Transformation> moonSunRotation = std::make_shared<Transformation>(47.0f, 20.0f);
-    std::shared_ptr<Transformation> moonEarthRotation= std::make_shared<Transformation>(3.0f, 3.0f);
-    std::shared_ptr<Transformation> moonSpin = std::make_shared<Transformation>(0.0f, 4.0f);
-
-    // Initialize positions
-    glm::mat4 sunFramePosition = glm::translate(glm::mat4(1.0f), sunPosition);
-    glm::mat4 earthFramePosition = glm::translate(glm::mat4(1.0f), earthPosition);
-    glm::mat4 moonFramePosition = glm::translate(glm::mat4(1.0f), moonPosition);
+    // the models are imported in parallel, the GL uploads run here on the main thread while we wait.
+    // Every model is loaded once, however many objects use it.
+    ModelLibrary models;
+    // the models start with their small mip levels, the rest comes in as they are seen from closer
+    std::unique_ptr<TextureStreamer> streamer;
+    if (options.textureStreaming) {
+        streamer.reset(new TextureStreamer(TEXTURE_MEMORY));
+        models.setTextureStreamer(streamer.get());
+    }
+    // textures that weren't compressed offline are encoded on the loading threads, BC1 and BC3 need S3TC
+    bool compressTextures = options.textureCompression && textureCompressionSupported();
+    if (options.textureCompression && !compressTextures)
+        std::cout << "S3TC texture compression is not available, uploading the textures uncompressed" << std::endl;
+    models.setTextureCompression(compressTextures);
+    // a model with layers is drawn with its material instead of its own textures, which aren't loaded then. Only
+    // the models some body draws as a mesh get one, the terrain samples its own maps, and only if the colour map
+    // is there, without it the model keeps its textures.
+    std::vector<bool> layered(scene.models.size(), false);
+    for (unsigned int i = 0; i < scene.bodies.size(); i++) {
+        const SceneBody& body = scene.bodies[i];
+        if (!body.hidden && !drawnAsTerrain[i] && !scene.models[body.model].layers.color.empty())
+            layered[body.model] = true;
+    }
+    for (unsigned int i = 0; i < scene.models.size(); i++) {
+        if (layered[i])
+            layered[i] = MaterialLibrary::available(scene.models[i].layers);
+    }
+    std::vector<ModelHandle> sceneModels;
+    for (unsigned int i = 0; i < scene.models.size(); i++)
+        sceneModels.push_back(models.load(scene.models[i].path, scene.models[i].unique, !layered[i]));
+    // the layered planet materials are packed into texture arrays while the models load
+    MaterialLibrary materials(compressTextures);
+    std::vector<std::pair<ModelHandle, unsigned int>> layeredModels;
+    for (unsigned int i = 0; i < scene.models.size(); i++) {
+        if (layered[i])
+            layeredModels.push_back(std::make_pair(sceneModels[i], materials.add(scene.models[i].layers)));
+    }
+    models.wait();
+    materials.build();
+    for (auto& entry : layeredModels)
+        models.addTextures(entry.first, materials.textures(entry.second));
 
     // Create objects that handle the model, scale and the movement
-    Object sun = { 
-        sunModel, // Model
-        glm::vec3(30.0f), // Scaling
-        {sunSpin}, //Transformations
-        sunShader, // Shader
-        sunFramePosition // Frame position
-    };
-
-    Object earth = { 
-        earthModel, 
-        glm::vec3(0.5f), 
-        {earthSunRotation, earthSpin}, 
-        nonLuminousShader, 
-        earthFramePosition
+    std::vector<Object> objects;
+    std::vector<Transformation> motions;
+    objects.reserve(scene.bodies.size());
+    for (unsigned int i = 0; i < scene.bodies.size(); i++) {
+        const SceneBody& body = scene.bodies[i];
+        Object object;
+        object.model = sceneModels[body.model];
+        object.shader = static_cast<unsigned short>(body.shader);
+        object.flags = body.hidden ? OBJECT_HIDDEN : 0;
+        object.scale = body.scale;
+        object.firstMotion = static_cast<unsigned int>(motions.size());
+        for (auto& motion : scene.motionChain(i))
+            motions.push_back(Transformation(motion.radius, motion.period, motion.phase));
+        object.motionCount = static_cast<unsigned int>(motions.size()) - object.firstMotion;
+        objects.push_back(object);
+    }
+    for (auto& body : terrains)
+        objects[body.object].flags |= OBJECT_TERRAIN;
+    auto terrainRadius = [&](unsigned int i) {
+        const Model& model = models.get(objects[i].model);
+        return (model.occluderRadius > 0.0f ? model.occluderRadius : model.boundingRadius) * objects[i].scale.x;
     };
-    Object moon = { 
-        moonModel, 
-        glm::vec3(0.1f), 
-        {moonSunRotation, moonEarthRotation, moonSpin},  
-        nonLuminousShader, 
-        moonFramePosition
+    // the camera flies as fast as it is high over the nearest terrain, so the ground can be approached
+    float baseSpeed = camera.MovementSpeed;
+
+    // small round bodies are drawn as a quad each instead of their mesh
+    std::unique_ptr<ImpostorRenderer> impostors;
+    if (options.impostorRadius > 0.0f)
+        impostors.reset(new ImpostorRenderer(models, IMPOSTOR_FACE_SIZE));
+    // per model, the largest on-screen diameter of its objects this frame, which picks the texture levels streamed in
+    std::vector<float> modelPixels(models.size(), 0.0f);
+
+    // the position of every object in the last simulated frame, they keep it while the simulation is paused
+    std::vector<glm::mat4> framePositions(objects.size(), glm::mat4(1.0f));
+    // an object's transformations applied in order at a simulation time
+    auto placeObject = [&](size_t i, float time) {
+        glm::mat4 model = glm::mat4(1.0f);
+        for (unsigned int m = 0; m < objects[i].motionCount; m++) {
+            model = motions[objects[i].firstMotion + m].use(model, time);
+        }
+        return model;
     };
 
-    // Create a vector of objects
-    std::vector<Object> objects = { sun, earth, moon };
+    // the occluders are the biggest of the bodies we can be sure are solid all the way to some radius
+    std::vector<unsigned int> occluders;
+    for (unsigned int i = 0; i < objects.size(); i++) {
+        if (!(objects[i].flags & OBJECT_HIDDEN) && models.get(objects[i].model).occluderRadius > 0.0f)
+            occluders.push_back(i);
+    }
+    auto occluderRadius = [&](unsigned int i) {
+        glm::vec3 scale = objects[i].scale;
+        return models.get(objects[i].model).occluderRadius * std::min(scale.x, std::min(scale.y, scale.z));
+    };
+    std::sort(occluders.begin(), occluders.end(), [&](unsigned int a, unsigned int b) { return occluderRadius(a) > occluderRadius(b); });
+    if (occluders.size() > MAX_OCCLUDERS)
+        occluders.resize(MAX_OCCLUDERS);
+    OcclusionBuffer occlusion;
+
+    // with OpenGL 4.3 the objects are moved, culled and drawn by the GPU, the CPU path below is the fallback
+    std::unique_ptr<IndirectRenderer> indirect;
+    if (options.gpuDriven) {
+        if (loadGL43(procAddressLoader())) {
+            std::vector<IndirectObject> indirectObjects;
+            for (auto& object : objects) {
+                if (!(object.flags & (OBJECT_HIDDEN | OBJECT_TERRAIN)))
+                    indirectObjects.push_back({ object.model, object.shader, object.scale, object.firstMotion, object.motionCount });
+            }
+            indirect.reset(new IndirectRenderer());
+            indirect->build(models, indirectObjects, motions, impostors.get(), options.impostorRadius);
+            // the objects are drawn from the shared buffers, the models' own copies would only be counted twice
+            for (auto& object : indirectObjects)
+                models.release(object.model);
+        }
+        else {
+            std::cout << "OpenGL 4.3 is not available, culling and drawing on the CPU" << std::endl;
+        }
+    }
 
     // Various variables for the simulation
     bool motion = true;
     float lastPressTime = 0.0f;
     float delay = 0.2f;
 
-    float motionStartTime = static_cast<float>(glfwGetTime());
-    float motionStopTime = static_cast<float>(glfwGetTime());
-    float elapsedTime;
+    // a benchmark's simulation time is only the fixed steps, two clock readings would differ between runs
+    float motionStartTime = options.benchmark ? 0.0f : static_cast<float>(getTime());
+    float motionStopTime = motionStartTime;
+    float elapsedTime = 0.0f;
+
+    // per-frame culling results
+    std::vector<glm::vec4> objectSpheres(objects.size());
+    std::vector<unsigned char> objectVisible;
+    std::vector<DrawItem> drawList;
+    std::vector<glm::vec4> starSpheres;
+    for (auto& position : starPositions)
+        starSpheres.push_back(glm::vec4(position, 0.87f)); // the unit cube fits in a sphere of radius sqrt(3)/2
+    std::vector<unsigned char> starVisible;
+    // the stars never move, their tree is built once. The bodies' tree follows them by refitting and
+    // holds hidden bodies with a negative radius, which leaves them out of every query.
+    BVH starTree;
+    if (!skybox)
+        starTree.build(starSpheres);
+    BVH objectTree;
+    auto updateObjectTree = [&]() {
+        for (unsigned int i = 0; i < objects.size(); i++) {
+            glm::vec3 scale = objects[i].scale;
+            float radius = models.get(objects[i].model).boundingRadius * std::max(scale.x, std::max(scale.y, scale.z));
+            objectSpheres[i] = glm::vec4(glm::vec3(framePositions[i][3]), objects[i].flags & OBJECT_HIDDEN ? -1.0f : radius);
+        }
+        if (objectTree.empty() || objectTree.refit(objectSpheres) > BVH_REBUILD_COST)
+            objectTree.build(objectSpheres);
+    };
+    // picking and nearest body lookups asked for by the input this frame, answered once the bodies have moved
+    bool pickRequested = false;
+    bool nearestRequested = false;
+    bool pickHeld = false;
+    bool nearestHeld = false;
+    bool magnitudeHeld = false;
+    bool memoryHeld = false;
+    // the model matrices of everything drawn this frame, the objects in draw list order followed by the stars
+    std::vector<DrawBatch> batches;
+    std::vector<glm::mat4> instanceMatrices;
+    unsigned int firstStarInstance = 0;
+    InstanceBuffer instanceBuffer;
+
+    // frame recording reads back asynchronously, so it has to know the size of the framebuffer up front
+    std::unique_ptr<FrameCapture> capture;
+    if (!options.capturePath.empty()) {
+        int captureWidth = SCR_WIDTH;
+        int captureHeight = SCR_HEIGHT;
+        if (window != NULL)
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+        capture.reset(new FrameCapture(captureWidth, captureHeight, options.capturePath, options.captureFormat));
+    }
+
+    // a scripted camera replaces the mouse and keyboard, mostly for reproducible benchmarks
+    CameraPath cameraPath;
+    if (!options.cameraPath.empty() && !cameraPath.load(options.cameraPath))
+        return -1;
+    Benchmark benchmark;
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    unsigned int frameCount = 0;
+    while ((window == NULL || !glfwWindowShouldClose(window)) && (options.frames == 0 || frameCount < options.frames))
     {
+        PROFILE_BEGIN_FRAME();
+        renderStats().reset();
+        gpuMemory().nextFrame();
+        if (options.benchmark)
+            benchmark.beginFrame();
+
         // per-frame time logic
         // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
+        // a benchmark advances the simulation by a fixed step so every run renders the same frames
+        float currentFrame = options.benchmark ? frameCount * options.fixedStep : static_cast<float>(getTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
         // -----
-        processInput(window, motion, motionStartTime, motionStopTime, lastPressTime, delay);
+        {
+            PROFILE_SCOPE("Input");
+            if (window != NULL && !options.benchmark)
+                processInput(window, motion, motionStartTime, motionStopTime, lastPressTime, delay);
+            // a query per press, not per frame the button is held
+            if (window != NULL && !options.benchmark) {
+                bool pick = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+                bool nearest = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+                pickRequested = pick && !pickHeld;
+                nearestRequested = nearest && !nearestHeld;
+                pickHeld = pick;
+                nearestHeld = nearest;
+
+                // - and = (+) trade catalog stars for fill rate half a magnitude at a time
+                float magnitudeStep = 0.0f;
+                if (glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_KP_SUBTRACT) == GLFW_PRESS)
+                    magnitudeStep = -0.5f;
+                if (glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_KP_ADD) == GLFW_PRESS)
+                    magnitudeStep = 0.5f;
+                if (magnitudeStep != 0.0f && !magnitudeHeld && catalogStars) {
+                    magnitudeLimit += magnitudeStep;
+                    std::cout << "Magnitude limit " << magnitudeLimit << ": " << catalog.countBrighterThan(magnitudeLimit) << " stars" << std::endl;
+                }
+                magnitudeHeld = magnitudeStep != 0.0f;
+
+                // M prints the video memory in use
+                bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+                if (memory && !memoryHeld)
+                    gpuMemory().print();
+                memoryHeld = memory;
+            }
+            if (!cameraPath.empty()) {
+                float yaw, pitch;
+                cameraPath.evaluate(currentFrame, camera.Position, yaw, pitch);
+                camera.SetOrientation(yaw, pitch);
+            }
+        }
 
-        // render
+        // update
         // ------
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        {
+            PROFILE_SCOPE("Update");
+            // while the simulation is paused the objects keep the position of their last frame
+            if (motion == true) {
+                elapsedTime = currentFrame - (motionStartTime - motionStopTime);
+                elapsedTime *= SIMULATION_SPEED;
+            }
+            // the GPU-driven path places the objects itself
+            if (motion == true && !indirect) {
+                jobSystem().parallelFor(0, objects.size(), 64, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++)
+                        framePositions[i] = placeObject(i, elapsedTime);
+                });
+            }
+        }
 
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
+        // close to a planet's surface the near plane follows the camera down, from where the terrain was last frame.
+        // Culling sees the whole range. The scene is drawn from NEAR_PLANE out, and the ground in front of that goes
+        // on top afterwards with its own depth range (see the render block), so neither asks the depth buffer for more.
+        float nearPlane = NEAR_PLANE;
+        camera.MovementSpeed = baseSpeed;
+        for (auto& body : terrains) {
+            float altitude = body.terrain->altitude(camera.Position);
+            nearPlane = std::min(nearPlane, std::max(0.5f * altitude, 1e-4f));
+            camera.MovementSpeed = std::min(camera.MovementSpeed, std::max(altitude, 1e-3f * body.terrain->radius()));
+        }
+        float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, nearPlane, FAR_PLANE);
+        glm::mat4 drawProjection = glm::perspective(glm::radians(camera.Zoom), aspect, NEAR_PLANE, FAR_PLANE);
         glm::mat4 view = camera.GetViewMatrix();
 
-        for (auto& object : objects) {
-            object.shader.use();
+        // culling
+        // -------
+        {
+            PROFILE_SCOPE("Culling");
+            Frustum frustum = Frustum::fromMatrix(projection * view);
+            // the big bodies in front of the camera hide whatever is behind them, the GPU-driven path doesn't
+            // keep positions on the CPU so the few occluders are placed here
+            if (options.occlusion) {
+                occlusion.begin(view, projection);
+                for (unsigned int i : occluders) {
+                    glm::vec3 center = glm::vec3((indirect ? placeObject(i, elapsedTime) : framePositions[i])[3]);
+                    occlusion.addOccluder(center, occluderRadius(i));
+                }
+                occlusion.finish();
+            }
 
-            object.shader.setMat4("projection", projection);
-            object.shader.setMat4("view", view);
+            if (galaxy)
+                galaxy->update(projection, view, camera.Position, static_cast<float>(SCR_HEIGHT), options.pointBudget);
+            if (universe)
+                universe->update(camera.Position);
+            for (auto& body : terrains) {
+                unsigned int i = body.object;
+                body.terrain->update(indirect ? placeObject(i, elapsedTime) : framePositions[i], terrainRadius(i), projection, view,
+                    camera.Position, static_cast<float>(SCR_HEIGHT));
+            }
+            if (!skybox) {
+                starTree.cullFrustum(frustum, starVisible);
+                if (options.occlusion)
+                    cullOccluded(occlusion, starSpheres, starVisible);
+            }
 
-            object.shader.setVec3("light.position", sunPosition);
-            object.shader.setVec3("viewPos", camera.Position);
-            object.shader.setVec3("light.ambient", 0.3f, 0.3f, 0.3f);
-            object.shader.setVec3("light.diffuse", 0.8f, 0.8f, 0.8f);
+            // the GPU-driven path culls the objects in its compute shader
+            size_t cpuObjects = indirect ? 0 : objects.size();
+            if (cpuObjects > 0) {
+                if (motion == true || objectTree.empty())
+                    updateObjectTree();
+                objectTree.cullFrustum(frustum, objectVisible);
+                if (options.occlusion)
+                    cullOccluded(occlusion, objectSpheres, objectVisible);
+            }
 
-            glm::mat4 model = glm::mat4(1.0f);
-            if (motion == true) {
-                elapsedTime = currentFrame - (motionStartTime - motionStopTime);
-                elapsedTime *= SIMULATION_SPEED;
+            drawList.clear();
+            float projectedScale = projection[1][1] * SCR_HEIGHT * 0.5f;
+            for (unsigned int i = 0; i < cpuObjects; i++) {
+                if (objectVisible[i] && !(objects[i].flags & (OBJECT_HIDDEN | OBJECT_TERRAIN))) {
+                    float depth = glm::length(glm::vec3(objectSpheres[i]) - camera.Position);
+                    if (impostors && impostors->has(objects[i].model) && depth > objectSpheres[i].w &&
+                        objectSpheres[i].w * projectedScale / depth < options.impostorRadius) {
+                        impostors->add(objects[i].model, glm::scale(framePositions[i], objects[i].scale));
+                        continue;
+                    }
+                    if (streamer) {
+                        float pixels = 2.0f * objectSpheres[i].w * projectedScale / std::max(depth, objectSpheres[i].w);
+                        modelPixels[objects[i].model] = std::max(modelPixels[objects[i].model], pixels);
+                    }
+                    drawList.push_back({ makeSortKey(shaders[objects[i].shader].ID, objects[i].model, depth), i });
+                }
+            }
+            std::sort(drawList.begin(), drawList.end());
+
+            // the key sorts by shader and model first, so the draws that can share a call are already neighbours
+            batches.clear();
+            instanceMatrices.clear();
+            for (auto& item : drawList) {
+                const Object& object = objects[item.object];
+                DrawBatch* last = batches.empty() ? nullptr : &batches.back();
+                if (options.instancing && last != nullptr && last->shader == object.shader && last->model == object.model)
+                    last->count++;
+                else
+                    batches.push_back({ object.shader, object.model, static_cast<unsigned int>(instanceMatrices.size()), 1 });
+                instanceMatrices.push_back(glm::scale(framePositions[item.object], object.scale));
+            }
+            // the GPU-driven path keeps no positions on the CPU, the sizes are worked out every few frames
+            if (streamer && indirect && frameCount % STREAMING_FEEDBACK_INTERVAL == 0) {
+                for (unsigned int i = 0; i < objects.size(); i++) {
+                    if (objects[i].flags & (OBJECT_HIDDEN | OBJECT_TERRAIN))
+                        continue;
+                    glm::vec3 scale = objects[i].scale;
+                    float radius = models.get(objects[i].model).boundingRadius * std::max(scale.x, std::max(scale.y, scale.z));
+                    glm::vec3 center = glm::vec3(placeObject(i, elapsedTime)[3]);
+                    float depth = std::max(glm::length(center - camera.Position), radius);
+                    float pixels = 2.0f * radius * projectedScale / depth;
+                    // the impostors are coloured from their cubemaps
+                    if (!frustum.intersectsSphere(center, radius) || (impostors && impostors->has(objects[i].model) && pixels < 2.0f * options.impostorRadius))
+                        continue;
+                    modelPixels[objects[i].model] = std::max(modelPixels[objects[i].model], pixels);
+                }
+            }
+            if (streamer) {
+                for (ModelHandle m = 0; m < modelPixels.size(); m++) {
+                    if (modelPixels[m] > 0.0f) {
+                        for (auto& texture : models.get(m).textures_loaded)
+                            streamer->want(texture.id, modelPixels[m]);
+                    }
+                    modelPixels[m] = 0.0f;
+                }
+                streamer->update();
+            }
+
+            firstStarInstance = static_cast<unsigned int>(instanceMatrices.size());
+            for (unsigned int i = 0; i < starVisible.size(); i++) {
+                if (starVisible[i])
+                    instanceMatrices.push_back(glm::translate(glm::mat4(1.0f), starPositions[i]));
+            }
+        }
 
-                for (auto& transformation : object.transformations) {
-					model = transformation->use(model, elapsedTime);
-				}
-                object.framePosition = model;
+        // queries
+        // -------
+        // the crosshair is the middle of the screen, so a click picks along the camera's view direction
+        if (pickRequested || nearestRequested) {
+            // the GPU-driven path doesn't keep positions on the CPU, they are only worked out when asked for
+            if (indirect) {
+                for (unsigned int i = 0; i < objects.size(); i++)
+                    framePositions[i] = placeObject(i, elapsedTime);
+                updateObjectTree();
+            }
+            unsigned int body;
+            float distance;
+            if (pickRequested) {
+                if (objectTree.raycast(camera.Position, camera.Front, body, distance))
+                    std::cout << "Picked " << scene.bodies[body].name << " at a distance of " << distance << std::endl;
+                else
+                    std::cout << "Picked nothing" << std::endl;
+            }
+            if (nearestRequested && objectTree.nearest(camera.Position, body, distance))
+                std::cout << "Nearest body: " << scene.bodies[body].name << " at a distance of " << distance << std::endl;
+        }
+
+        // render
+        // ------
+        {
+            PROFILE_SCOPE("Draw");
+            PROFILE_GPU_SCOPE("Frame");
+            bindRenderTarget();
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            if (options.instancing)
+                instanceBuffer.upload(instanceMatrices);
+
+            // the per-frame uniforms, they only have to be set when the shader changes
+            auto prepareShader = [&](Shader& shader) {
+                shader.setMat4("projection", drawProjection);
+                shader.setMat4("view", view);
+
+                shader.setVec3("light.position", scene.light);
+                shader.setVec3("viewPos", camera.Position);
+                shader.setVec3("light.ambient", 0.3f, 0.3f, 0.3f);
+                shader.setVec3("light.diffuse", 0.8f, 0.8f, 0.8f);
+            };
+
+            if (indirect) {
+                PROFILE_GPU_SCOPE("Objects");
+                indirect->cull(elapsedTime, projection, view, camera.Position, SCR_HEIGHT, options.occlusion ? &occlusion : nullptr);
+                indirect->draw(shaders, prepareShader);
             }
             else {
-				model = object.framePosition;
+                PROFILE_GPU_SCOPE("Objects");
+                int currentShader = -1;
+                for (auto& batch : batches) {
+                    Shader& shader = shaders[batch.shader];
+                    if (batch.shader != currentShader) {
+                        currentShader = batch.shader;
+                        shader.use();
+                        prepareShader(shader);
+                    }
+
+                    const Model& model = models.get(batch.model);
+                    if (options.instancing) {
+                        model.DrawInstanced(shader, instanceBuffer, batch.firstInstance, batch.count);
+                    }
+                    else {
+                        shader.setMat4("model", instanceMatrices[batch.firstInstance]);
+                        model.Draw(shader);
+                    }
+                }
+            }
+
+            // the GPU-driven path draws its impostors with the objects
+            if (impostors && impostors->queued() > 0) {
+                PROFILE_GPU_SCOPE("Impostors");
+                impostors->draw(prepareShader);
+            }
+
+            if (!terrains.empty()) {
+                PROFILE_GPU_SCOPE("Terrain");
+                for (auto& body : terrains)
+                    body.terrain->draw(prepareShader);
+            }
+
+            if (universe) {
+                PROFILE_GPU_SCOPE("Universe");
+                universe->draw(drawProjection, view, camera.Position, elapsedTime);
+            }
+
+            // last, so the depth test skips every pixel the objects cover
+            if (skybox) {
+                PROFILE_GPU_SCOPE("Skybox");
+                skybox->draw(drawProjection, view);
+            }
+            else {
+                PROFILE_GPU_SCOPE("Stars");
+                glBindVertexArray(starVAO);
+                starShader.use();
+                starShader.setMat4("projection", drawProjection);
+                starShader.setMat4("view", view);
+                unsigned int starCount = static_cast<unsigned int>(instanceMatrices.size()) - firstStarInstance;
+                starShader.setBool("instanced", options.instancing);
+                if (options.instancing && starCount > 0) {
+                    instanceBuffer.bind(firstStarInstance);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, starCount);
+                    renderStats().addDraw(12 * starCount);
+                }
+                else if (!options.instancing) {
+                    for (unsigned int i = firstStarInstance; i < instanceMatrices.size(); i++) {
+                        starShader.setMat4("model", instanceMatrices[i]);
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                        renderStats().addDraw(12);
+                    }
+                }
+                glBindVertexArray(0);
+            }
+            if (catalogStars) {
+                PROFILE_GPU_SCOPE("Catalog");
+                catalogStars->draw(drawProjection, view, catalog.countBrighterThan(magnitudeLimit));
+            }
+            if (galaxy) {
+                PROFILE_GPU_SCOPE("Galaxy");
+                galaxy->draw(drawProjection, view);
+            }
+
+            // the ground closer than NEAR_PLANE is in front of everything drawn so far, it gets the depth buffer to itself
+            if (nearPlane < NEAR_PLANE) {
+                PROFILE_GPU_SCOPE("Near terrain");
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawProjection = glm::perspective(glm::radians(camera.Zoom), aspect, nearPlane, NEAR_OVERLAP * NEAR_PLANE);
+                for (auto& body : terrains)
+                    body.terrain->draw(prepareShader);
             }
-            model = glm::scale(model, object.scale);
-            object.shader.setMat4("model", model);
-            object.model.Draw(object.shader);
         }
 
-        glBindVertexArray(starVAO);
-        starShader.use();
-        starShader.setMat4("projection", projection);
-        starShader.setMat4("view", view);
-        for (auto& position : starPositions) {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, position);
-            starShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (capture) {
+            PROFILE_SCOPE("Capture");
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreenTarget().FBO);
+            capture->capture();
         }
-        glBindVertexArray(0);
+
+        // everything drawn this frame is marked now, what went unused gives its memory back to the budget
+        gpuMemory().makeRoom(0);
+
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();   
+        presentFrame(window);
+        if (window != NULL)
+            glfwPollEvents();   
+        // the frame time of a benchmark includes the GPU, otherwise it would only measure how fast we queue commands
+        if (options.benchmark) {
+            glFinish();
+            benchmark.endFrame(renderStats());
+        }
+        frameCount++;
+        PROFILE_END_FRAME();
+    }
+
+    // the last frames are still in flight, they need the context to be read back
+    if (capture) {
+        capture->finish();
+        std::cout << "Captured " << capture->framesCaptured() << " frames" << std::endl;
+        capture.reset();
+    }
+
+    if (options.benchmark) {
+        benchmark.report(options.reportPath, options.seed, options.fixedStep);
+        gpuMemory().print();
+        if (!options.curvePath.empty())
+            benchmark.appendCurve(options.curvePath, static_cast<unsigned int>(objects.size()), static_cast<unsigned int>(models.size()), scene.starCount);
+    }
+
+    if (!options.tracePath.empty()) {
+#ifdef ENABLE_PROFILER
+        profiler().printSummary();
+        profiler().writeChromeTrace(options.tracePath);
+#else
+        std::cout << "Profiling is compiled out, build with ENABLE_PROFILER for a trace" << std::endl;
+#endif
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // glfw: terminate, clearing all previously allocated GLFW resources (or the headless context).
     // ------------------------------------------------------------------
-    glfwTerminate();
+    windowTerminate();
     return 0;
 }
 
@@ -0,0 +1,33 @@
+# Benchmarks a series of growing stress scenes and collects frame time against body count in one CSV.
+# Run from the GraphicsAssingnment directory so the assets are found, e.g.
+#     .\tools\stress_sweep.ps1 -Planets 10,100,1000 -Moons 4 -Output curve.csv
+param(
+    [string]$Executable = "..\x64\Release\GraphicsAssingnment.exe",
+    [int[]]$Planets = @(1, 10, 100, 1000),
+    [int]$Moons = 2,
+    [int]$Asteroids = 0,
+    [int]$Stars = 1000,
+    [int]$Frames = 600,
+    [switch]$UniqueModels,
+    [string]$Output = "stress_curve.csv"
+)
+
+if (Test-Path $Output) {
+    Remove-Item $Output
+}
+
+foreach ($count in $Planets) {
+    $arguments = @("--headless", "--benchmark", "--frames", $Frames, "--planets", $count, "--moons", $Moons,
+                   "--asteroids", $Asteroids, "--stars", $Stars, "--curve", $Output)
+    if ($UniqueModels) {
+        $arguments += "--unique-models"
+    }
+    Write-Host "Planets: $count"
+    & $Executable @arguments
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Benchmark failed for $count planets"
+        exit $LASTEXITCODE
+    }
+}
+
+Import-Csv $Output | Format-Table bodies, models, avg_ms, p95_ms, us_per_body, draw_calls